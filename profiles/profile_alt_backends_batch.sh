@@ -0,0 +1,11 @@
+./bin/bihash_application.icl 3 7 255
+./bin/bihash_application.icl 4 7 255
+./bin/bihash_application.icl 5 7 255
+./bin/bihash_application.icl 14 7 255
+./bin/bihash_application.icl 15 7 255
+./bin/bihash_application.icl 22 7 255
+./bin/bihash_application.icl 25 7 255
+./bin/bihash_application.icl 34 8 255
+./bin/bihash_application.icl 35 8 255
+./bin/bihash_application.icl 45 7 255
+./bin/bihash_application.icl 49 7 255
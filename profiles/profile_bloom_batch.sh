@@ -0,0 +1,9 @@
+./bin/bihash_application.icl 1 255 255 bloom 10
+./bin/bihash_application.icl 2 255 255 bloom 10
+./bin/bihash_application.icl 3 255 255 bloom 10
+./bin/bihash_application.icl 4 255 255 bloom 10
+./bin/bihash_application.icl 5 255 255 bloom 10
+./bin/bihash_application.icl 35 255 255 bloom 10
+
+./bin/bihash_application.icl 4 255 255 bloom 6
+./bin/bihash_application.icl 4 255 255 bloom 16
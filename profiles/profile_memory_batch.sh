@@ -0,0 +1,31 @@
+#!/bin/bash
+# Memory footprint against CPO for every kernel, one row per profile/API.
+# Writes memory_vs_cpo.csv, and memory_vs_cpo.png when gnuplot is installed.
+
+OUT=${OUT:-memory_vs_cpo}
+
+for p in 3 4 5 14 15 22 25 34 35 45 49; do
+  ./bin/bihash_application.icl $p 7 255
+done | awk '
+  /^Memory:profile_id/ { split($0, a, /[][]/); profile = a[2] }
+  /^    process:/      { rss = $3 }
+  /^Summary:/          { in_summary = 1; next }
+  /^API /              { next }
+  /^---/               { in_summary = 0 }
+  in_summary && NF >= 8 {
+    print profile "," $1 "," $2 "," $3 "," $7 "," $8 "," rss
+  }
+  BEGIN { print "profile,api,cpo,mops,bytes_per_entry,mops_per_gb,rss_mb" }
+' > $OUT.csv
+
+command -v gnuplot > /dev/null || exit 0
+gnuplot <<PLOT
+set terminal png size 1024,768
+set output "$OUT.png"
+set datafile separator ","
+set key autotitle columnhead
+set xlabel "Bytes/Entry"
+set ylabel "CPO"
+set grid
+plot "$OUT.csv" using 5:3:2 with labels point pt 7 offset char 1,1 notitle
+PLOT
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Record a baseline for the profile x API matrix, or compare this build
+# against one and exit non-zero if any cell regressed.
+#   ./profiles/profile_regression.sh record  data/baseline.csv
+#   ./profiles/profile_regression.sh compare data/baseline.csv
+# PROFILES, CMPS (perf_cmp_id: 7 linear, 8 random) and OPTS (e.g.
+# "repeat 10 threshold 3") can be overridden from the environment.
+
+MODE=${1:?record or compare}
+BASELINE=${2:?baseline file}
+PROFILES=${PROFILES:-"1 3 4 5 14 15 22 25 34 35 45 49"}
+CMPS=${CMPS:-"7 8"}
+OPTS=${OPTS:-}
+
+[ "$MODE" = record ] && rm -f $BASELINE
+
+status=0
+for p in $PROFILES; do
+  for c in $CMPS; do
+    ./bin/bihash_application.icl $p $c 0 $MODE $BASELINE $OPTS \
+      | awk '/^Baseline:/; /^Regression:/,/^regression check/'
+    [ ${PIPESTATUS[0]} -eq 0 ] || status=1
+  done
+done
+exit $status
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Throughput over time: V0 and V4 searching random keys for $SECONDS_ each,
+# one sample every 100 ms. Writes soak.csv, and soak.png when gnuplot is
+# installed.
+
+OUT=${OUT:-soak}
+PROFILE=${PROFILE:-35}
+SECONDS_=${SECONDS_:-60}
+
+./bin/bihash_application.icl $PROFILE 6 0 kernel V0 kernel V4 \
+  soak $SECONDS_ interval 100 counters | awk '
+  /^soak,api,/ { if (!header++) print; next }
+  /^soak,/     { print }
+' > $OUT.csv
+
+command -v gnuplot > /dev/null || exit 0
+gnuplot <<PLOT
+set terminal png size 1024,768
+set output "$OUT.png"
+set datafile separator ","
+set xlabel "ms"
+set ylabel "MOPS"
+set grid
+plot "< grep ',V0,' $OUT.csv" using 3:4 with lines title "V0", \
+     "< grep ',V4,' $OUT.csv" using 3:4 with lines title "V4"
+PLOT
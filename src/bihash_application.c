@@ -1,12 +1,17 @@
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* sched_getcpu, pthread_setaffinity_np */
+#endif
 #include <vlib/vlib.h>
 #include <vppinfra/time.h>
 #include <vppinfra/cache.h>
 #include <vppinfra/error.h>
 #include <sys/resource.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <sys/sysinfo.h>
 #include <openssl/md5.h>
 
 
@@ -20,6 +25,15 @@
 
 #include <vppinfra/bihash_template.h>
 #include <vppinfra/bihash_template.c>
+#include "bihash_locate.h"
+#include "bihash_probe.h"
+
+#include "cuckoo_8_8.h"
+#include "swiss_8_8.h"
+#include "search_kernel.h"
+#include "cold_cache.h"
+#include "timer_calib.h"
+#include "profiler_util.h"
 
 #if BIHASH_ENABLE_STATS
 typedef struct
@@ -141,9 +155,19 @@ int BV (clib_bihash_search_batch_v4)
    BVT (clib_bihash_kv) * search_key, u8 key_mask,
    BVT (clib_bihash_kv) * valuep,u8 * valid_key_idx)
 {
+  BIHASH_PROBE_BATCH (h, search_key, key_mask);
   return BV (clib_bihash_search_inline_2_batch)(h,search_key,key_mask,valuep,valid_key_idx);
 }
 
+/* the filtered and cached batch kernels V13/V15 wrap V4 */
+#include "bloom_8_8.h"
+#include "flow_cache_8_8.h"
+#include "bihash_update.h"
+#include "bihash_batch_n.h"
+#include "bihash_fixed_8_8.h"
+#include "direct_index_8_8.h"
+#include "resize_bihash_8_8.h"
+
 #define reset_keys(kvs,kv_sz,key_val) \
 do{\
     int i;\
@@ -201,9 +225,25 @@ do{\
 #define shift_one_key(kv,shift_nm)
 #endif
 
+/*
+* Timed region of a perf run, see timer_calib.h: serialized timestamps,
+* timer overhead subtracted, core clock sampled around the region.
+*/
+#define perf_timer_begin(start) \
+do{\
+  timer_freq_begin (&bihash_profiler_main.timer);\
+  start = timer_begin ();\
+}while(0)
+
+#define perf_timer_end(start,cycles) \
+do{\
+  cycles = timer_cycles (&bihash_profiler_main.timer, start, timer_end ());\
+  timer_freq_end (&bihash_profiler_main.timer);\
+}while(0)
+
 #define statistic_perf(test_no,if_no,num_of_elm,options,cycles) \
 do{\
-  char *prt_format ="---[item%d]|API V%d|---Dec:searching %d elments---"\
+  char *prt_format ="---[item%d]|API %s|---Dec:searching %d elments---"\
                     "|Cycles/Option:%d|cycles:%ld|options:%ld\n"; \
 \
   fformat (stdout,prt_format, \
@@ -224,12 +264,12 @@ do{ \
   options = 0;\
   u64 start ; \
   reset_one_key(kv,0); \
-  start = clib_cpu_time_now();\
+  perf_timer_begin(start);\
   do{\
 \
     for(i=0;i<loop_cnt_once;i++){\
       \
-      if (BV (clib_bihash_search) (h, &kv, &kv) < 0){\
+      if (if_fn (h, &kv, &kv) < 0){\
       }\
       key_ops_step(kv,ops_flag);\
     }\
@@ -240,13 +280,13 @@ do{ \
 \
   for(i=0;i<div_cnt;i++){\
       \
-      if (BV (clib_bihash_search) (h, &kv, &kv) < 0){\
+      if (if_fn (h, &kv, &kv) < 0){\
       }\
       key_ops_step(kv,ops_flag);\
     }\
     options += div_cnt ;\
   }\
-  cycles = clib_cpu_time_now() - start ;  \
+  perf_timer_end(start,cycles);\
   statistic_perf(test_no,if_no,num_of_elm,options,cycles);\
 }while(0)
 
@@ -582,6 +622,47 @@ profile_type_table g_p_table[] = {
 
 
 
+/*
+* Filter kept in sync with the table by init_hash_table, through the same
+* insert path. perf_cmp_body sets it around the profile's own table only.
+*/
+bloom_bihash_t *init_hash_table_filter;
+
+/*
+* Direct index kept in sync the same way, set by "direct" around the
+* profile's table and by the direct index mode, see direct_index.c.
+*/
+direct_index_bihash_t *init_hash_table_direct;
+
+/*
+* Set by the parallel build, see parallel_build.c: the profile's kvs are
+* collected here in insert order instead of being added to the table.
+*/
+BVT (clib_bihash_kv) **init_hash_table_kvs;
+
+#include "insert_profile.c"
+
+/*
+* Set by the insert profile, see insert_profile.c: every add is timed and
+* its bucket events recorded.
+*/
+insert_profile_t *init_hash_table_inserts;
+
+#define profile_table_add(h,kv) do{\
+  if(init_hash_table_kvs){\
+    vec_add1 (*init_hash_table_kvs, kv);\
+    break;\
+  }\
+  if(init_hash_table_inserts)\
+    insert_profile_add (init_hash_table_inserts, h, &kv);\
+  else\
+    BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );\
+  if(init_hash_table_filter)\
+    bloom_8_8_add (&init_hash_table_filter->filter, kv.key);\
+  if(init_hash_table_direct)\
+    direct_index_8_8_add (&init_hash_table_direct->index, h, &kv);\
+}while(0)
+
 int init_hash_table(
   profile_type_table *table,
   int is_which_profile,
@@ -608,7 +689,7 @@ for (j = 0; j < amount; j++)\
         kv.key = j;\
         kv.value = j+1+0x7FFFFFFFFFFF;\
 \
-        BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );\
+        profile_table_add(h,kv);\
     \
     }\
 }while(0)
@@ -621,7 +702,7 @@ for (j = 0; j < amount; j++)\
         kv.key = (j+1000000*j)%(12208745);\
         kv.value = j+1+0x7FFFFFFFFFFF;\
 \
-        BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );\
+        profile_table_add(h,kv);\
     \
     }\
 }while(0)
@@ -634,7 +715,7 @@ for (j = 0; j < amount; j++)\
         kv.key = j*j;\
         kv.value = j+1+0x7FFFFFFFFFFF;\
 \
-        BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );\
+        profile_table_add(h,kv);\
     \
     }\
 }while(0)
@@ -647,7 +728,7 @@ for (j = 0; j < amount; j++)\
         kv.key = random();\
         kv.value = j;\
 \
-        BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );\
+        profile_table_add(h,kv);\
     \
     }\
 }while(0)
@@ -660,7 +741,7 @@ for (j = 0; j < amount; j++)\
         kv.key = j*amount;\
         kv.value = j;\
 \
-        BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );\
+        profile_table_add(h,kv);\
     \
     }\
 }while(0)
@@ -685,6 +766,9 @@ for (j = 0; j < amount; j++)\
 
 
   BV (clib_bihash_init) (h, "bihash-profiler", user_buckets, user_memory_size);
+  if(init_hash_table_filter)
+    bloom_8_8_init (&init_hash_table_filter->filter, ptbl->element_cnt,
+                    init_hash_table_filter->filter.bits_per_key);
   fformat (stdout, "nbuckets:%d \n",user_buckets);
 
   loop_cnt = ptbl->element_cnt;
@@ -723,6 +807,309 @@ for (j = 0; j < amount; j++)\
 
 }
 
+/**
+ * Bytes held by the table: the bucket array plus every kvp page hanging
+ * off a bucket. Pages stored inline in the bucket are not counted twice.
+ */
+uword BV (clib_bihash_bytes_in_use) (BVT (clib_bihash) * h)
+{
+  BVT (clib_bihash_bucket) * b;
+  uword bytes;
+  u32 i;
+
+  bytes = (uword) h->nbuckets * (sizeof (BVT (clib_bihash_bucket)) +
+    BIHASH_KVP_AT_BUCKET_LEVEL * BIHASH_KVP_PER_PAGE *
+    sizeof (BVT (clib_bihash_kv)));
+
+  for (i = 0; i < h->nbuckets; i++)
+    {
+      b = BV (clib_bihash_get_bucket) (h, i);
+      if (BV (clib_bihash_bucket_is_empty) (b))
+	continue;
+      if (BIHASH_KVP_AT_BUCKET_LEVEL && b->log2_pages == 0)
+	continue;
+      bytes += sizeof (BVT (clib_bihash_value)) << b->log2_pages;
+    }
+  return bytes;
+}
+
+/**
+ * Where the table's memory goes, from the arena allocator's own records.
+ */
+typedef struct
+{
+  uword bucket_bytes;		/* bucket array, kvps at bucket level included */
+  uword arena_bytes;		/* reserved by the arena chunks */
+  uword arena_used_bytes;	/* handed out from the chunks */
+  uword freelist_bytes;		/* handed out, then freed to the free-lists */
+  u32 n_chunks;
+} bihash_mem_stats_t;
+
+void BV (clib_bihash_mem_stats) (BVT (clib_bihash) * h, bihash_mem_stats_t * ms)
+{
+  BVT (clib_bihash_alloc_chunk) * c;
+  BVT (clib_bihash_value) * v;
+  u64 offset;
+  u32 i;
+
+  clib_memset (ms, 0, sizeof (*ms));
+  ms->bucket_bytes = (uword) h->nbuckets * (sizeof (BVT (clib_bihash_bucket)) +
+    BIHASH_KVP_AT_BUCKET_LEVEL * BIHASH_KVP_PER_PAGE *
+    sizeof (BVT (clib_bihash_kv)));
+
+  for (c = h->chunks; c; c = c->next)
+    {
+      ms->arena_bytes += c->size;
+      ms->arena_used_bytes += c->next_alloc - (u8 *) (c + 1);
+      ms->n_chunks++;
+    }
+
+  for (i = 0; i < vec_len (h->freelists); i++)
+    for (offset = h->freelists[i]; offset; offset = v->next_free_as_u64)
+      {
+	v = BV (clib_bihash_get_value) (h, offset);
+	ms->freelist_bytes += sizeof (BVT (clib_bihash_value)) << i;
+      }
+}
+
+/**
+ * Evict the whole table from the caches: every arena chunk holds buckets
+ * or kvp pages, so flushing what the chunks handed out covers both.
+ */
+void BV (clib_bihash_flush_cache) (BVT (clib_bihash) * h)
+{
+  BVT (clib_bihash_alloc_chunk) * c;
+
+  for (c = h->chunks; c; c = c->next)
+    cold_cache_flush_range (c, c->next_alloc - (u8 *) c);
+  cold_cache_flush_range (h, sizeof (*h));
+}
+
+/**
+ * Process side of the footprint: resident set and page faults.
+ */
+typedef struct
+{
+  uword rss_bytes;
+  u64 minor_faults;
+  u64 major_faults;
+} process_mem_stats_t;
+
+void process_mem_stats_get (process_mem_stats_t * ps)
+{
+  struct rusage ru;
+  uword size, resident = 0;
+  FILE *f;
+
+  clib_memset (ps, 0, sizeof (*ps));
+  if ((f = fopen ("/proc/self/statm", "r")))
+    {
+      if (fscanf (f, "%lu %lu", &size, &resident) != 2)
+	resident = 0;
+      fclose (f);
+    }
+  ps->rss_bytes = resident * sysconf (_SC_PAGESIZE);
+
+  if (getrusage (RUSAGE_SELF, &ru) == 0)
+    {
+      ps->minor_faults = ru.ru_minflt;
+      ps->major_faults = ru.ru_majflt;
+    }
+}
+
+static int
+BV (clib_bihash_count_cb) (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  (*(u64 *) arg)++;
+  return BIHASH_WALK_CONTINUE;
+}
+
+u64 BV (clib_bihash_num_keys) (BVT (clib_bihash) * h)
+{
+  u64 n = 0;
+
+  BV (clib_bihash_foreach_key_value_pair) (h, BV (clib_bihash_count_cb), &n);
+  return n;
+}
+
+/**
+ * Alternative backends (V8..V11) holding the same keys as the bihash.
+ */
+typedef struct
+{
+  cuckoo_8_8_t cuckoo;
+  swiss_8_8_t swiss;
+  u64 n_keys;
+  u64 n_failed;
+  u8 is_init;
+} alt_tables_t;
+
+static int
+alt_tables_add_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  alt_tables_t *at = arg;
+
+  at->n_keys++;
+  if (cuckoo_8_8_add (&at->cuckoo, kv) < 0)
+    at->n_failed++;
+  if (swiss_8_8_add (&at->swiss, kv) < 0)
+    at->n_failed++;
+  return BIHASH_WALK_CONTINUE;
+}
+
+/*
+ * Filled by walking the bihash built by init_hash_table, so every backend
+ * holds exactly the same key set, whatever key algorithm the profile uses.
+ */
+int alt_tables_init (alt_tables_t * at, BVT (clib_bihash) * h, u64 n_elts)
+{
+  if (at->is_init)
+    return 0;
+
+  if (cuckoo_8_8_init (&at->cuckoo, n_elts) < 0 ||
+      swiss_8_8_init (&at->swiss, n_elts) < 0)
+    return -1;
+
+  BV (clib_bihash_foreach_key_value_pair) (h, alt_tables_add_cb, at);
+  at->is_init = 1;
+
+  fformat (stdout, "alt_tables: %ld keys, cuckoo %ld buckets %ld kicks %d stashed,"
+	   " swiss %ld groups, %ld failed adds\n",
+	   at->n_keys, at->cuckoo.nbuckets, at->cuckoo.n_kicks,
+	   at->cuckoo.n_stash, at->swiss.n_groups, at->n_failed);
+  return at->n_failed ? -1 : 0;
+}
+
+void alt_tables_free (alt_tables_t * at)
+{
+  if (!at->is_init)
+    return;
+  cuckoo_8_8_free (&at->cuckoo);
+  swiss_8_8_free (&at->swiss);
+  at->is_init = 0;
+}
+
+/* start_mode of perf_cmp_body */
+#define START_MODE_NO_WARMUP 0
+#define START_MODE_WARM      1
+#define START_MODE_COLD      2	/* cold run, then the warm runs */
+
+/**
+ * Profiler state shared with the search kernel registry.
+ */
+typedef struct
+{
+  /* table of the current profile */
+  BVT (clib_bihash) * h;
+  u64 n_elts;
+  alt_tables_t alt_tables;
+
+  /* all known kernels, and the indices of the ones to run */
+  search_kernel_t *kernels;
+  u32 *selected;
+  u32 n_plugin_kernels;
+
+  /* calibrated timer, see timer_calib.h */
+  timer_calib_t timer;
+
+  /* sharded mode, see sharded_table.c; 0: off */
+  u32 n_shards;
+
+  /* chained mode, see chained_tables.c: profiles of the extra tables */
+  u32 *chain_profiles;
+
+  /* filtered kernels V12/V13, see bloom_8_8.h; "bloom <bits>" */
+  bloom_bihash_t filtered;
+  u32 bloom_bits_per_key;
+
+  /* cached kernels V14/V15, see flow_cache_8_8.h; "flowcache <entries>" */
+  flow_cache_bihash_t cached;
+  u32 flow_cache_entries;
+  flow_cache_policy_t flow_cache_policy;
+
+  /* fixed geometry kernels V16/V17, see bihash_fixed_8_8.h */
+  bihash_fixed_t fixed;
+
+  /* direct kernels V18/V19, see direct_index_8_8.h; "direct [<pct>]" */
+  direct_index_bihash_t direct;
+  u32 direct_density_pct;
+  u8 direct_index;
+
+  /* wide key mode, see wide_keys.c */
+  u8 wide_keys;
+
+  /* parallel build, see parallel_build.c; "build <threads>", 0: off */
+  u32 build_threads;
+
+  /* soak mode, see soak.c; "soak <seconds>", 0: off */
+  u32 soak_seconds;
+  u32 soak_interval_ms;
+  u8 soak_counters;
+
+  /* baseline, see regression.c; "record <file>" or "compare <file>" */
+  u8 *baseline_path;
+  u8 baseline_compare;
+  u32 repeat;
+  f64 regression_threshold;
+
+  /* noisy neighbour, see noisy_neighbor.c; "noisy <cpus>" */
+  u8 *noisy_cpus;
+
+  /* online resize, see online_resize.c; "resize [<buckets per step>]" */
+  u8 online_resize;
+  u32 resize_step;
+
+  /* shared-memory readers, see shared_readers.c; "readers [<n>]" */
+  u8 shared_readers_mode;
+  u32 shared_readers;
+
+  /* masked batch, see masked_batch.c; "masked" */
+  u8 masked_batch;
+
+  /* lookup-and-update, see lookup_update.c; "update [<threads>]" */
+  u8 lookup_update;
+  u32 update_threads;
+
+  /* cache sweep, see cache_sweep.c; "cachesweep [<max MB>]" */
+  u8 cache_sweep;
+  u32 cache_sweep_max_mb;
+
+  /* bucket heatmap, see bucket_heatmap.c; "heatmap <1 in n>", 0: off */
+  u32 heatmap_every;
+
+  /* insert profile, see insert_profile.c; "inserts [<n worst>]" */
+  u8 insert_profile;
+  u32 insert_worst;
+  insert_profile_t inserts;
+
+  /* cold runs, see cold_cache.h */
+  cold_cache_t cold_cache;
+
+  /* command line: "kernel <name>", "plugin <path>" */
+  u8 **kernel_names;
+  u8 **plugin_paths;
+} bihash_profiler_main_t;
+
+bihash_profiler_main_t bihash_profiler_main;
+
+#include "search_kernel.c"
+#include "sharded_table.c"
+#include "chained_tables.c"
+#include "filtered_lookup.c"
+#include "cached_lookup.c"
+#include "wide_keys.c"
+#include "parallel_build.c"
+#include "soak.c"
+#include "regression.c"
+#include "bucket_heatmap.c"
+#include "cache_sweep.c"
+#include "lookup_update.c"
+#include "noisy_neighbor.c"
+#include "masked_batch.c"
+#include "direct_index.c"
+#include "shared_readers.c"
+#include "online_resize.c"
+
 #define perf_test_1_linear(test_no,if_no,loops_num,options,cycles,if_fn,h,kv,result) \
 do{ \
   u64 _loop_cnt = loops_num/8;\
@@ -732,7 +1119,7 @@ do{ \
   u8 key_mask = 0xFF;\
   u8 valid_key_idx = 0; \
   reset_keys(kv,8,0);\
-  start = clib_cpu_time_now();\
+  perf_timer_begin(start);\
   do{\
 \
     if (if_fn(h, kv, key_mask,result,&valid_key_idx) < 0){\
@@ -742,7 +1129,7 @@ do{ \
     options+=8; \
 \
   }while(--_loop_cnt);\
-  cycles = clib_cpu_time_now() - start ;  \
+  perf_timer_end(start,cycles);\
   statistic_perf(test_no,if_no,num_of_elm,options,cycles);\
 }while(0)
 
@@ -756,7 +1143,7 @@ do{ \
   u8 key_mask = 0xFF;\
   u8 valid_key_idx = 0; \
   reset_keys(kv,loop_cnt_once,0);\
-  start = clib_cpu_time_now();\
+  perf_timer_begin(start);\
   do{\
 \
     if (if_fn(h, kv, key_mask,result,&valid_key_idx) < 0){\
@@ -778,7 +1165,7 @@ do{ \
     }\
     options+=div_cnt ;\
   }\
-  cycles = clib_cpu_time_now() - start ;  \
+  perf_timer_end(start,cycles);\
   statistic_perf(test_no,if_no,num_of_elm,options,cycles);\
 }while(0)
 
@@ -805,7 +1192,7 @@ do{ \
   u8 key_mask = 0xFF;\
   u8 valid_key_idx = 0; \
   reset_keys(kv,8,0);\
-  start = clib_cpu_time_now();\
+  perf_timer_begin(start);\
   do{\
 \
     if (if_fn(h, kv, key_mask,result,&valid_key_idx) < 0){\
@@ -815,7 +1202,7 @@ do{ \
     options+=8; \
 \
   }while(--_loop_cnt);\
-  cycles = clib_cpu_time_now() - start ;  \
+  perf_timer_end(start,cycles);\
   statistic_perf(test_no,if_no,num_of_elm,options,cycles);\
 }while(0)
 
@@ -826,7 +1213,7 @@ do{ \
   options = 0;\
   u64 start; \
   reset_keys(kv,8,0);\
-  start = clib_cpu_time_now();\
+  perf_timer_begin(start);\
   \
     do{\
 \
@@ -837,7 +1224,7 @@ do{ \
 \
   }while(--_loop_cnt);\
   \
-  cycles = clib_cpu_time_now() - start ;  \
+  perf_timer_end(start,cycles);\
   statistic_perf(test_no,if_no,num_of_elm,options,cycles);\
 }while(0)
 
@@ -845,7 +1232,7 @@ do{ \
 #define dump_md5(if_name,out0) do{\
 \
 int n; \
-fformat (stdout,"["#if_name"]\n\t md5sum:");\
+fformat (stdout,"[%s]\n\t md5sum:",if_name);\
 for(n=0; n<MD5_DIGEST_LENGTH; n++) \
         fformat (stdout,"%02x", out0[n]);\
 fformat (stdout,"\n");\
@@ -881,18 +1268,18 @@ always_inline u64 bitmap_next_set(u64 ai,u64 ei)
         i != ~0; \
         i = bitmap_next_set(ai,i+1))
 
-#define judge_match_result(if_fn0,if_fn1,md5sum0,md5sum1,ret) \
+#define judge_match_result(name0,name1,md5sum0,md5sum1,ret) \
 do{\
   ret = memcmp(out0,out1,MD5_DIGEST_LENGTH) ?1:0; \
   if(!ret){\
-    fformat (stdout,#if_fn0"|-> MATCH <-|"#if_fn1" ---[PASS]\n",if_fn0,if_fn1);\
+    fformat (stdout,"%s|-> MATCH <-|%s ---[PASS]\n",name0,name1);\
   }else{\
-    fformat (stdout,#if_fn0"|-> MATCH <-|"#if_fn1" ---[FAILED]\n",if_fn0,if_fn1);\
-    dump_md5(if_fn0,out0);dump_md5(if_fn1,out1);\
+    fformat (stdout,"%s|-> MATCH <-|%s ---[FAILED]\n",name0,name1);\
+    dump_md5(name0,out0);dump_md5(name1,out1);\
   }\
 }while(0)
 
-#define consistency_test_0(test_no,if_no1,loops_num,h,kv0,kv1,if_fn0,if_fn1) \
+#define consistency_test_0(test_no,if_no1,loops_num,h0,h1,kv0,kv1,if_fn0,if_fn1,name0,name1) \
 do{\
   u64 _loop_cnt = loops_num;\
   MD5_CTX c[2];\
@@ -911,7 +1298,7 @@ do{\
   do{\
   \
     for(i=0;i<8;i++){\
-      if (if_fn0 (h, &kv0, &kv0) == 0){\
+      if (if_fn0 (h0, &kv0, &kv0) == 0){\
       cnts[0]++;\
         sprintf(buf,"%ld",kv0.value);\
         MD5_Update(&c[0], buf, strlen(buf));\
@@ -920,7 +1307,7 @@ do{\
       /* options++ */ ; \
     }\
     \
-    if (if_fn1(h, kv1, key_mask,kv1,&valid_key_idx) > 0){\
+    if (if_fn1(h1, kv1, key_mask,kv1,&valid_key_idx) > 0){\
        bit_foreach(i,valid_key_idx){\
        cnts[1]++;\
           sprintf(buf,"%ld",kv1[i].value);\
@@ -932,12 +1319,12 @@ do{\
   \
   MD5_Final(out0, &c[0]);\
   MD5_Final(out1, &c[1]);\
-  judge_match_result(if_fn0,if_fn1,out0,out1,ret);\
+  judge_match_result(name0,name1,out0,out1,ret);\
  \
 }while(0)
 
 
-#define consistency_test_1(test_no,if_no0,if_no1,loops_num,h,kv0,kv1,if_fn0,if_fn1) \
+#define consistency_test_1(test_no,if_no0,if_no1,loops_num,h0,h1,kv0,kv1,if_fn0,if_fn1,name0,name1) \
 do{\
   u64 _loop_cnt = loops_num;\
   MD5_CTX c[2];\
@@ -954,14 +1341,14 @@ do{\
   \
   do{\
   \
-    if (if_fn0(h, kv0, key_mask,kv0,&valid_key_idx) > 0){\
+    if (if_fn0(h0, kv0, key_mask,kv0,&valid_key_idx) > 0){\
         bit_foreach(i,valid_key_idx){\
           sprintf(buf,"%ld",kv0[i].value);\
           MD5_Update(&c[0], buf, strlen(buf));\
         }\
     }\
     \
-    if (if_fn1(h, kv1, key_mask,kv1,&valid_key_idx) > 0){\
+    if (if_fn1(h1, kv1, key_mask,kv1,&valid_key_idx) > 0){\
        bit_foreach(i,valid_key_idx){\
           sprintf(buf,"%ld",kv1[i].value);\
           MD5_Update(&c[1], buf, strlen(buf));\
@@ -973,7 +1360,7 @@ do{\
   \
   MD5_Final(out0, &c[0]);\
   MD5_Final(out1, &c[1]);\
-  judge_match_result(if_fn0,if_fn1,out0,out1,ret);\
+  judge_match_result(name0,name1,out0,out1,ret);\
 \
 }while(0)
 
@@ -985,17 +1372,23 @@ do{\
 
 int perf_cmp_body(int profile_id,int start_flag,int cmp_msk,int consistency_msk)
 {
-
+  bihash_profiler_main_t *bpm = &bihash_profiler_main;
   BVT (clib_bihash_kv) kv;
   int i, j;
   int ret;
   u64 loop_cnt = 0;
-  u64 cycles[32];
-  u64 options[32];
+  u64 n_keys = 0;
+  process_mem_stats_t ps0, ps1;
+  bihash_mem_stats_t ms;
+  u32 r, n_repeat;
+  int n_regressed = 0;
+  search_kernel_t *k, *k0;
+  u32 *ip, ref;
+  u8 **s;
+  void *table;
 
   BVT (clib_bihash_kv) kv1_8[8];
   BVT (clib_bihash_kv) kv4_8[8];
-  BVT (clib_bihash_kv) kv5_8[8];
   // BVT (clib_bihash_kv) kv14_8[16];
   BVT (clib_bihash) * h;
 
@@ -1016,11 +1409,114 @@ int perf_cmp_body(int profile_id,int start_flag,int cmp_msk,int consistency_msk)
   int is_which_profile;
   int is_which_cmp;
   is_which_profile = profile_id;
+  is_which_cmp = cmp_msk;
+
+  /*
+  * Kernels to run: the perf_cmp_id picks a default set, "kernel <name>"
+  * on the command line replaces it, plugin kernels are always added.
+  */
+  search_kernel_register_builtins (bpm);
+
+  if(vec_len (bpm->kernel_names)){
+    /* a mistyped name fails the run rather than dropping the kernel */
+    vec_foreach (s, bpm->kernel_names)
+      if(search_kernel_select (bpm, (char *) s[0]) < 0){
+        search_kernel_usage (bpm);
+        return 1;
+      }
+  }else if(is_which_cmp == 0xFF || is_which_cmp == 0x6){
+    search_kernel_select (bpm, "V0");
+    search_kernel_select (bpm, "V4");
+    search_kernel_select (bpm, "V5");
+  }else if(is_which_cmp == 0x0 ){
+    search_kernel_select (bpm, "V0");
+  }else if(is_which_cmp == 0x4){
+    search_kernel_select (bpm, "V4");
+  }else if(is_which_cmp == 0x5){
+    search_kernel_select (bpm, "V5");
+  }else if(is_which_cmp == 0x7 || is_which_cmp == 0x8){
+    search_kernel_select (bpm, "V0");
+    search_kernel_select (bpm, "V4");
+    search_kernel_select (bpm, "V5");
+    search_kernel_select (bpm, "V8");
+    search_kernel_select (bpm, "V9");
+    search_kernel_select (bpm, "V10");
+    search_kernel_select (bpm, "V11");
+  }else if(is_which_cmp == 0x9){
+    search_kernel_select (bpm, "V0");
+    search_kernel_select (bpm, "V16");
+    search_kernel_select (bpm, "V4");
+    search_kernel_select (bpm, "V17");
+  }
+
+  vec_foreach (s, bpm->plugin_paths)
+    search_kernel_load_plugin (bpm, (char *) s[0]);
+
+  /* once for every mode: the kernels and the modes all time through it */
+  timer_calibrate (&bpm->timer);
  
+  if(bpm->bloom_bits_per_key){
+    bpm->filtered.filter.bits_per_key = bpm->bloom_bits_per_key;
+    init_hash_table_filter = &bpm->filtered;
+  }
+  if(bpm->direct_index){
+    direct_index_8_8_init (&bpm->direct.index, bpm->direct_density_pct);
+    init_hash_table_direct = &bpm->direct;
+  }
+  if(bpm->insert_profile){
+    insert_profile_init (&bpm->inserts, &bpm->timer);
+    init_hash_table_inserts = &bpm->inserts;
+  }
+  process_mem_stats_get (&ps0);
   ret = init_hash_table(g_p_table,is_which_profile,h,&loop_cnt);
   if(ret < 0 ){
       fformat (stdout, "init_hash_table failed \n");
   }
+  process_mem_stats_get (&ps1);
+  if(init_hash_table_filter){
+    bpm->filtered.h = h;
+    bpm->filtered.is_init = 1;
+    init_hash_table_filter = 0;
+  }
+  if(init_hash_table_direct){
+    direct_index_8_8_seal (&bpm->direct.index);
+    bpm->direct.h = h;
+    bpm->direct.is_init = 1;
+    init_hash_table_direct = 0;
+  }
+  if(init_hash_table_inserts){
+    init_hash_table_inserts = 0;
+    insert_profile_report (&bpm->inserts, h, is_which_profile,
+                           bpm->insert_worst ? bpm->insert_worst : INSERT_PROFILE_DEFAULT_WORST);
+    insert_profile_free (&bpm->inserts);
+  }
+  bpm->h = h;
+  bpm->n_elts = loop_cnt;
+
+  /*
+  * Memory footprint of the table just built, and what building it cost
+  * the process. Profiles 50..59 need tens of GB, watch the rss line.
+  */
+  n_keys = BV (clib_bihash_num_keys) (h);
+  BV (clib_bihash_mem_stats) (h, &ms);
+  /* signed: rss may shrink across the build (frees, madvise) */
+  f64 rss_delta = (f64) ps1.rss_bytes - ps0.rss_bytes;
+  #define MEM_MB(bytes) ( (f64)(bytes) / (1 << 20) )
+  #define MEM_PER_KEY(bytes) ( n_keys ? (f64)(bytes)/n_keys : 0 )
+  fformat (stdout, "Memory:profile_id[%d],%ld keys\n"
+           "    buckets:   %.2f MB\n"
+           "    arena:     %.2f MB allocated in %d chunks, %.2f MB used, %.2f MB on free-lists\n"
+           "    per key:   %.2f bytes used, %.2f bytes allocated\n"
+           "    process:   rss %.2f MB (%s%.2f MB), %ld minor / %ld major page faults in init_hash_table\n",
+           is_which_profile, n_keys,
+           MEM_MB(ms.bucket_bytes),
+           MEM_MB(ms.arena_bytes), ms.n_chunks,
+           MEM_MB(ms.arena_used_bytes), MEM_MB(ms.freelist_bytes),
+           MEM_PER_KEY(ms.arena_used_bytes - ms.freelist_bytes),
+           MEM_PER_KEY(ms.arena_bytes),
+           MEM_MB(ps1.rss_bytes), rss_delta < 0 ? "" : "+", MEM_MB(rss_delta),
+           ps1.minor_faults - ps0.minor_faults,
+           ps1.major_faults - ps0.major_faults);
 
 
 #if BIHASH_ENABLE_STATS
@@ -1044,12 +1540,17 @@ int perf_cmp_body(int profile_id,int start_flag,int cmp_msk,int consistency_msk)
 #endif
   
   f64 base;
+  uword bytes;
   f64 cycles_per_second;
   cycles_per_second = os_cpu_clock_frequency();
   #define ST_1e6(cycles,freq) ( ((f64)(cycles)) / (freq) )
-  #define CPO(x,y) ( (f64)(cycles[(x)] / options[(y)]) )
-  #define OPS(x,y) ( (f64)(options[(x)])  / ST_1e6(1e6*cycles[(y)],cycles_per_second)  ) 
+  #define CPO(k) ( (f64)((k)->cycles / (k)->options) )
+  #define OPS(k) ( (f64)((k)->options)  / ST_1e6(1e6*(k)->cycles,cycles_per_second)  ) 
   #define cpo_per(b,t) ( (b)>0 ? (t)*100/(b): 0)
+  #define BPE(bytes) ( n_keys ? (f64)(bytes)/n_keys : 0 )
+  /* '*': the core clock moved during the run, its CPO is not comparable */
+  #define FREQ_FLAG(k) ( bpm->timer.freq_src == TIMER_FREQ_SRC_NONE ? " n/a" : (k)->freq_stable ? "" : " *" )
+  #define OPS_PER_GB(k,bytes) ( (bytes) ? OPS(k) * (1 << 30) / (bytes) : 0 )
 
 #if 0
 /**
@@ -1057,41 +1558,63 @@ int perf_cmp_body(int profile_id,int start_flag,int cmp_msk,int consistency_msk)
  * for the convenience of pasting to excel tables
  * 
  */
-  #define table_head_line "[items]----|  CPO  |---| MOPS  |---|Ratio for OPS|---|  Cycles |---|  Options  | \n\t"
-  #define new_perf_data_line "[item%d]:     %.2f       %.2f      %.2f%%           %ld          %ld \n\t"
-  #define new_data_line(cycles_id,options_id)    cycles_id,CPO(cycles_id,options_id),OPS(options_id,cycles_id),cpo_per(base,OPS(options_id,cycles_id)),cycles[cycles_id],options[options_id]
+  #define table_head_line "[items]----|  CPO  |---| MOPS  |---|Ratio for OPS|---|  Cycles |---|  Options  |---| Bytes/Entry |---| MOPS/GB |---| Core/TSC | \n\t"
+  #define new_perf_data_line "[item%d]:     %.2f       %.2f      %.2f%%           %ld          %ld          %.2f          %.2f          %.3f%s \n\t"
+  #define new_data_line(k,bytes)    (k)->id,CPO(k),OPS(k),cpo_per(base,OPS(k)),(k)->cycles,(k)->options,BPE(bytes),OPS_PER_GB(k,bytes),(k)->core_ratio,FREQ_FLAG(k)
   #define table_end_line "...........|-------------------------------------------------------------------| \n"
 #else
-  #define table_head_line "CPO  |---| MOPS  |---|Ratio for OPS|---|  Cycles |---|  Options  | \n"
-  #define new_perf_data_line "%.2f       %.2f      %.2f%%           %ld          %ld \n"
-  #define new_data_line(cycles_id,options_id)    CPO(cycles_id,options_id),OPS(options_id,cycles_id),cpo_per(base,OPS(options_id,cycles_id)),cycles[cycles_id],options[options_id]
+  #define table_head_line "API  |---|  CPO  |---| MOPS  |---|Ratio for OPS|---|  Cycles |---|  Options  |---| Bytes/Entry |---| MOPS/GB |---| Core/TSC | \n"
+  #define new_perf_data_line "%s       %.2f       %.2f      %.2f%%           %ld          %ld          %.2f          %.2f          %.3f%s \n"
+  #define new_data_line(k,bytes)    (k)->name,CPO(k),OPS(k),cpo_per(base,OPS(k)),(k)->cycles,(k)->options,BPE(bytes),OPS_PER_GB(k,bytes),(k)->core_ratio,FREQ_FLAG(k)
   #define table_end_line "-------------------------------------------------------------------| \n"
 
 #endif
 
-  #define format_prt_compared(base_cycles_id,base_options_id) \
+  /*
+  * One row per selected kernel, the first selected kernel is the baseline.
+  */
+  #define format_prt_compared() \
   do{\
-  base = OPS(base_cycles_id,base_options_id);\
-  fformat(stdout,"Summary:@%ld options,V0 as the baseline \n"\
-            table_head_line\
-            new_perf_data_line\
-            new_perf_data_line\
-            new_perf_data_line\
-            table_end_line,\
-        options[0],\
-        new_data_line(0,0),\
-        new_data_line(4,4),\
-        new_data_line(5,5)\
-        );\
+  k0 = vec_elt_at_index (bpm->kernels, bpm->selected[0]);\
+  base = OPS(k0);\
+  fformat(stdout,"Summary:@%ld options,%s as the baseline,%ld keys \n"\
+            table_head_line,\
+        k0->options,k0->name,n_keys);\
+  vec_foreach (ip, bpm->selected){\
+    k = vec_elt_at_index (bpm->kernels, ip[0]);\
+    bytes = search_kernel_table_bytes(bpm,k);\
+    fformat(stdout,new_perf_data_line,\
+        new_data_line(k,bytes));\
+  }\
+  fformat(stdout,table_end_line);\
+  }while(0)
+
+  /*
+  * Cold next to warm CPO, cold runs start with the table and the kernel
+  * code evicted (search_kernel_evict), as a first packet of a flow does.
+  */
+  #define format_prt_cold_warm() \
+  do{\
+  fformat(stdout,"Cold vs warm:%s\n"\
+            "API  |---| Cold CPO |---| Warm CPO |---| Cold/Warm | \n",\
+        bpm->cold_cache.disturb_tlb ? " (TLB disturbed)" : "");\
+  vec_foreach (ip, bpm->selected){\
+    k = vec_elt_at_index (bpm->kernels, ip[0]);\
+    f64 cold_cpo = (f64)k->cold_cycles/k->cold_options;\
+    f64 warm_cpo = (f64)k->cycles/k->options;\
+    fformat(stdout,"%s       %.2f       %.2f       %.2f \n",\
+        k->name,cold_cpo,warm_cpo,warm_cpo > 0 ? cold_cpo/warm_cpo : 0);\
+  }\
+  fformat(stdout,table_end_line);\
   }while(0)
 
-  is_which_cmp = cmp_msk;
   int is_consistency = 0xFF;
 
   /*
   * Reason of duplicate execution: we want to know the measure on hot I-Cache&D-Cache.
+  * START_MODE_COLD first runs once right after search_kernel_evict.
   */
-  int start_mode = start_flag;/*0:cold,1:warm*/
+  int start_mode = start_flag;
   #define perf_test_lauch_mode(s_mod,perf_test_fn) do{\
   if(s_mod){\
     perf_test_fn;\
@@ -1099,105 +1622,225 @@ int perf_cmp_body(int profile_id,int start_flag,int cmp_msk,int consistency_msk)
   perf_test_fn;\
   }while(0)
 
-  if(is_which_cmp == 0xFF){
-     /**
-     * 
-     * V0 as baseline, compare V4 and V5 as growing searching keys.
-     * Observe the 'ratio' metric.
-     */
-      fformat (stdout,"perf_test[ALL]...profile_id[%d]\n",is_which_profile);
+  /*
+  * 0x6 and 0x8 search random keys, the other modes linear keys.
+  */
+  int is_random = (is_which_cmp == 0x6 || is_which_cmp == 0x8);
+
+  #define perf_test_kernel(k,table,options,cycles) do{\
+    if((k)->batch_width == 1 && !is_random){\
+      perf_test_0_linear((k)->id,(k)->name,loop_cnt,options,cycles,\
+                (k)->search,table,kv,kv);\
+    }else if((k)->batch_width == 1){\
+      perf_test_0_random((k)->id,(k)->name,loop_cnt,options,cycles,\
+                (k)->search,table,kv,kv);\
+    }else if(!is_random){\
+      perf_test_1_linear((k)->id,(k)->name,loop_cnt,options,cycles,\
+                (k)->search_batch,table,kv4_8,kv4_8);\
+    }else{\
+      perf_test_1_random((k)->id,(k)->name,loop_cnt,options,cycles,\
+                (k)->search_batch,table,kv4_8,kv4_8);\
+    }\
+  }while(0)
 
+  if(vec_len (bpm->selected)){
+    fformat (stdout,"Timer: tsc %.2f MHz, overhead %ld cycles subtracted, core clock from %s, core/tsc %.3f\n",
+             cycles_per_second/1e6, bpm->timer.overhead,
+             timer_freq_src_name (&bpm->timer), bpm->timer.core_ratio);
+    if(is_which_cmp == 0xFF)
+      fformat (stdout,"perf_test[ALL]...profile_id[%d]\n",is_which_profile);
+    else
+      fformat (stdout,"perf_test[%d]...profile_id[%d]\n",is_which_cmp,is_which_profile);
+
+    /* build every table before timing the first kernel */
+    vec_foreach (ip, bpm->selected)
+      search_kernel_table (bpm, vec_elt_at_index (bpm->kernels, ip[0]));
+
+    vec_foreach (ip, bpm->selected){
+      k = vec_elt_at_index (bpm->kernels, ip[0]);
+      table = search_kernel_table (bpm, k);
+      if(start_mode == START_MODE_COLD){
+        search_kernel_evict (bpm, k);
+        fformat (stdout,"cold");
+        perf_test_kernel(k,table,k->cold_options,k->cold_cycles);
+      }
+#if BIHASH_PROBE_STATS
+      bihash_probe_t probe;
+      clib_memset (&probe, 0, sizeof (probe));
+      bihash_probe_start (&probe);
+#endif
       perf_test_lauch_mode(start_mode,
-                perf_test_0_linear(0,0,loop_cnt,options[0],cycles[0],NULL,h,kv,kv));
-      perf_test_lauch_mode(start_mode,
-                perf_test_1_linear(4,4,loop_cnt,options[4],cycles[4],
-                BV (clib_bihash_search_batch_v4),h,kv4_8,kv4_8));
-      perf_test_lauch_mode(start_mode,
-                perf_test_1_linear(5,5,loop_cnt,options[5],cycles[5],
-                BV (clib_bihash_search_batch_v5),h,kv5_8,kv5_8));
-    
-      format_prt_compared(0,0);
+                perf_test_kernel(k,table,k->options,k->cycles));
+#if BIHASH_PROBE_STATS
+      bihash_probe_stop ();
+      if (probe.lookups)
+        fformat (stdout, "%U", format_bihash_probe, &probe, k->name);
+      else
+        fformat (stdout, "Probes:%s,not instrumented,no lookup reached the bihash through a probed path\n",
+                 k->name);
+#endif
+      k->core_ratio = bpm->timer.last_ratio;
+      k->freq_stable = bpm->timer.last_stable;
+
+      /* more warm runs as samples for the baseline */
+      n_repeat = bpm->repeat ? bpm->repeat :
+        bpm->baseline_path ? REGRESSION_DEFAULT_REPEAT : 1;
+      vec_add1 (k->cpo_samples, (f64) k->cycles / k->options);
+      for(r = 1; r < n_repeat; r++){
+        u64 options, cycles;
+        perf_test_kernel(k,table,options,cycles);
+        vec_add1 (k->cpo_samples, (f64) cycles / options);
+      }
+    }
 
-  }else if(is_which_cmp == 0x0 ){
-      fformat (stdout,"perf_test[0]...\n");
-      perf_test_lauch_mode(start_mode,
-                perf_test_0_linear(0,0,loop_cnt,options[0],cycles[0],NULL,h,kv,kv));
-      
-  }else if(is_which_cmp == 0x4){
-      fformat (stdout,"perf_test[4]...\n");
-      perf_test_lauch_mode(start_mode,
-                perf_test_1_linear(4,4,loop_cnt,options[4],cycles[4],
-                BV (clib_bihash_search_batch_v4),h,kv4_8,kv4_8));
-  }else if(is_which_cmp == 0x5){
-      fformat (stdout,"perf_test[5]...\n");
-      perf_test_lauch_mode(start_mode,
-                perf_test_1_linear(5,5,loop_cnt,options[5],cycles[5],
-                BV (clib_bihash_search_batch_v5),h,kv5_8,kv5_8));
+    if(vec_len (bpm->selected) > 1){
+      format_prt_compared();
+    }
+    if(start_mode == START_MODE_COLD){
+      format_prt_cold_warm();
+    }
+
+    if(bpm->n_shards){
+      vec_foreach (ip, bpm->selected)
+        sharded_perf_test (bpm, vec_elt_at_index (bpm->kernels, ip[0]),
+                           cycles_per_second);
+    }
+
+    if(bpm->baseline_path && bpm->baseline_compare){
+      n_regressed = regression_compare (bpm, is_which_profile, is_random);
+    }else if(bpm->baseline_path){
+      regression_record (bpm, is_which_profile, is_random);
+    }
 
-  }else if(is_which_cmp == 0x6){
-    /**
-     * 
-     * V0 as baseline, compare V4 and V5 with random searching keys.
-     * Observe the 'ratio' metric.
-     */
-    fformat (stdout,"perf_test[6]...profile_id[%d]\n",is_which_profile);
+    if(bpm->soak_seconds){
+      vec_foreach (ip, bpm->selected)
+        soak_perf_test (bpm, vec_elt_at_index (bpm->kernels, ip[0]),
+                        cycles_per_second, is_random);
+    }
+  }
+
+  if(vec_len (bpm->chain_profiles)){
+    chained_perf_test (bpm, is_which_profile, loop_cnt, is_random);
+  }
+
+  if(bpm->heatmap_every){
+    bucket_heatmap_perf_test (bpm, is_which_profile, is_random);
+  }
 
-    perf_test_lauch_mode(start_mode,
-                perf_test_0_random(0,0,loop_cnt,options[0],cycles[0],NULL,h,kv,kv));
+  if(bpm->bloom_bits_per_key){
+    filtered_perf_sweep (bpm);
+  }
+
+  if(bpm->flow_cache_entries){
+    cached_perf_sweep (bpm);
+  }
 
-    perf_test_lauch_mode(start_mode,
-                perf_test_1_random(4,4,loop_cnt,options[4],cycles[4],
-                BV (clib_bihash_search_batch_v4),h,kv4_8,kv4_8));
-    perf_test_lauch_mode(start_mode,
-                perf_test_1_random(5,5,loop_cnt,options[5],cycles[5],
-                BV (clib_bihash_search_batch_v5),h,kv5_8,kv5_8));
+  if(bpm->wide_keys){
+    wide_keys_perf_test (bpm);
+  }
 
-    format_prt_compared(0,0);
+  if(bpm->noisy_cpus){
+    noisy_neighbor_perf_test (bpm, cycles_per_second);
+  }
 
+  if(bpm->lookup_update){
+    lookup_update_perf_test (bpm, cycles_per_second);
   }
 
+  if(bpm->shared_readers_mode){
+    shared_readers_perf_test (bpm, cycles_per_second);
+  }
+
+  if(bpm->masked_batch){
+    masked_batch_perf_test (bpm);
+  }
+
+  if(bpm->direct_index){
+    direct_index_perf_test (bpm);
+  }
+
+  if(bpm->online_resize){
+    online_resize_perf_test (bpm, is_which_profile);
+  }
+
+  if(bpm->cache_sweep){
+    cache_sweep_perf_test (bpm);
+  }
+
+  if(bpm->build_threads){
+    parallel_build_perf_test (bpm, is_which_profile, fix_seed);
+  }
+
+  /*
+  * Every kernel is checked against SEARCH_KERNEL_REFERENCE:
+  * 0xFF: all selected kernels, 0: V0, 1: V5, 2: cuckoo V8/V9, 3: swiss V10/V11.
+  */
   is_consistency = consistency_msk;
- 
+  ref = search_kernel_index_by_name (bpm, SEARCH_KERNEL_REFERENCE);
+  k0 = vec_elt_at_index (bpm->kernels, ref);
+
+  #define consistency_test_kernel(test_no,k) \
+  do{\
+    table = search_kernel_table (bpm, (k));\
+    if((k)->batch_width == 1){\
+      consistency_test_0( test_no,\
+                          k0->id,\
+                          loop_cnt,\
+                          table,h,\
+                          kv,\
+                          kv4_8,\
+                          (k)->search,\
+                          k0->search_batch,\
+                          (k)->fn_name,k0->fn_name);\
+    }else{\
+      consistency_test_1( test_no,\
+                          (k)->id,k0->id,\
+                          loop_cnt,\
+                          table,h,\
+                          kv1_8,kv4_8,\
+                          (k)->search_batch,\
+                          k0->search_batch,\
+                          (k)->fn_name,k0->fn_name);\
+    }\
+  }while(0)
+
+  #define consistency_test_by_name(test_no,name) \
+  do{\
+    k = vec_elt_at_index (bpm->kernels, search_kernel_index_by_name (bpm, name));\
+    consistency_test_kernel (test_no, k);\
+  }while(0)
+
   if(is_consistency == 0xFF){
       fformat (stdout,"consistency_test[ALL]...\n");
-      consistency_test_0( 0,
-                          4,
-                          loop_cnt,
-                          h,
-                          kv,
-                          kv4_8,
-                          BV (clib_bihash_search),
-                          BV (clib_bihash_search_batch_v4));
-      consistency_test_1( 1,
-                          1,4,
-                          loop_cnt,
-                          h,
-                          kv1_8,kv4_8,
-                          BV (clib_bihash_search_batch_v5),
-                          BV (clib_bihash_search_batch_v4));
+      if(!vec_len (bpm->selected)){
+        consistency_test_by_name(0,"V0");
+        consistency_test_by_name(1,"V5");
+      }
+      vec_foreach (ip, bpm->selected){
+        if(ip[0] == ref)
+          continue;
+        consistency_test_kernel(0xFF,vec_elt_at_index (bpm->kernels, ip[0]));
+      }
   }else if(is_consistency == 0){
       fformat (stdout,"consistency_test[0]...\n");
-      consistency_test_0( 0,
-                          4,
-                          loop_cnt,
-                          h,
-                          kv,
-                          kv4_8,
-                          BV (clib_bihash_search),
-                          BV (clib_bihash_search_batch_v4));
+      consistency_test_by_name(0,"V0");
   }else if(is_consistency == 1){
       fformat (stdout,"consistency_test[1]...\n");
-      consistency_test_1( 1,
-                          1,4,
-                          loop_cnt,
-                          h,
-                          kv1_8,kv4_8,
-                          BV (clib_bihash_search_batch_v5),
-                          BV (clib_bihash_search_batch_v4));
+      consistency_test_by_name(1,"V5");
+  }else if(is_consistency == 2){
+      fformat (stdout,"consistency_test[2]...\n");
+      consistency_test_by_name(2,"V8");
+      consistency_test_by_name(2,"V9");
+  }else if(is_consistency == 3){
+      fformat (stdout,"consistency_test[3]...\n");
+      consistency_test_by_name(3,"V10");
+      consistency_test_by_name(3,"V11");
   }
   
+  search_kernels_free (bpm);
+  timer_calib_free (&bpm->timer);
   BV (clib_bihash_free) (h);
-  return 0;
+  return n_regressed ? 2 : 0;
 }
 
 
@@ -0,0 +1,175 @@
+/*
+ * Batch search of any n keys, 1 to BIHASH_BATCH_N_MAX, with a sparse
+ * valid mask: key i is searched if bit i of mask is set (mask 0: all n),
+ * where the key_mask of clib_bihash_search_batch_v4 only counts the first
+ * keys. The bitmap of the keys found goes to hits, the kvp of key i to
+ * valuep[i], and the number found is returned.
+ *
+ * The indices of the valid keys are packed first (with AVX512, 16 at a
+ * time by a masked compress store), so a sparse mask still fills the 8
+ * lanes of a group. The groups go through the passes of V4: hash and
+ * prefetch the buckets, locate and prefetch the kvp pages, then compare;
+ * the last group has the lanes it has switched on, not a scalar tail.
+ * With AVX512 the compare pass gathers the lanes' search keys once, then
+ * slot j of their 8 pages by one masked gather and one masked compare;
+ * lanes leave the mask as they hit, and those of linear search buckets go
+ * on to their next page the same way.
+ *
+ * A template like bihash_template.h: included after it.
+ */
+#ifndef BIHASH_TYPE
+#error BIHASH_TYPE not defined
+#endif
+
+#ifndef __included_bihash_batch_n_h__
+#define __included_bihash_batch_n_h__
+#define BIHASH_BATCH_N_MAX 256
+#endif
+
+/* the compare gathers kvp[j].key at v + j * sizeof (kv) */
+STATIC_ASSERT (sizeof (((BVT (clib_bihash_kv) *) 0)->key) == 8,
+	       "one u64 key per kvp");
+STATIC_ASSERT (STRUCT_OFFSET_OF (BVT (clib_bihash_value), kvp) == 0,
+	       "kvps at the start of the page");
+
+/* lanes of key_mask found in the 8 pages v, n_pages[i] of them each;
+   lane i is key idx[i] */
+always_inline u8
+BV (clib_bihash_batch_n_compare) (BVT (clib_bihash_kv) * search_key,
+				  u32 * idx, u8 key_mask,
+				  BVT (clib_bihash_value) ** v, u32 * n_pages,
+				  BVT (clib_bihash_kv) * valuep)
+{
+  u8 found = 0, todo = key_mask, m;
+  u32 i, j, p;
+#ifdef __AVX512F__
+  __m512i keys, pages, kvp_keys;
+  __mmask8 hit;
+
+  /* kv i is u64 2 * i of search_key */
+  keys = _mm512_mask_i32gather_epi64
+    (_mm512_setzero_si512 (), todo,
+     _mm256_slli_epi32 (_mm256_loadu_si256 ((__m256i *) idx), 1),
+     &search_key[0].key, 8);
+  pages = _mm512_loadu_si512 (v);
+  for (p = 0; todo; p++)
+    {
+      for (j = 0; j < BIHASH_KVP_PER_PAGE && todo; j++)
+	{
+	  kvp_keys = _mm512_mask_i64gather_epi64
+	    (keys, todo, _mm512_add_epi64 (pages, _mm512_set1_epi64
+					   (p * sizeof (v[0][0]) +
+					    j * sizeof (search_key[0]))),
+	     (void *) 0, 1);
+	  hit = _mm512_mask_cmpeq_epi64_mask (todo, kvp_keys, keys);
+	  for (m = hit; m; m &= m - 1)
+	    {
+	      i = count_trailing_zeros (m);
+	      valuep[idx[i]] = v[i][p].kvp[j];
+	    }
+	  found |= hit;
+	  todo &= ~hit;
+	}
+      /* lanes with a page past p go on */
+      for (m = todo; m; m &= m - 1)
+	{
+	  i = count_trailing_zeros (m);
+	  if (n_pages[i] <= p + 1)
+	    todo &= ~(1 << i);
+	}
+    }
+#else
+  for (m = todo; m; m &= m - 1)
+    {
+      i = count_trailing_zeros (m);
+      for (p = 0; p < n_pages[i]; p++)
+	for (j = 0; j < BIHASH_KVP_PER_PAGE; j++)
+	  if (BV (clib_bihash_key_compare) (v[i][p].kvp[j].key,
+					    search_key[idx[i]].key))
+	    {
+	      valuep[idx[i]] = v[i][p].kvp[j];
+	      found |= 1 << i;
+	      goto next;
+	    }
+    next:;
+    }
+#endif
+  return found;
+}
+
+static never_inline u32
+BV (clib_bihash_search_batch_n) (BVT (clib_bihash) * h,
+				 BVT (clib_bihash_kv) * search_key, u32 n,
+				 u64 * mask, BVT (clib_bihash_kv) * valuep,
+				 u64 * hits)
+{
+  BVT (clib_bihash_value) * v[8];
+  u32 idx[BIHASH_BATCH_N_MAX + 8], g, i, n_idx = 0, n_pages[8], ret = 0;
+  u64 hash[8], m;
+  u8 key_mask, lanes, found;
+
+  ASSERT (n >= 1 && n <= BIHASH_BATCH_N_MAX);
+  clib_memset (hits, 0, round_pow2 (n, 64) / 8);
+
+  /* the valid keys, packed */
+  for (g = 0; g < n; g += 64)
+    {
+      m = mask ? mask[g / 64] : ~0ULL;
+      if (n - g < 64)
+	m &= pow2_mask (n - g);
+#ifdef __AVX512F__
+      for (i = 0; i < 64 && m >> i; i += 16)
+	{
+	  _mm512_mask_compressstoreu_epi32
+	    (idx + n_idx, (u16) (m >> i),
+	     _mm512_add_epi32 (_mm512_set1_epi32 (g + i),
+			       _mm512_set_epi32 (15, 14, 13, 12, 11, 10, 9, 8,
+						 7, 6, 5, 4, 3, 2, 1, 0)));
+	  n_idx += count_set_bits ((u16) (m >> i));
+	}
+#else
+      for (; m; m &= m - 1)
+	idx[n_idx++] = g + count_trailing_zeros (m);
+#endif
+    }
+
+  /* 8 lanes at a time, the last group with the lanes it has */
+  for (g = 0; g < n_idx; g += 8)
+    {
+      key_mask = pow2_mask (clib_min (n_idx - g, 8));
+
+      for (i = 0; i < 8; i++)
+	if (key_mask & (1 << i))
+	  {
+	    hash[i] = BV (clib_bihash_hash) (&search_key[idx[g + i]]);
+	    BIHASH_PROBE_KEY (h, &search_key[idx[g + i]]);
+	    BV (clib_bihash_prefetch_bucket) (h, hash[i]);
+	  }
+
+      lanes = 0;
+      for (i = 0; i < 8; i++)
+	{
+	  v[i] = 0;
+	  n_pages[i] = 0;
+	  if (!(key_mask & (1 << i)))
+	    continue;
+	  v[i] = BV (clib_bihash_locate) (h, hash[i], &n_pages[i], 0);
+	  if (!v[i])
+	    continue;
+	  CLIB_PREFETCH (v[i], sizeof (v[i][0]), LOAD);
+	  lanes |= 1 << i;
+	}
+
+      if (lanes == 0)
+	continue;
+      found = BV (clib_bihash_batch_n_compare) (search_key, idx + g, lanes, v,
+						n_pages, valuep);
+      for (; found; found &= found - 1)
+	{
+	  i = idx[g + count_trailing_zeros (found)];
+	  hits[i / 64] |= 1ULL << (i % 64);
+	  ret++;
+	}
+    }
+  return ret;
+}
@@ -0,0 +1,121 @@
+/*
+ * Batch search for wide keys (16_8, 40_8, 48_8, ...), same contract as
+ * clib_bihash_search_batch_v4: the first count_set_bits (key_mask) keys
+ * are searched, the bitmap of the keys found goes to valid_key_idx and
+ * their number is returned.
+ *
+ * The 8 keys go through three passes: hash and prefetch the buckets,
+ * locate and prefetch the kvp pages, then compare. With AVX512 the search
+ * key sits in one zmm register and a kvp is compared with it by a masked
+ * load of its key lanes and one masked compare, whatever the key width.
+ * The page is walked up to the first match: comparing all of its kvps
+ * without a branch touches every cache line of a 40_8/48_8 page and was
+ * slower.
+ *
+ * A template like bihash_template.h: included once per instantiation,
+ * after it.
+ */
+#ifndef BIHASH_TYPE
+#error BIHASH_TYPE not defined
+#endif
+
+#ifndef __included_bihash_batch_wide_h__
+#define __included_bihash_batch_wide_h__
+#define bihash_wide_key_u64s  (sizeof (((BVT (clib_bihash_kv) *) 0)->key) / 8)
+#endif
+
+STATIC_ASSERT (bihash_wide_key_u64s <= 8, "key wider than a zmm register");
+
+#ifdef __AVX512F__
+/* index of the kvp of page v holding key, -1 if none */
+always_inline int
+BV (clib_bihash_wide_page_search) (BVT (clib_bihash_value) * v, __m512i key)
+{
+  __mmask8 key_lanes = pow2_mask (bihash_wide_key_u64s);
+  u32 i;
+
+  for (i = 0; i < BIHASH_KVP_PER_PAGE; i++)
+    if (_mm512_mask_cmpeq_epi64_mask
+	(key_lanes, _mm512_maskz_loadu_epi64 (key_lanes, v->kvp[i].key),
+	 key) == key_lanes)
+      return i;
+  return -1;
+}
+#endif
+
+static never_inline int
+BV (clib_bihash_search_batch_wide) (BVT (clib_bihash) * h,
+				    BVT (clib_bihash_kv) * search_key,
+				    u8 key_mask, BVT (clib_bihash_kv) * valuep,
+				    u8 * valid_key_idx)
+{
+  BVT (clib_bihash_bucket) * b;
+  BVT (clib_bihash_value) * v[8];
+  u32 i, p, n_pages[8], n_keys = count_set_bits (key_mask);
+  u64 hash[8];
+  u8 bitmap = 0;
+  int j, ret = 0;
+#ifdef __AVX512F__
+  __m512i key;
+#endif
+
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = BV (clib_bihash_hash) (&search_key[i]);
+      BV (clib_bihash_prefetch_bucket) (h, hash[i]);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    {
+      b = BV (clib_bihash_get_bucket) (h, hash[i]);
+      if (PREDICT_FALSE (BV (clib_bihash_bucket_is_empty) (b)))
+	{
+	  n_pages[i] = 0;
+	  continue;
+	}
+      if (PREDICT_FALSE (b->lock))
+	{
+	  volatile BVT (clib_bihash_bucket) * bv = b;
+	  while (bv->lock)
+	    CLIB_PAUSE ();
+	}
+      v[i] = BV (clib_bihash_get_value) (h, b->offset);
+      n_pages[i] = 1;
+      if (PREDICT_FALSE (b->linear_search))
+	n_pages[i] <<= b->log2_pages;
+      else
+	v[i] += (hash[i] >> h->log2_nbuckets) & ((1 << b->log2_pages) - 1);
+      CLIB_PREFETCH (v[i], sizeof (v[i][0]), LOAD);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    {
+#ifdef __AVX512F__
+      key = _mm512_maskz_loadu_epi64 (pow2_mask (bihash_wide_key_u64s),
+				      search_key[i].key);
+#endif
+      for (p = 0; p < n_pages[i]; p++)
+	{
+#ifdef __AVX512F__
+	  j = BV (clib_bihash_wide_page_search) (v[i] + p, key);
+#else
+	  for (j = 0; j < BIHASH_KVP_PER_PAGE; j++)
+	    if (BV (clib_bihash_key_compare) (v[i][p].kvp[j].key,
+					      search_key[i].key))
+	      break;
+	  if (j == BIHASH_KVP_PER_PAGE)
+	    j = -1;
+#endif
+	  if (j >= 0)
+	    {
+	      valuep[i] = v[i][p].kvp[j];
+	      bitmap |= 1 << i;
+	      ret++;
+	      break;
+	    }
+	}
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
@@ -0,0 +1,173 @@
+/*
+ * Search kernels specialized at compile time for one table geometry:
+ * BIHASH_FIXED_NBUCKETS buckets (1048576, as every profile of g_p_table,
+ * unless built with -DBIHASH_FIXED_NBUCKETS=<n>, see CMakeLists.txt) of
+ * the bihash_8_8 layout.
+ *
+ * The bucket mask, the page shift and the bucket stride are constants
+ * instead of h->nbuckets and h->log2_nbuckets, and the BIHASH_KVP_PER_PAGE
+ * kvps of a page are compared without a loop, the hit picked from the
+ * compare bitmap. The bucket array and the kvp arena are runtime
+ * addresses: taken once from the bihash when the table is set up and
+ * loaded from bihash_fixed_t, next to each other, once per call.
+ *
+ * The kernels V16 (scalar) and V17 (8 keys, the passes of V4) search the
+ * profile's bihash, or a copy with the fixed geometry if its nbuckets
+ * differs.
+ */
+#ifndef __included_bihash_fixed_8_8_h__
+#define __included_bihash_fixed_8_8_h__
+
+#ifndef BIHASH_FIXED_NBUCKETS
+#define BIHASH_FIXED_NBUCKETS 1048576
+#endif
+
+STATIC_ASSERT ((BIHASH_FIXED_NBUCKETS & (BIHASH_FIXED_NBUCKETS - 1)) == 0,
+	       "BIHASH_FIXED_NBUCKETS must be a power of 2");
+STATIC_ASSERT (BIHASH_KVP_PER_PAGE == 4, "page compare unrolled for 4 kvps");
+
+#define BIHASH_FIXED_LOG2_NBUCKETS __builtin_ctzll (BIHASH_FIXED_NBUCKETS)
+
+typedef struct
+{
+  u8 *buckets;
+  u8 *arena;
+  BVT (clib_bihash) * h;
+  BVT (clib_bihash) copy;	/* the profile's kvs, if its geometry differs */
+  u8 is_copy;
+  u8 is_init;
+} bihash_fixed_t;
+
+always_inline BVT (clib_bihash_bucket) *
+bihash_fixed_bucket (u8 * buckets, u64 hash)
+{
+  return (BVT (clib_bihash_bucket) *)
+    (buckets + (hash & (BIHASH_FIXED_NBUCKETS - 1)) *
+     BIHASH_BUCKET_BYTES);
+}
+
+/* page of the key hashed to hash, 0 if its bucket is empty: the walk of
+   bihash_locate.h with the constant page shift */
+always_inline BVT (clib_bihash_value) *
+bihash_fixed_page (u8 * arena, BVT (clib_bihash_bucket) * b, u64 hash,
+		   u32 * n_pages)
+{
+  return BV (clib_bihash_locate_page) (arena, b,
+				       hash >> BIHASH_FIXED_LOG2_NBUCKETS,
+				       n_pages, 0);
+}
+
+/* slot of key in page v, -1 if none */
+always_inline int
+bihash_fixed_page_search (BVT (clib_bihash_value) * v, u64 key)
+{
+  u32 m = (v->kvp[0].key == key) | (v->kvp[1].key == key) << 1 |
+    (v->kvp[2].key == key) << 2 | (v->kvp[3].key == key) << 3;
+
+  return m ? count_trailing_zeros (m) : -1;
+}
+
+always_inline int
+bihash_fixed_search_inline (BVT (clib_bihash_value) * v, u32 n_pages,
+			    BVT (clib_bihash_kv) * search_key,
+			    BVT (clib_bihash_kv) * valuep)
+{
+  u32 p;
+  int j;
+
+  for (p = 0; p < n_pages; p++)
+    if ((j = bihash_fixed_page_search (v + p, search_key->key)) >= 0)
+      {
+	*valuep = v[p].kvp[j];
+	return 0;
+      }
+  return -1;
+}
+
+/* Same contract as clib_bihash_search */
+static never_inline int
+bihash_fixed_search (bihash_fixed_t * t, BVT (clib_bihash_kv) * search_key,
+		     BVT (clib_bihash_kv) * valuep)
+{
+  u8 *buckets = t->buckets, *arena = t->arena;
+  u64 hash = BV (clib_bihash_hash) (search_key);
+  BVT (clib_bihash_value) * v;
+  u32 n_pages;
+
+  BIHASH_PROBE_KEY (t->h, search_key);
+  v = bihash_fixed_page (arena, bihash_fixed_bucket (buckets, hash), hash,
+			 &n_pages);
+  if (!v)
+    return -1;
+  return bihash_fixed_search_inline (v, n_pages, search_key, valuep);
+}
+
+/* Same contract as clib_bihash_search_batch_v4 */
+static never_inline int
+bihash_fixed_search_batch (bihash_fixed_t * t,
+			   BVT (clib_bihash_kv) * search_key, u8 key_mask,
+			   BVT (clib_bihash_kv) * valuep, u8 * valid_key_idx)
+{
+  u8 *buckets = t->buckets, *arena = t->arena;
+  BVT (clib_bihash_value) * v[8];
+  u32 i, n_pages[8], n_keys = count_set_bits (key_mask);
+  u64 hash[8];
+  u8 bitmap = 0;
+  int ret = 0;
+
+  BIHASH_PROBE_BATCH (t->h, search_key, key_mask);
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = BV (clib_bihash_hash) (&search_key[i]);
+      CLIB_PREFETCH (bihash_fixed_bucket (buckets, hash[i]),
+		     CLIB_CACHE_LINE_BYTES, LOAD);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    if ((v[i] = bihash_fixed_page (arena, bihash_fixed_bucket
+				   (buckets, hash[i]), hash[i], &n_pages[i])))
+      CLIB_PREFETCH (v[i], sizeof (v[i][0]), LOAD);
+
+  for (i = 0; i < n_keys; i++)
+    if (v[i] && bihash_fixed_search_inline (v[i], n_pages[i],
+					    &search_key[i], &valuep[i]) == 0)
+      {
+	bitmap |= 1 << i;
+	ret++;
+      }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+/* t searches h, or a copy of it if h has another nbuckets */
+static void
+bihash_fixed_init (bihash_fixed_t * t, BVT (clib_bihash) * h)
+{
+  clib_memset (t, 0, sizeof (*t));
+  t->h = h;
+  if (h->nbuckets != BIHASH_FIXED_NBUCKETS)
+    {
+      fformat (stdout, "fixed geometry: %d buckets, the table has %d, searching a copy\n",
+	       BIHASH_FIXED_NBUCKETS, h->nbuckets);
+      BV (clib_bihash_init) (&t->copy, "fixed-geometry",
+			     BIHASH_FIXED_NBUCKETS, 32ULL << 30);
+      BV (clib_bihash_foreach_key_value_pair) (h, profiler_copy_kv_cb,
+					       &t->copy);
+      t->h = &t->copy;
+      t->is_copy = 1;
+    }
+  t->buckets = (u8 *) BV (clib_bihash_get_bucket) (t->h, 0);
+  t->arena = (u8 *) BV (clib_bihash_get_value) (t->h, 0);
+  t->is_init = 1;
+}
+
+static void
+bihash_fixed_free (bihash_fixed_t * t)
+{
+  if (t->is_copy)
+    BV (clib_bihash_free) (&t->copy);
+  clib_memset (t, 0, sizeof (*t));
+}
+
+#endif /* __included_bihash_fixed_8_8_h__ */
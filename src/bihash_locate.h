@@ -0,0 +1,62 @@
+/*
+ * The walk of clib_bihash_search_inline_2_with_hash down to a kvp page,
+ * shared by every path of the tool which searches a bucket itself: the
+ * probe build, the heatmap, lookup-and-update, the any n batch and the
+ * fixed geometry kernels. The bucket of the hash, empty or not, a wait
+ * while its lock bit is set, then the page: all 2^log2_pages pages of a
+ * linear search bucket from the first, else the one the hash bits above
+ * log2_nbuckets select.
+ *
+ * A template like bihash_template.h: included after it.
+ */
+#ifndef BIHASH_TYPE
+#error BIHASH_TYPE not defined
+#endif
+
+/*
+ * Page of bucket b holding the key, 0 if b is empty. arena: the kvp
+ * arena (BV (clib_bihash_get_value) at offset 0), page_hash: the hash
+ * shifted right by log2_nbuckets. *n_pages pages of BIHASH_KVP_PER_PAGE
+ * kvps are searched from there; *lock_spins, if not 0, gets the times
+ * the lock bit was found set.
+ */
+always_inline BVT (clib_bihash_value) *
+BV (clib_bihash_locate_page) (u8 * arena, BVT (clib_bihash_bucket) * b,
+			      u64 page_hash, u32 * n_pages, u32 * lock_spins)
+{
+  BVT (clib_bihash_value) * v;
+  u32 spins = 0;
+
+  if (PREDICT_FALSE (BV (clib_bihash_bucket_is_empty) (b)))
+    return 0;
+  if (PREDICT_FALSE (b->lock))
+    {
+      volatile BVT (clib_bihash_bucket) * bv = b;
+      while (bv->lock)
+	{
+	  spins++;
+	  CLIB_PAUSE ();
+	}
+    }
+  if (lock_spins)
+    *lock_spins = spins;
+
+  v = (BVT (clib_bihash_value) *) (arena + b->offset);
+  *n_pages = 1;
+  if (PREDICT_FALSE (b->linear_search))
+    *n_pages <<= b->log2_pages;
+  else
+    v += page_hash & ((1 << b->log2_pages) - 1);
+  return v;
+}
+
+/* the same in bihash h, from the full hash */
+always_inline BVT (clib_bihash_value) *
+BV (clib_bihash_locate) (BVT (clib_bihash) * h, u64 hash, u32 * n_pages,
+			 u32 * lock_spins)
+{
+  return BV (clib_bihash_locate_page)
+    ((u8 *) BV (clib_bihash_get_value) (h, 0),
+     BV (clib_bihash_get_bucket) (h, hash), hash >> h->log2_nbuckets,
+     n_pages, lock_spins);
+}
@@ -0,0 +1,160 @@
+/*
+ * Probe counting build (BIHASH_PROBE_STATS=1, the bihash_application.*.probe
+ * targets of CMakeLists.txt): every lookup which reaches the bihash_8_8
+ * while a probe is started is walked a second time down its bucket, by
+ * the walk of bihash_locate.h the search paths share, counting the kvp pages
+ * examined, the kvps compared up to the hit, whether the bucket is a
+ * linear search one and how many times the walk found the lock bit set.
+ *
+ * The walk hooks into the search paths: clib_bihash_search (V0, and V5
+ * which calls it per key) is redirected to a probed wrapper, V4,
+ * clib_bihash_search_batch_n, the fixed geometry kernels (V16, V17, walked
+ * in the bihash they were set up from), resize_bihash_search and the
+ * lookup-and-update forms probe the keys they search. Kernels built on
+ * them (V13, V19, ...) are counted by the lookups they send on; a kernel
+ * that never reaches the bihash (cuckoo, swiss, ...) is reported as not
+ * instrumented. Timings of the probe build are not comparable: in any
+ * other build the hooks are empty.
+ *
+ * One probe at a time, from one thread. A template like
+ * bihash_template.h: included after bihash_template.c, for 8_8 only.
+ */
+#ifndef __included_bihash_probe_h__
+#define __included_bihash_probe_h__
+
+#ifndef BIHASH_PROBE_STATS
+#define BIHASH_PROBE_STATS 0
+#endif
+
+#if BIHASH_PROBE_STATS
+
+#if BIHASH_USING_8_8_STATS
+#error "the probe build redirects clib_bihash_search_8_8"
+#endif
+
+#define BIHASH_PROBE_BINS 33	/* 0..31, and 32 or more */
+
+typedef struct
+{
+  u64 lookups;
+  u64 hits;
+  u64 empty;			/* bucket empty, nothing examined */
+  u64 linear;			/* linear search bucket */
+  u64 n_pages, n_kvps, n_lock_retries;
+
+  /* lookups by count */
+  u64 pages[BIHASH_PROBE_BINS];
+  u64 kvps[BIHASH_PROBE_BINS];
+  u64 lock_retries[BIHASH_PROBE_BINS];
+} bihash_probe_t;
+
+/* counting while not 0 */
+static bihash_probe_t *bihash_probe_current;
+
+static void
+bihash_probe_start (bihash_probe_t * p)
+{
+  bihash_probe_current = p;
+}
+
+static void
+bihash_probe_stop (void)
+{
+  bihash_probe_current = 0;
+}
+
+static never_inline void
+BV (clib_bihash_probe_key) (bihash_probe_t * p, BVT (clib_bihash) * h,
+			    BVT (clib_bihash_kv) * search_key)
+{
+  u64 hash = BV (clib_bihash_hash) (search_key);
+  BVT (clib_bihash_bucket) * b = BV (clib_bihash_get_bucket) (h, hash);
+  BVT (clib_bihash_value) * v;
+  u32 kvps = 0, retries = 0, n_pages, limit, i;
+  int hit = 0;
+
+  p->lookups++;
+  v = BV (clib_bihash_locate) (h, hash, &n_pages, &retries);
+  if (!v)
+    {
+      p->empty++;
+      goto done;
+    }
+  p->linear += b->linear_search;
+  limit = n_pages * BIHASH_KVP_PER_PAGE;
+  for (i = 0; i < limit && !hit; i++)
+    {
+      kvps++;
+      hit = BV (clib_bihash_key_compare) (v->kvp[i].key, search_key->key);
+    }
+
+done:
+  p->hits += hit;
+  p->n_pages += round_pow2 (kvps, BIHASH_KVP_PER_PAGE) / BIHASH_KVP_PER_PAGE;
+  p->n_kvps += kvps;
+  p->n_lock_retries += retries;
+  p->pages[clib_min (round_pow2 (kvps, BIHASH_KVP_PER_PAGE) /
+		     BIHASH_KVP_PER_PAGE, BIHASH_PROBE_BINS - 1)]++;
+  p->kvps[clib_min (kvps, BIHASH_PROBE_BINS - 1)]++;
+  p->lock_retries[clib_min (retries, BIHASH_PROBE_BINS - 1)]++;
+}
+
+#define BIHASH_PROBE_KEY(h, kv)                                         \
+do {                                                                    \
+  if (PREDICT_FALSE (bihash_probe_current != 0))                        \
+    BV (clib_bihash_probe_key) (bihash_probe_current, h, kv);           \
+} while (0)
+
+/* the keys of key_mask, as clib_bihash_search_batch_v4 takes them */
+#define BIHASH_PROBE_BATCH(h, kvs, key_mask)                            \
+do {                                                                    \
+  u32 _i;                                                               \
+  if (PREDICT_FALSE (bihash_probe_current != 0))                        \
+    for (_i = 0; _i < count_set_bits (key_mask); _i++)                  \
+      BV (clib_bihash_probe_key) (bihash_probe_current, h, &(kvs)[_i]); \
+} while (0)
+
+static int
+BV (clib_bihash_search_probed) (BVT (clib_bihash) * h,
+				BVT (clib_bihash_kv) * search_key,
+				BVT (clib_bihash_kv) * valuep)
+{
+  BIHASH_PROBE_KEY (h, search_key);
+  return BV (clib_bihash_search) (h, search_key, valuep);
+}
+
+/* from here on every clib_bihash_search is probed */
+#define clib_bihash_search_8_8 clib_bihash_search_probed_8_8
+
+static u8 *
+format_bihash_probe (u8 * s, va_list * args)
+{
+  bihash_probe_t *p = va_arg (*args, bihash_probe_t *);
+  char *name = va_arg (*args, char *);
+  u64 n = clib_max (p->lookups, 1);
+  u32 i;
+
+  s = format (s, "Probes:%s,%ld lookups into the bihash,%.2f%% hits,%.2f%% empty buckets,%.2f%% linear buckets,"
+	      "per lookup %.3f pages %.3f kvps %.4f lock retries\n"
+	      "count |---| pages |---| kvps |---| lock retries | \n",
+	      name, p->lookups, 100.0 * p->hits / n, 100.0 * p->empty / n,
+	      100.0 * p->linear / n, (f64) p->n_pages / n, (f64) p->n_kvps / n,
+	      (f64) p->n_lock_retries / n);
+  for (i = 0; i < BIHASH_PROBE_BINS; i++)
+    if (p->pages[i] || p->kvps[i] || p->lock_retries[i])
+      s = format (s, "%s%d       %.2f%%       %.2f%%       %.2f%% \n",
+		  i == BIHASH_PROBE_BINS - 1 ? ">=" : "", i,
+		  100.0 * p->pages[i] / n, 100.0 * p->kvps[i] / n,
+		  100.0 * p->lock_retries[i] / n);
+  s = format (s, "-------------------------------------------------------------------| \n");
+  return s;
+}
+
+#else
+
+#define BIHASH_PROBE_KEY(h, kv)
+#define BIHASH_PROBE_BATCH(h, kvs, key_mask)
+
+#endif /* BIHASH_PROBE_STATS */
+
+#endif /* __included_bihash_probe_h__ */
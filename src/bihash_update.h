@@ -0,0 +1,151 @@
+/*
+ * Lookup-and-update: search a key and, on a hit, add delta to the value
+ * of its kvp in the table instead of copying the kvp out, as a flow table
+ * bumping a hit counter does. The _atomic forms add with a lock-free
+ * fetch-add, for tables several threads write to.
+ *
+ * The value is written in place: an update racing a split of its bucket
+ * (an add of another key) may be lost, as any in-place write is.
+ *
+ * A template like bihash_template.h: included after it.
+ */
+#ifndef BIHASH_TYPE
+#error BIHASH_TYPE not defined
+#endif
+
+/* kvp of key in its page, 0 if none */
+always_inline BVT (clib_bihash_kv) *
+BV (clib_bihash_update_find) (BVT (clib_bihash_value) * v,
+			      BVT (clib_bihash_kv) * key, u32 limit)
+{
+  u32 i;
+
+  for (i = 0; i < limit; i++)
+    if (BV (clib_bihash_key_compare) (v->kvp[i].key, key->key))
+      return &v->kvp[i];
+  return 0;
+}
+
+/* page of the key hashed to hash, 0 if its bucket is empty; *limit kvps
+   from there, see bihash_locate.h */
+always_inline BVT (clib_bihash_value) *
+BV (clib_bihash_update_page) (BVT (clib_bihash) * h, u64 hash, u32 * limit)
+{
+  BVT (clib_bihash_value) * v;
+  u32 n_pages;
+
+  if (!(v = BV (clib_bihash_locate) (h, hash, &n_pages, 0)))
+    return 0;
+  *limit = n_pages * BIHASH_KVP_PER_PAGE;
+  return v;
+}
+
+always_inline void
+BV (clib_bihash_update_value) (BVT (clib_bihash_kv) * kvp, u64 delta,
+			       int is_atomic)
+{
+  if (is_atomic)
+    clib_atomic_fetch_add_relax (&kvp->value, delta);
+  else
+    kvp->value += delta;
+}
+
+always_inline int
+BV (clib_bihash_search_update_inline) (BVT (clib_bihash) * h,
+				       BVT (clib_bihash_kv) * key, u64 delta,
+				       int is_atomic)
+{
+  u64 hash = BV (clib_bihash_hash) (key);
+  BVT (clib_bihash_value) * v;
+  BVT (clib_bihash_kv) * kvp;
+  u32 limit;
+
+  BIHASH_PROBE_KEY (h, key);
+  if (!(v = BV (clib_bihash_update_page) (h, hash, &limit)))
+    return -1;
+  if (!(kvp = BV (clib_bihash_update_find) (v, key, limit)))
+    return -1;
+  BV (clib_bihash_update_value) (kvp, delta, is_atomic);
+  return 0;
+}
+
+/*
+ * Batch form, same contract as clib_bihash_search_batch_v4 but with the
+ * values updated in the table: hash and prefetch the buckets, locate and
+ * prefetch the pages for store, then compare and update.
+ */
+always_inline int
+BV (clib_bihash_search_update_batch_inline) (BVT (clib_bihash) * h,
+					     BVT (clib_bihash_kv) * search_key,
+					     u8 key_mask, u64 delta,
+					     u8 * valid_key_idx, int is_atomic)
+{
+  BVT (clib_bihash_value) * v[8];
+  BVT (clib_bihash_kv) * kvp;
+  u32 i, limit[8], n_keys = count_set_bits (key_mask);
+  u64 hash[8];
+  u8 bitmap = 0;
+  int ret = 0;
+
+  BIHASH_PROBE_BATCH (h, search_key, key_mask);
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = BV (clib_bihash_hash) (&search_key[i]);
+      BV (clib_bihash_prefetch_bucket) (h, hash[i]);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    if ((v[i] = BV (clib_bihash_update_page) (h, hash[i], &limit[i])))
+      CLIB_PREFETCH (v[i], sizeof (v[i][0]), STORE);
+
+  for (i = 0; i < n_keys; i++)
+    {
+      if (!v[i])
+	continue;
+      kvp = BV (clib_bihash_update_find) (v[i], &search_key[i], limit[i]);
+      if (!kvp)
+	continue;
+      BV (clib_bihash_update_value) (kvp, delta, is_atomic);
+      bitmap |= 1 << i;
+      ret++;
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+static never_inline int
+BV (clib_bihash_search_update) (BVT (clib_bihash) * h,
+				BVT (clib_bihash_kv) * key, u64 delta)
+{
+  return BV (clib_bihash_search_update_inline) (h, key, delta, 0);
+}
+
+static never_inline int
+BV (clib_bihash_search_update_atomic) (BVT (clib_bihash) * h,
+				       BVT (clib_bihash_kv) * key, u64 delta)
+{
+  return BV (clib_bihash_search_update_inline) (h, key, delta, 1);
+}
+
+static never_inline int
+BV (clib_bihash_search_update_batch) (BVT (clib_bihash) * h,
+				      BVT (clib_bihash_kv) * search_key,
+				      u8 key_mask, u64 delta,
+				      u8 * valid_key_idx)
+{
+  return BV (clib_bihash_search_update_batch_inline) (h, search_key,
+						      key_mask, delta,
+						      valid_key_idx, 0);
+}
+
+static never_inline int
+BV (clib_bihash_search_update_batch_atomic) (BVT (clib_bihash) * h,
+					     BVT (clib_bihash_kv) *
+					     search_key, u8 key_mask,
+					     u64 delta, u8 * valid_key_idx)
+{
+  return BV (clib_bihash_search_update_batch_inline) (h, search_key,
+						      key_mask, delta,
+						      valid_key_idx, 1);
+}
@@ -0,0 +1,207 @@
+/*
+ * Blocked Bloom filter for 8-byte keys, checked before the bihash so
+ * absent keys skip the bucket load and the page walk.
+ *
+ * Split-block layout: a key maps to one 64-byte block of 8 words and sets
+ * one bit in every word. A key is checked with one cache line load, and
+ * with AVX512 with one compare of the whole block. The filter has no
+ * delete: a deleted key only costs false positives until a rebuild.
+ */
+#ifndef __included_bloom_8_8_h__
+#define __included_bloom_8_8_h__
+
+#define BLOOM_8_8_WORDS  8
+#define BLOOM_8_8_DEFAULT_BITS_PER_KEY 10
+
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u64 w[BLOOM_8_8_WORDS];
+} bloom_8_8_block_t;
+
+typedef struct
+{
+  bloom_8_8_block_t *blocks;
+  u64 n_blocks;
+  u64 n_keys;
+  u32 bits_per_key;
+} bloom_8_8_t;
+
+/* odd multipliers, one per word, picking the bit to set in that word */
+static const u32 bloom_8_8_salt[BLOOM_8_8_WORDS] = {
+  0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+  0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31,
+};
+
+always_inline u64
+bloom_8_8_hash (u64 key)
+{
+  return clib_xxhash (key);
+}
+
+/* upper half of the hash picks the block, no power of 2 needed */
+always_inline bloom_8_8_block_t *
+bloom_8_8_block (bloom_8_8_t * f, u64 hash)
+{
+  return f->blocks + (((hash >> 32) * f->n_blocks) >> 32);
+}
+
+always_inline u64
+bloom_8_8_bit (u32 hash, u32 i)
+{
+  return 1ULL << ((hash * bloom_8_8_salt[i]) >> 26);
+}
+
+static inline int
+bloom_8_8_init (bloom_8_8_t * f, u64 n_keys, u32 bits_per_key)
+{
+  clib_memset (f, 0, sizeof (*f));
+  f->bits_per_key = bits_per_key;
+  f->n_blocks = clib_max ((n_keys * bits_per_key + 511) / 512, 1);
+  f->blocks = clib_mem_alloc_aligned (f->n_blocks * sizeof (f->blocks[0]),
+				      CLIB_CACHE_LINE_BYTES);
+  if (!f->blocks)
+    return -1;
+  clib_memset (f->blocks, 0, f->n_blocks * sizeof (f->blocks[0]));
+  return 0;
+}
+
+static inline void
+bloom_8_8_free (bloom_8_8_t * f)
+{
+  if (f->blocks)
+    clib_mem_free (f->blocks);
+  clib_memset (f, 0, sizeof (*f));
+}
+
+always_inline uword
+bloom_8_8_memory_bytes (bloom_8_8_t * f)
+{
+  return f->n_blocks * sizeof (f->blocks[0]);
+}
+
+static inline void
+bloom_8_8_add (bloom_8_8_t * f, u64 key)
+{
+  u64 hash = bloom_8_8_hash (key);
+  bloom_8_8_block_t *b = bloom_8_8_block (f, hash);
+  u32 i;
+
+  for (i = 0; i < BLOOM_8_8_WORDS; i++)
+    b->w[i] |= bloom_8_8_bit (hash, i);
+  f->n_keys++;
+}
+
+/* 0: key is absent, 1: key may be present */
+always_inline int
+bloom_8_8_check_with_hash (bloom_8_8_t * f, u64 hash)
+{
+  bloom_8_8_block_t *b = bloom_8_8_block (f, hash);
+#ifdef __AVX512F__
+  __m256i salt = _mm256_loadu_si256 ((__m256i *) bloom_8_8_salt);
+  __m256i idx = _mm256_srli_epi32 (_mm256_mullo_epi32
+				   (_mm256_set1_epi32 ((u32) hash), salt),
+				   26);
+  __m512i bits = _mm512_sllv_epi64 (_mm512_set1_epi64 (1),
+				    _mm512_cvtepu32_epi64 (idx));
+  __m512i block = _mm512_load_si512 ((__m512i *) b->w);
+  return _mm512_cmpeq_epi64_mask (_mm512_and_si512 (block, bits),
+				  bits) == 0xff;
+#else
+  u64 miss = 0;
+  u32 i;
+
+  for (i = 0; i < BLOOM_8_8_WORDS; i++)
+    miss |= ~b->w[i] & bloom_8_8_bit (hash, i);
+  return miss == 0;
+#endif
+}
+
+always_inline int
+bloom_8_8_check (bloom_8_8_t * f, u64 key)
+{
+  return bloom_8_8_check_with_hash (f, bloom_8_8_hash (key));
+}
+
+/* bitmap of the first n_keys keys which may be present */
+always_inline u8
+bloom_8_8_check_batch (bloom_8_8_t * f, BVT (clib_bihash_kv) * kv,
+		       u32 n_keys)
+{
+  u64 hash[8];
+  u8 bitmap = 0;
+  u32 i;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = bloom_8_8_hash (kv[i].key);
+      CLIB_PREFETCH (bloom_8_8_block (f, hash[i]), CLIB_CACHE_LINE_BYTES,
+		     LOAD);
+    }
+  for (i = 0; i < n_keys; i++)
+    bitmap |= bloom_8_8_check_with_hash (f, hash[i]) << i;
+  return bitmap;
+}
+
+/*
+ * The bihash behind its filter, the table searched by the filtered
+ * kernels V12 (filter, then clib_bihash_search) and V13 (batch filter,
+ * then clib_bihash_search_batch_v4 on the keys which passed).
+ */
+typedef struct
+{
+  bloom_8_8_t filter;
+  BVT (clib_bihash) * h;
+  u8 is_init;
+} bloom_bihash_t;
+
+/* Same contract as clib_bihash_search, never_inline as in cuckoo_8_8.h */
+static never_inline int
+bloom_bihash_search (bloom_bihash_t * t, BVT (clib_bihash_kv) * search_key,
+		     BVT (clib_bihash_kv) * valuep)
+{
+  if (!bloom_8_8_check (&t->filter, search_key->key))
+    return -1;
+  return BV (clib_bihash_search) (t->h, search_key, valuep);
+}
+
+/* Same contract as clib_bihash_search_batch_v4 */
+static never_inline int
+bloom_bihash_search_batch (bloom_bihash_t * t,
+			   BVT (clib_bihash_kv) * search_key, u8 key_mask,
+			   BVT (clib_bihash_kv) * valuep, u8 * valid_key_idx)
+{
+  BVT (clib_bihash_kv) kv[8], result[8];
+  u32 i, n = 0, n_keys = count_set_bits (key_mask);
+  u8 idx[8], maybe, found = 0, bitmap = 0;
+  int ret;
+
+  maybe = bloom_8_8_check_batch (&t->filter, search_key, n_keys);
+  if (!maybe)
+    {
+      *valid_key_idx = 0;
+      return 0;
+    }
+
+  /* keys which passed the filter, packed for the batch search */
+  for (i = 0; i < n_keys; i++)
+    if (maybe & (1 << i))
+      {
+	kv[n] = search_key[i];
+	idx[n++] = i;
+      }
+
+  ret = BV (clib_bihash_search_batch_v4) (t->h, kv, pow2_mask (n), result,
+					   &found);
+  for (i = 0; i < n; i++)
+    if (found & (1 << i))
+      {
+	valuep[idx[i]] = result[i];
+	bitmap |= 1 << idx[i];
+      }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+#endif /* __included_bloom_8_8_h__ */
@@ -0,0 +1,260 @@
+/*
+ * Bucket heatmap: which buckets the perf key stream lands on, and how
+ * many kvp pages a lookup reads there. Included by bihash_application.c.
+ *
+ * One in "heatmap <n>" keys of the stream the perf runs search (linear
+ * 0, 1, 2, ... up to the profile's element count, or random ()) is
+ * walked down the profile's bihash by heatmap_probe, the search path of
+ * clib_bihash_search. Every kernel on the bihash (V0, V4, V5, the
+ * filtered and cached ones before their bihash lookup, plugins) picks its
+ * bucket from the key hash alone, so the map holds for all of them.
+ *
+ * Printed: skew (share of the lookups taken by the hottest buckets),
+ * buckets by access count, lookups by pages read, the hottest buckets
+ * and the hottest linear search buckets. Written to
+ * bihash_heatmap_<profile>_<keys>.csv:
+ *   range,<first bucket>,<last bucket>,<samples>,<buckets touched>,
+ *         <max samples of one bucket>,<linear buckets>,<mean pages read>
+ * for HEATMAP_FILE_RANGES equal bucket ranges, then
+ *   bucket,<index>,<samples>,<pages>,<linear>,<mean pages read>
+ * for the HEATMAP_FILE_BUCKETS hottest buckets.
+ */
+
+#define HEATMAP_TOP_BUCKETS  10
+#define HEATMAP_FILE_RANGES  1024
+#define HEATMAP_FILE_BUCKETS 1000
+#define HEATMAP_LOG2_BINS    16
+
+typedef struct
+{
+  u32 bucket;
+  u32 pages_read;		/* 0: empty bucket */
+  u8 log2_pages;
+  u8 linear;
+  u8 hit;
+} heatmap_sample_t;
+
+typedef struct
+{
+  u32 bucket;
+  u32 samples;
+  u64 pages_read;		/* sum over the samples */
+  u8 log2_pages;
+  u8 linear;
+} heatmap_bucket_t;
+
+/* search path of clib_bihash_search, counting the kvp pages read */
+static void
+heatmap_probe (BVT (clib_bihash) * h, u64 key, heatmap_sample_t * s)
+{
+  BVT (clib_bihash_kv) kv = {.key = key };
+  BVT (clib_bihash_bucket) * b;
+  BVT (clib_bihash_value) * v;
+  u64 hash = BV (clib_bihash_hash) (&kv);
+  u32 p, i, n_pages;
+
+  clib_memset (s, 0, sizeof (*s));
+  s->bucket = hash & (h->nbuckets - 1);
+  b = BV (clib_bihash_get_bucket) (h, hash);
+  if (!(v = BV (clib_bihash_locate) (h, hash, &n_pages, 0)))
+    return;
+
+  s->log2_pages = b->log2_pages;
+  s->linear = b->linear_search;
+
+  for (p = 0; p < n_pages; p++)
+    for (i = 0; i < BIHASH_KVP_PER_PAGE; i++)
+      if (BV (clib_bihash_key_compare) (v[p].kvp[i].key, kv.key))
+	{
+	  s->pages_read = p + 1;
+	  s->hit = 1;
+	  return;
+	}
+  s->pages_read = n_pages;
+}
+
+static int
+heatmap_sample_cmp (void *a1, void *a2)
+{
+  heatmap_sample_t *a = a1, *b = a2;
+
+  return a->bucket < b->bucket ? -1 : a->bucket > b->bucket;
+}
+
+static int
+heatmap_bucket_cmp (void *a1, void *a2)
+{
+  heatmap_bucket_t *a = a1, *b = a2;
+
+  return a->samples > b->samples ? -1 : a->samples < b->samples;
+}
+
+/* buckets in bucket order; left sorted hottest first */
+static void
+heatmap_write (bihash_profiler_main_t * bpm, heatmap_bucket_t * buckets,
+	       int profile_id, int is_random, u64 n_samples)
+{
+  BVT (clib_bihash) * h = bpm->h;
+  heatmap_bucket_t *hb = buckets;
+  u32 r, n_ranges = clib_min (h->nbuckets, HEATMAP_FILE_RANGES);
+  u64 first, last, samples, pages, touched, max, linear;
+  char path[64];
+  FILE *f;
+
+  snprintf (path, sizeof (path), "bihash_heatmap_%d_%s.csv", profile_id,
+	    is_random ? "random" : "linear");
+  if (!(f = fopen (path, "w")))
+    {
+      fformat (stderr, "heatmap: cannot open %s\n", path);
+      return;
+    }
+  fprintf (f, "# profile_id %d,%s keys,1 in %d lookups,%lu samples,%u buckets\n",
+	   profile_id, is_random ? "random" : "linear", bpm->heatmap_every,
+	   (unsigned long) n_samples, h->nbuckets);
+  fprintf (f, "# range,first,last,samples,touched,max,linear,mean_pages\n");
+
+  /* buckets is sorted by bucket index here */
+  for (r = 0; r < n_ranges; r++)
+    {
+      first = (u64) r * h->nbuckets / n_ranges;
+      last = (u64) (r + 1) * h->nbuckets / n_ranges - 1;
+      samples = pages = touched = max = linear = 0;
+      for (; hb < vec_end (buckets) && hb->bucket <= last; hb++)
+	{
+	  samples += hb->samples;
+	  pages += hb->pages_read;
+	  touched++;
+	  max = clib_max (max, hb->samples);
+	  linear += hb->linear;
+	}
+      fprintf (f, "range,%lu,%lu,%lu,%lu,%lu,%lu,%.2f\n",
+	       (unsigned long) first, (unsigned long) last,
+	       (unsigned long) samples, (unsigned long) touched,
+	       (unsigned long) max, (unsigned long) linear,
+	       samples ? (f64) pages / samples : 0);
+    }
+
+  vec_sort_with_function (buckets, heatmap_bucket_cmp);
+  fprintf (f, "# bucket,index,samples,pages,linear,mean_pages\n");
+  for (r = 0; r < clib_min (vec_len (buckets), HEATMAP_FILE_BUCKETS); r++)
+    fprintf (f, "bucket,%u,%u,%u,%u,%.2f\n", buckets[r].bucket,
+	     buckets[r].samples, 1 << buckets[r].log2_pages,
+	     buckets[r].linear,
+	     (f64) buckets[r].pages_read / buckets[r].samples);
+  fclose (f);
+  fformat (stdout, "Heatmap:written to %s\n", path);
+}
+
+void
+bucket_heatmap_perf_test (bihash_profiler_main_t * bpm, int profile_id,
+			  int is_random)
+{
+  BVT (clib_bihash) * h = bpm->h;
+  heatmap_sample_t *samples = 0, *s;
+  heatmap_bucket_t *buckets = 0, *hb = 0;
+  u64 i, key, n_hits = 0, sum, top, n_linear = 0;
+  u64 by_count[HEATMAP_LOG2_BINS], by_pages[HEATMAP_LOG2_BINS];
+  u32 every = bpm->heatmap_every, bin, j;
+  f64 top_pct[] = { 0.1, 1, 10 };
+
+  for (i = 0; i < bpm->n_elts; i++)
+    {
+      key = is_random ? random () : i;
+      if (i % every)
+	continue;
+      vec_add2 (samples, s, 1);
+      heatmap_probe (h, key, s);
+      n_hits += s->hit;
+    }
+  if (vec_len (samples) == 0)
+    return;
+
+  /* samples -> buckets, by bucket index */
+  clib_memset (by_pages, 0, sizeof (by_pages));
+  vec_sort_with_function (samples, heatmap_sample_cmp);
+  vec_foreach (s, samples)
+  {
+    if (!hb || hb->bucket != s->bucket)
+      {
+	vec_add2 (buckets, hb, 1);
+	hb->bucket = s->bucket;
+	hb->log2_pages = s->log2_pages;
+	hb->linear = s->linear;
+      }
+    hb->samples++;
+    hb->pages_read += s->pages_read;
+    by_pages[s->pages_read ?
+	     clib_min (min_log2 (s->pages_read) + 1, HEATMAP_LOG2_BINS - 1) : 0]++;
+    n_linear += s->linear;
+  }
+
+  fformat (stdout, "Heatmap:profile_id[%d],%s keys,1 in %d lookups,%ld samples,%.2f%% hits,%ld of %d buckets touched\n",
+	   profile_id, is_random ? "random" : "linear", every,
+	   vec_len (samples), 100.0 * n_hits / vec_len (samples),
+	   vec_len (buckets), h->nbuckets);
+  heatmap_write (bpm, buckets, profile_id, is_random, vec_len (samples));
+
+  /* buckets is sorted hottest first from here */
+  fformat (stdout, "hottest  |---| buckets |---| share of lookups | \n");
+  for (j = 0; j < ARRAY_LEN (top_pct); j++)
+    {
+      top = clib_max ((u64) (top_pct[j] * h->nbuckets / 100), 1);
+      sum = 0;
+      for (i = 0; i < clib_min (top, vec_len (buckets)); i++)
+	sum += buckets[i].samples;
+      fformat (stdout, "%.1f%%       %ld       %.2f%% \n", top_pct[j], top,
+	       100.0 * sum / vec_len (samples));
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  clib_memset (by_count, 0, sizeof (by_count));
+  by_count[0] = h->nbuckets - vec_len (buckets);
+  vec_foreach (hb, buckets)
+    by_count[clib_min (min_log2 (hb->samples) + 1, HEATMAP_LOG2_BINS - 1)]++;
+  fformat (stdout, "samples  |---| buckets | \n");
+  for (bin = 0; bin < HEATMAP_LOG2_BINS; bin++)
+    if (by_count[bin])
+      fformat (stdout, "%ld-%ld       %ld \n", bin ? 1ULL << (bin - 1) : 0,
+	       bin ? (1ULL << bin) - 1 : 0, by_count[bin]);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  fformat (stdout, "pages read  |---| lookups |---| share | \n");
+  for (bin = 0; bin < HEATMAP_LOG2_BINS; bin++)
+    if (by_pages[bin])
+      fformat (stdout, "%ld-%ld       %ld       %.2f%% \n",
+	       bin ? 1ULL << (bin - 1) : 0, bin ? (1ULL << bin) - 1 : 0,
+	       by_pages[bin], 100.0 * by_pages[bin] / vec_len (samples));
+  fformat (stdout, "    %.2f%% of the lookups in linear search buckets\n",
+	   100.0 * n_linear / vec_len (samples));
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+#define heatmap_bucket_row(hb)                                          \
+  fformat (stdout, "%d       %d       %.2f%%       %d       %d       %.2f \n", \
+           (hb)->bucket, (hb)->samples,                                 \
+           100.0 * (hb)->samples / vec_len (samples),                   \
+           1 << (hb)->log2_pages, (hb)->linear,                         \
+           (f64) (hb)->pages_read / (hb)->samples)
+
+  fformat (stdout, "Hot buckets:\n"
+	   "bucket  |---| samples |---| share |---| pages |---| linear |---| pages read | \n");
+  for (i = 0; i < clib_min (HEATMAP_TOP_BUCKETS, vec_len (buckets)); i++)
+    heatmap_bucket_row (&buckets[i]);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  fformat (stdout, "Hot linear buckets:\n"
+	   "bucket  |---| samples |---| share |---| pages |---| linear |---| pages read | \n");
+  j = 0;
+  vec_foreach (hb, buckets)
+  {
+    if (!hb->linear)
+      continue;
+    heatmap_bucket_row (hb);
+    if (++j == HEATMAP_TOP_BUCKETS)
+      break;
+  }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+#undef heatmap_bucket_row
+
+  vec_free (samples);
+  vec_free (buckets);
+}
@@ -0,0 +1,199 @@
+/*
+ * Cache sweep: V0/V4/V5 CPO over tables sized by the cache hierarchy
+ * instead of the fixed scales of g_p_table. Included by
+ * bihash_application.c.
+ *
+ * Data cache sizes come from /sys/devices/system/cpu/cpu0/cache, or from
+ * sysconf when sysfs has none. Tables of random keys, one bucket per key
+ * as most profiles have, are built at CACHE_SWEEP_STEPS_PER_OCTAVE sizes
+ * per doubling from L1d / 8 up to 8x the last level (or "cachesweep
+ * <MB>"). Each is searched for CACHE_SWEEP_LOOKUPS present keys in
+ * random order, so the whole table is the working set; its size is
+ * measured with clib_bihash_bytes_in_use once built.
+ */
+
+#define CACHE_SWEEP_MAX_LEVELS       4
+#define CACHE_SWEEP_STEPS_PER_OCTAVE 2
+#define CACHE_SWEEP_BYTES_PER_KEY    48	/* first guess, the row shows the real size */
+#define CACHE_SWEEP_LOOKUPS          (1 << 22)
+#define CACHE_SWEEP_MIN_KEYS         64
+
+static char *cache_sweep_kernels[] = { "V0", "V4", "V5" };
+
+typedef struct
+{
+  /* data or unified cache of each level, bytes; 0: none */
+  u64 bytes[CACHE_SWEEP_MAX_LEVELS + 1];
+  u32 last_level;
+  char *src;
+} cache_sweep_caches_t;
+
+static int
+cache_sweep_read_sysfs (char *path, char *buf, int len)
+{
+  FILE *f = fopen (path, "r");
+  int ok;
+
+  if (!f)
+    return 0;
+  ok = fgets (buf, len, f) != 0;
+  fclose (f);
+  return ok;
+}
+
+static void
+cache_sweep_caches_get (cache_sweep_caches_t * c)
+{
+  char path[128], buf[32], unit;
+  u32 index, level;
+  u64 size;
+
+  clib_memset (c, 0, sizeof (*c));
+  c->src = "sysfs";
+  for (index = 0;; index++)
+    {
+      snprintf (path, sizeof (path),
+		"/sys/devices/system/cpu/cpu0/cache/index%u/level", index);
+      if (!cache_sweep_read_sysfs (path, buf, sizeof (buf)))
+	break;
+      level = atoi (buf);
+      snprintf (path, sizeof (path),
+		"/sys/devices/system/cpu/cpu0/cache/index%u/type", index);
+      if (!cache_sweep_read_sysfs (path, buf, sizeof (buf)) ||
+	  !strncmp (buf, "Instruction", 11))
+	continue;
+      snprintf (path, sizeof (path),
+		"/sys/devices/system/cpu/cpu0/cache/index%u/size", index);
+      if (!cache_sweep_read_sysfs (path, buf, sizeof (buf)) || level == 0 ||
+	  level > CACHE_SWEEP_MAX_LEVELS)
+	continue;
+      unit = 0;
+      size = 0;
+      sscanf (buf, "%lu%c", &size, &unit);
+      size <<= unit == 'K' ? 10 : unit == 'M' ? 20 : unit == 'G' ? 30 : 0;
+      c->bytes[level] = size;
+      c->last_level = clib_max (c->last_level, level);
+    }
+  if (c->last_level)
+    return;
+
+  c->src = "sysconf";
+  c->bytes[1] = clib_max (sysconf (_SC_LEVEL1_DCACHE_SIZE), 0);
+  c->bytes[2] = clib_max (sysconf (_SC_LEVEL2_CACHE_SIZE), 0);
+  c->bytes[3] = clib_max (sysconf (_SC_LEVEL3_CACHE_SIZE), 0);
+  c->bytes[4] = clib_max (sysconf (_SC_LEVEL4_CACHE_SIZE), 0);
+  for (level = 1; level <= CACHE_SWEEP_MAX_LEVELS; level++)
+    if (c->bytes[level])
+      c->last_level = level;
+}
+
+/* smallest cache level holding bytes, 0: none */
+always_inline u32
+cache_sweep_level_of (cache_sweep_caches_t * c, u64 bytes)
+{
+  u32 level;
+
+  for (level = 1; level <= c->last_level; level++)
+    if (c->bytes[level] && bytes <= c->bytes[level])
+      return level;
+  return 0;
+}
+
+static u8 *
+format_cache_sweep_level (u8 * s, va_list * args)
+{
+  u32 level = va_arg (*args, u32);
+
+  if (level == 0)
+    return format (s, "DRAM");
+  return format (s, level == 1 ? "L1d" : "L%d", level);
+}
+
+void
+cache_sweep_perf_test (bihash_profiler_main_t * bpm)
+{
+  BVT (clib_bihash) _h, *h = &_h, *profile_h = bpm->h;
+  BVT (clib_bihash_kv) kv;
+  cache_sweep_caches_t caches;
+  search_kernel_t *k;
+  u64 *keys = 0, *lookups = 0, n_keys, bytes, hits, target, max_bytes;
+  u64 cycles[ARRAY_LEN (cache_sweep_kernels)];
+  u32 level, prev_level = ~0, j, step;
+  u64 i;
+
+  cache_sweep_caches_get (&caches);
+  if (caches.last_level == 0 || caches.bytes[1] == 0)
+    {
+      fformat (stdout, "Cache sweep:no cache sizes in sysfs or sysconf\n");
+      return;
+    }
+  max_bytes = bpm->cache_sweep_max_mb ? (u64) bpm->cache_sweep_max_mb << 20 :
+    8 * caches.bytes[caches.last_level];
+
+  fformat (stdout, "Cache sweep:");
+  for (level = 1; level <= caches.last_level; level++)
+    if (caches.bytes[level])
+      fformat (stdout, "%U %ld KB,", format_cache_sweep_level, level,
+	       caches.bytes[level] >> 10);
+  fformat (stdout, "from %s,%d random lookups of present keys per table\n"
+	   "table KB |---| keys |---| buckets |---| fits |---| V0 CPO |---| V4 CPO |---| V5 CPO | \n",
+	   caches.src, CACHE_SWEEP_LOOKUPS);
+
+  for (step = 0;; step++)
+    {
+      /* L1d / 8 * 2^(step / CACHE_SWEEP_STEPS_PER_OCTAVE) */
+      target = caches.bytes[1] / 8 *
+	pow (2, (f64) step / CACHE_SWEEP_STEPS_PER_OCTAVE);
+      if (target > max_bytes)
+	break;
+      n_keys = clib_max (target / CACHE_SWEEP_BYTES_PER_KEY,
+			 CACHE_SWEEP_MIN_KEYS);
+
+      clib_memset (h, 0, sizeof (*h));
+      BV (clib_bihash_init) (h, "cache-sweep", max_pow2 (n_keys),
+			     32ULL << 30);
+      vec_reset_length (keys);
+      for (i = 0; i < n_keys; i++)
+	{
+	  kv.key = ((u64) random () << 31) | random ();
+	  kv.value = i;
+	  BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );
+	  vec_add1 (keys, kv.key);
+	}
+      vec_reset_length (lookups);
+      for (i = 0; i < CACHE_SWEEP_LOOKUPS; i++)
+	vec_add1 (lookups, keys[random () % vec_len (keys)]);
+      bytes = BV (clib_bihash_bytes_in_use) (h);
+
+      /* the cache boundaries this table went past */
+      level = cache_sweep_level_of (&caches, bytes);
+      if (prev_level != ~0 && level != prev_level)
+	fformat (stdout, "---- %U %ld KB ----\n", format_cache_sweep_level,
+		 prev_level, caches.bytes[prev_level] >> 10);
+      prev_level = level;
+
+      bpm->h = h;
+      for (j = 0; j < ARRAY_LEN (cache_sweep_kernels); j++)
+	{
+	  k = vec_elt_at_index (bpm->kernels, search_kernel_index_by_name
+				(bpm, cache_sweep_kernels[j]));
+	  cycles[j] = search_kernel_time_keys (bpm, k, lookups, &hits);
+	  if (hits != vec_len (lookups))
+	    fformat (stdout, "%s found %ld of %ld keys ---[FAILED]\n",
+		     k->name, hits, vec_len (lookups));
+	}
+      bpm->h = profile_h;
+
+      fformat (stdout, "%.1f       %ld       %d       %U       %.2f       %.2f       %.2f \n",
+	       (f64) bytes / 1024, n_keys, h->nbuckets,
+	       format_cache_sweep_level, level,
+	       (f64) cycles[0] / vec_len (lookups),
+	       (f64) cycles[1] / vec_len (lookups),
+	       (f64) cycles[2] / vec_len (lookups));
+      BV (clib_bihash_free) (h);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  vec_free (keys);
+  vec_free (lookups);
+}
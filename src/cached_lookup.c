@@ -0,0 +1,137 @@
+/*
+ * Flow cache sweep: V0/V4 against the cached kernels V14/V15 for
+ * uniform, sequential and hot-set key streams. Included by
+ * bihash_application.c.
+ *
+ * All streams only hold keys of the profile's table:
+ *   uniform:    any key, equally likely
+ *   sequential: the keys in table walk order, looping
+ *   hot-set:    CACHED_HOT_PCT% of lookups on CACHED_HOT_FLOWS keys
+ */
+
+#define CACHED_HOT_FLOWS 2048
+#define CACHED_HOT_PCT   95
+
+typedef enum
+{
+  CACHED_STREAM_UNIFORM,
+  CACHED_STREAM_SEQUENTIAL,
+  CACHED_STREAM_HOT_SET,
+  CACHED_N_STREAMS,
+} cached_stream_t;
+
+static char *cached_stream_names[] = {
+  [CACHED_STREAM_UNIFORM] = "uniform",
+  [CACHED_STREAM_SEQUENTIAL] = "sequential",
+  [CACHED_STREAM_HOT_SET] = "hot-set",
+};
+
+static char *cached_sweep_kernels[] = { "V0", "V14", "V4", "V15" };
+
+static void
+cached_stream_keys (cached_stream_t stream, u64 * present, u64 ** keys,
+		    u64 n)
+{
+  u64 i, n_present = vec_len (present);
+  u64 n_hot = clib_min (n_present, CACHED_HOT_FLOWS);
+
+  vec_reset_length (*keys);
+  for (i = 0; i < n; i++)
+    switch (stream)
+      {
+      case CACHED_STREAM_UNIFORM:
+	vec_add1 (*keys, present[random () % n_present]);
+	break;
+      case CACHED_STREAM_SEQUENTIAL:
+	vec_add1 (*keys, present[i % n_present]);
+	break;
+      default:
+	if (random () % 100 < CACHED_HOT_PCT)
+	  vec_add1 (*keys, present[random () % n_hot]);
+	else
+	  vec_add1 (*keys, present[random () % n_present]);
+	break;
+      }
+}
+
+/* updates through flow_cache_bihash_add_del must be seen by V14 */
+static void
+cached_invalidate_check (flow_cache_bihash_t * t, u64 key)
+{
+  BVT (clib_bihash_kv) kv, result;
+  u64 value;
+
+  kv.key = key;
+  flow_cache_bihash_search (t, &kv, &result);
+  value = result.value;
+
+  kv.value = value + 1;
+  flow_cache_bihash_add_del (t, &kv, 1 /* is_add */ );
+  flow_cache_bihash_search (t, &kv, &result);
+  fformat (stdout, "flow cache invalidate on add_del ---[%s]\n",
+	   result.value == value + 1 ? "PASS" : "FAILED");
+
+  kv.value = value;
+  flow_cache_bihash_add_del (t, &kv, 1 /* is_add */ );
+}
+
+void
+cached_perf_sweep (bihash_profiler_main_t * bpm)
+{
+  flow_cache_bihash_t *t;
+  search_kernel_t *k;
+  u64 *present = 0, *keys = 0, n, hits, hits0;
+  u64 cycles[ARRAY_LEN (cached_sweep_kernels)];
+  f64 hit_rate[ARRAY_LEN (cached_sweep_kernels)];
+  cached_stream_t stream;
+  u32 j;
+
+  k = vec_elt_at_index (bpm->kernels,
+			search_kernel_index_by_name (bpm, "V14"));
+  t = search_kernel_table (bpm, k);
+
+  present = search_kernel_table_keys (bpm);
+  n = vec_len (present) & ~7ULL;
+  if (n == 0)
+    goto done;
+
+  fformat (stdout, "Flow cache:%d sets x %d ways,%s,%.2f KB,%ld keys\n"
+	   "stream  |---| V0 CPO |---| V14 CPO |---| V4 CPO |---| V15 CPO |---| V14 hit rate |---| V15 hit rate | \n",
+	   t->cache.n_sets, FLOW_CACHE_8_8_WAYS,
+	   flow_cache_policy_names[t->cache.policy],
+	   (f64) flow_cache_8_8_memory_bytes (&t->cache) / 1024,
+	   vec_len (present));
+
+  for (stream = 0; stream < CACHED_N_STREAMS; stream++)
+    {
+      cached_stream_keys (stream, present, &keys, n);
+      hits0 = ~0ULL;
+      for (j = 0; j < ARRAY_LEN (cached_sweep_kernels); j++)
+	{
+	  k = vec_elt_at_index (bpm->kernels, search_kernel_index_by_name
+				(bpm, cached_sweep_kernels[j]));
+	  flow_cache_8_8_flush (&t->cache);
+	  cycles[j] = search_kernel_time_keys (bpm, k, keys, &hits);
+	  /* counters cover the warm-up run and the timed one */
+	  hit_rate[j] = t->cache.hits + t->cache.misses ?
+	    100.0 * t->cache.hits / (t->cache.hits + t->cache.misses) : 0;
+	  if (hits0 == ~0ULL)
+	    hits0 = hits;
+	  else if (hits != hits0)
+	    fformat (stdout, "%s found %ld keys, V0 found %ld ---[FAILED]\n",
+		     k->name, hits, hits0);
+	}
+
+      fformat (stdout, "%s       %.2f       %.2f       %.2f       %.2f       %.2f%%       %.2f%% \n",
+	       cached_stream_names[stream], (f64) cycles[0] / n,
+	       (f64) cycles[1] / n, (f64) cycles[2] / n, (f64) cycles[3] / n,
+	       hit_rate[1], hit_rate[3]);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  cached_invalidate_check (t, present[0]);
+
+done:
+  vec_free (present);
+  vec_free (keys);
+}
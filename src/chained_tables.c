@@ -0,0 +1,174 @@
+/*
+ * Chained mode: every key is looked up in K tables in sequence, the way
+ * an ACL or policy lookup probes several tables for the same packet.
+ * Included by bihash_application.c.
+ *
+ * Table 0 is the profile's table, the others are built from the profiles
+ * given with "chain <profile_id>", so they differ in category and size.
+ * Three ways to search a batch of 8 keys in all K tables:
+ *   V0xK:        clib_bihash_search, key by key, table by table
+ *   V4xK:        clib_bihash_search_batch_v4 once per table
+ *   interleaved: hash the 8 keys once (the hash only depends on the key),
+ *                prefetch the buckets of all K tables, then their kvp
+ *                pages, then compare, so the misses of all tables overlap
+ */
+
+typedef struct
+{
+  BVT (clib_bihash) ** tables;
+  u32 *profile_ids;
+} chained_tables_t;
+
+typedef enum
+{
+  CHAINED_RUN_V0,
+  CHAINED_RUN_V4,
+  CHAINED_RUN_INTERLEAVED,
+} chained_run_t;
+
+static char *chained_run_names[] = {
+  [CHAINED_RUN_V0] = "V0xK",
+  [CHAINED_RUN_V4] = "V4xK",
+  [CHAINED_RUN_INTERLEAVED] = "interleaved",
+};
+
+int
+chained_tables_init (chained_tables_t * ct, bihash_profiler_main_t * bpm,
+		     int profile_id)
+{
+  BVT (clib_bihash) * h;
+  u32 *id;
+
+  clib_memset (ct, 0, sizeof (*ct));
+  vec_add1 (ct->tables, bpm->h);
+  vec_add1 (ct->profile_ids, profile_id);
+
+  vec_foreach (id, bpm->chain_profiles)
+  {
+    h = clib_mem_alloc (sizeof (*h));
+    clib_memset (h, 0, sizeof (*h));
+    if (init_hash_table (g_p_table, id[0], h, 0) < 0)
+      {
+	fformat (stdout, "chained: unknown profile_id %d\n", id[0]);
+	clib_mem_free (h);
+	continue;
+      }
+    vec_add1 (ct->tables, h);
+    vec_add1 (ct->profile_ids, id[0]);
+  }
+  return vec_len (ct->tables) > 1 ? 0 : -1;
+}
+
+void
+chained_tables_free (chained_tables_t * ct)
+{
+  u32 t;
+
+  /* table 0 belongs to perf_cmp_body */
+  for (t = 1; t < vec_len (ct->tables); t++)
+    {
+      BV (clib_bihash_free) (ct->tables[t]);
+      clib_mem_free (ct->tables[t]);
+    }
+  vec_free (ct->tables);
+  vec_free (ct->profile_ids);
+}
+
+/* hits over all K tables for one batch of 8 keys */
+static never_inline u64
+chained_search_batch (chained_tables_t * ct, chained_run_t run,
+		      BVT (clib_bihash_kv) * kv)
+{
+  BVT (clib_bihash_kv) result;
+  BVT (clib_bihash_kv) results[8];
+  u32 t, j, n_tables = vec_len (ct->tables);
+  u64 hash[8], hits = 0;
+  u8 valid_key_idx;
+
+  switch (run)
+    {
+    case CHAINED_RUN_V0:
+      for (j = 0; j < 8; j++)
+	for (t = 0; t < n_tables; t++)
+	  if (BV (clib_bihash_search) (ct->tables[t], &kv[j], &result) == 0)
+	    hits++;
+      break;
+
+    case CHAINED_RUN_V4:
+      for (t = 0; t < n_tables; t++)
+	hits += BV (clib_bihash_search_batch_v4) (ct->tables[t], kv, 0xFF,
+						   results, &valid_key_idx);
+      break;
+
+    case CHAINED_RUN_INTERLEAVED:
+      for (j = 0; j < 8; j++)
+	hash[j] = BV (clib_bihash_hash) (&kv[j]);
+      for (t = 0; t < n_tables; t++)
+	for (j = 0; j < 8; j++)
+	  BV (clib_bihash_prefetch_bucket) (ct->tables[t], hash[j]);
+      for (t = 0; t < n_tables; t++)
+	for (j = 0; j < 8; j++)
+	  BV (clib_bihash_prefetch_data) (ct->tables[t], hash[j]);
+      for (t = 0; t < n_tables; t++)
+	for (j = 0; j < 8; j++)
+	  if (BV (clib_bihash_search_inline_2_with_hash)
+	      (ct->tables[t], hash[j], &kv[j], &result) == 0)
+	    hits++;
+      break;
+    }
+  return hits;
+}
+
+/*
+ * Search n_keys keys (linear from 0, or random) in all chained tables with
+ * each variant and print the total cycles per key.
+ */
+void
+chained_perf_test (bihash_profiler_main_t * bpm, int profile_id, u64 n_keys,
+		   int is_random)
+{
+  chained_tables_t _ct, *ct = &_ct;
+  BVT (clib_bihash_kv) kv[8];
+  u64 i, start, cycles, hits, n_batches = n_keys / 8;
+  chained_run_t run;
+  u32 j, n_tables, *id;
+  int warm;
+
+  if (chained_tables_init (ct, bpm, profile_id) < 0)
+    {
+      chained_tables_free (ct);
+      return;
+    }
+  n_tables = vec_len (ct->tables);
+
+  fformat (stdout, "Chained:%d tables, profile_id", n_tables);
+  vec_foreach (id, ct->profile_ids)
+    fformat (stdout, " %d", id[0]);
+  fformat (stdout, ",%ld %s keys\n"
+	   "run      |---| Cycles/Key |---| Cycles/Key/Table |---| Hits | \n",
+	   n_batches * 8, is_random ? "random" : "linear");
+
+  for (run = CHAINED_RUN_V0; run <= CHAINED_RUN_INTERLEAVED; run++)
+    {
+      /* first pass warms up, as perf_test_lauch_mode does */
+      for (warm = 0; warm < 2; warm++)
+	{
+	  srandom (n_keys);
+	  hits = 0;
+	  perf_timer_begin (start);
+	  for (i = 0; i < n_batches; i++)
+	    {
+	      for (j = 0; j < 8; j++)
+		kv[j].key = is_random ? random () : i * 8 + j;
+	      hits += chained_search_batch (ct, run, kv);
+	    }
+	  perf_timer_end (start, cycles);
+	}
+      fformat (stdout, "%s       %.2f       %.2f       %ld \n",
+	       chained_run_names[run], (f64) cycles / (n_batches * 8),
+	       (f64) cycles / (n_batches * 8 * n_tables), hits);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  chained_tables_free (ct);
+}
@@ -0,0 +1,81 @@
+/*
+ * Cache and TLB eviction between measurement runs.
+ *
+ * A run that starts right after the table was built or searched finds the
+ * table partly in the LLC and the search code in the I-cache. The cold
+ * mode flushes the lines the next run will touch, then optionally walks a
+ * buffer one page at a time to push the table's translations out of the
+ * (S)TLB.
+ */
+#ifndef __included_cold_cache_h__
+#define __included_cold_cache_h__
+
+/* pages walked by cold_cache_disturb_tlb, well above any STLB size */
+#define COLD_CACHE_TLB_PAGES  (16 << 10)
+
+/* used when sysconf does not know the LLC size */
+#define COLD_CACHE_DEFAULT_LLC_BYTES  (64 << 20)
+
+typedef struct
+{
+  u8 *sweep_buf;
+  uword sweep_bytes;
+  u8 *tlb_buf;
+  u8 disturb_tlb;
+} cold_cache_t;
+
+static inline void
+cold_cache_flush_range (void *p, uword n_bytes)
+{
+  u8 *a = (u8 *) ((uword) p & ~(uword) (CLIB_CACHE_LINE_BYTES - 1));
+  u8 *end = (u8 *) p + n_bytes;
+
+  for (; a < end; a += CLIB_CACHE_LINE_BYTES)
+    _mm_clflush (a);
+  _mm_mfence ();
+}
+
+/* write a buffer twice the LLC size, for memory we cannot flush by range */
+static inline void
+cold_cache_sweep_llc (cold_cache_t * cc)
+{
+  uword i;
+
+  if (!cc->sweep_buf)
+    {
+      long llc = sysconf (_SC_LEVEL3_CACHE_SIZE);
+
+      cc->sweep_bytes = 2 * (llc > 0 ? llc : COLD_CACHE_DEFAULT_LLC_BYTES);
+      cc->sweep_buf = clib_mem_alloc_aligned (cc->sweep_bytes,
+					      CLIB_CACHE_LINE_BYTES);
+    }
+  for (i = 0; i < cc->sweep_bytes; i += CLIB_CACHE_LINE_BYTES)
+    cc->sweep_buf[i]++;
+  _mm_mfence ();
+}
+
+/* one access per 4K page, each one needs its own translation */
+static inline void
+cold_cache_disturb_tlb (cold_cache_t * cc)
+{
+  uword i;
+
+  if (!cc->tlb_buf)
+    cc->tlb_buf = clib_mem_alloc_aligned ((uword) COLD_CACHE_TLB_PAGES << 12,
+					  4096);
+  for (i = 0; i < COLD_CACHE_TLB_PAGES; i++)
+    cc->tlb_buf[(i << 12) + ((i * CLIB_CACHE_LINE_BYTES) & 4095)]++;
+  _mm_mfence ();
+}
+
+static inline void
+cold_cache_free (cold_cache_t * cc)
+{
+  if (cc->sweep_buf)
+    clib_mem_free (cc->sweep_buf);
+  if (cc->tlb_buf)
+    clib_mem_free (cc->tlb_buf);
+  cc->sweep_buf = cc->tlb_buf = 0;
+}
+
+#endif /* __included_cold_cache_h__ */
@@ -0,0 +1,291 @@
+/*
+ * Bucketized cuckoo hash for 8-byte keys / 8-byte values.
+ *
+ * Reference backend for comparing against bihash_8_8 under the same
+ * profiles: two candidate buckets per key, 4 slots per bucket, one
+ * 64-byte cache line per bucket (keys first, values second).
+ * A key is looked up in at most two cache lines, never more.
+ *
+ * Keys equal to ~0ULL are reserved to mark empty slots, the same value
+ * bihash uses for free kvps.
+ */
+#ifndef __included_cuckoo_8_8_h__
+#define __included_cuckoo_8_8_h__
+
+#define CUCKOO_8_8_SLOTS      4
+#define CUCKOO_8_8_MAX_KICKS  512
+#define CUCKOO_8_8_STASH_SZ   8
+#define CUCKOO_8_8_EMPTY_KEY  (~0ULL)
+
+typedef struct
+{
+  u64 key[CUCKOO_8_8_SLOTS];
+  u64 value[CUCKOO_8_8_SLOTS];
+} cuckoo_8_8_bucket_t;
+
+typedef struct
+{
+  cuckoo_8_8_bucket_t *buckets;
+  u64 nbuckets;
+  u64 bucket_mask;
+  u64 n_elts;
+  u64 n_kicks;
+
+  /* victims which could not be placed after CUCKOO_8_8_MAX_KICKS */
+  u32 n_stash;
+  u64 stash_key[CUCKOO_8_8_STASH_SZ];
+  u64 stash_value[CUCKOO_8_8_STASH_SZ];
+} cuckoo_8_8_t;
+
+always_inline u64
+cuckoo_8_8_bucket_index_1 (cuckoo_8_8_t * t, u64 key)
+{
+  return clib_crc32c_u64 (0, key) & t->bucket_mask;
+}
+
+/*
+ * crc32c is linear, a second crc with another seed would only xor the
+ * first index with a constant and pair buckets up; use an unrelated hash.
+ */
+always_inline u64
+cuckoo_8_8_bucket_index_2 (cuckoo_8_8_t * t, u64 key)
+{
+  return clib_xxhash (key) & t->bucket_mask;
+}
+
+/* bitmap of slots in bucket b holding key */
+always_inline u32
+cuckoo_8_8_bucket_match (cuckoo_8_8_bucket_t * b, u64 key)
+{
+#ifdef __AVX2__
+  __m256i k = _mm256_set1_epi64x (key);
+  __m256i m = _mm256_cmpeq_epi64 (k, _mm256_load_si256 ((__m256i *) b->key));
+  return _mm256_movemask_pd (_mm256_castsi256_pd (m));
+#else
+  u32 i, rv = 0;
+  for (i = 0; i < CUCKOO_8_8_SLOTS; i++)
+    rv |= (b->key[i] == key) << i;
+  return rv;
+#endif
+}
+
+static inline int
+cuckoo_8_8_init (cuckoo_8_8_t * t, u64 n_elts)
+{
+  u64 n;
+
+  clib_memset (t, 0, sizeof (*t));
+
+  /* keep the load factor under 90%, two-choice 4-way cuckoo tops out ~97% */
+  n = (n_elts * 10) / (CUCKOO_8_8_SLOTS * 9) + 1;
+  t->nbuckets = 1ULL << max_log2 (clib_max (n, 2));
+  t->bucket_mask = t->nbuckets - 1;
+  t->buckets = clib_mem_alloc_aligned (t->nbuckets * sizeof (t->buckets[0]),
+				       CLIB_CACHE_LINE_BYTES);
+  if (!t->buckets)
+    return -1;
+  clib_memset (t->buckets, 0xff, t->nbuckets * sizeof (t->buckets[0]));
+  return 0;
+}
+
+static inline void
+cuckoo_8_8_free (cuckoo_8_8_t * t)
+{
+  if (t->buckets)
+    clib_mem_free (t->buckets);
+  clib_memset (t, 0, sizeof (*t));
+}
+
+always_inline uword
+cuckoo_8_8_memory_bytes (cuckoo_8_8_t * t)
+{
+  return t->nbuckets * sizeof (t->buckets[0]);
+}
+
+always_inline int
+cuckoo_8_8_bucket_insert (cuckoo_8_8_bucket_t * b, u64 key, u64 value)
+{
+  u32 empty = cuckoo_8_8_bucket_match (b, CUCKOO_8_8_EMPTY_KEY);
+  u32 slot;
+
+  if (!empty)
+    return -1;
+  slot = count_trailing_zeros (empty);
+  b->key[slot] = key;
+  b->value[slot] = value;
+  return 0;
+}
+
+/* Same contract as clib_bihash_add_del (..., is_add = 1) */
+static inline int
+cuckoo_8_8_add (cuckoo_8_8_t * t, BVT (clib_bihash_kv) * kv)
+{
+  cuckoo_8_8_bucket_t *b1, *b2, *b;
+  u64 key = kv->key, value = kv->value, victim, bi;
+  u32 m, kicks, slot, i;
+
+  b1 = t->buckets + cuckoo_8_8_bucket_index_1 (t, key);
+  b2 = t->buckets + cuckoo_8_8_bucket_index_2 (t, key);
+
+  /* replace */
+  if ((m = cuckoo_8_8_bucket_match (b1, key)))
+    {
+      b1->value[count_trailing_zeros (m)] = value;
+      return 0;
+    }
+  if ((m = cuckoo_8_8_bucket_match (b2, key)))
+    {
+      b2->value[count_trailing_zeros (m)] = value;
+      return 0;
+    }
+  for (i = 0; i < t->n_stash; i++)
+    if (t->stash_key[i] == key)
+      {
+	t->stash_value[i] = value;
+	return 0;
+      }
+
+  t->n_elts++;
+  if (cuckoo_8_8_bucket_insert (b1, key, value) == 0 ||
+      cuckoo_8_8_bucket_insert (b2, key, value) == 0)
+    return 0;
+
+  /* random walk: evict a victim and move it to its other bucket */
+  b = (random () & 1) ? b2 : b1;
+  for (kicks = 0; kicks < CUCKOO_8_8_MAX_KICKS; kicks++)
+    {
+      slot = random () & (CUCKOO_8_8_SLOTS - 1);
+      victim = b->key[slot];
+      b->key[slot] = key;
+      key = victim;
+      victim = b->value[slot];
+      b->value[slot] = value;
+      value = victim;
+      t->n_kicks++;
+
+      bi = cuckoo_8_8_bucket_index_1 (t, key);
+      if (t->buckets + bi == b)
+	bi = cuckoo_8_8_bucket_index_2 (t, key);
+      b = t->buckets + bi;
+      if (cuckoo_8_8_bucket_insert (b, key, value) == 0)
+	return 0;
+    }
+
+  if (t->n_stash < CUCKOO_8_8_STASH_SZ)
+    {
+      t->stash_key[t->n_stash] = key;
+      t->stash_value[t->n_stash] = value;
+      t->n_stash++;
+      return 0;
+    }
+
+  /* table is over-subscribed, the last victim is dropped */
+  t->n_elts--;
+  return -1;
+}
+
+always_inline int
+cuckoo_8_8_search_stash (cuckoo_8_8_t * t, u64 key, BVT (clib_bihash_kv) * valuep)
+{
+  u32 i;
+  for (i = 0; i < t->n_stash; i++)
+    if (t->stash_key[i] == key)
+      {
+	valuep->key = key;
+	valuep->value = t->stash_value[i];
+	return 0;
+      }
+  return -1;
+}
+
+/*
+ * Same contract as clib_bihash_search. The search entry points are
+ * never_inline so the harness measures a call, as it does for bihash.
+ */
+static never_inline int
+cuckoo_8_8_search (cuckoo_8_8_t * t, BVT (clib_bihash_kv) * search_key,
+		   BVT (clib_bihash_kv) * valuep)
+{
+  u64 key = search_key->key;
+  cuckoo_8_8_bucket_t *b;
+  u32 m;
+
+  b = t->buckets + cuckoo_8_8_bucket_index_1 (t, key);
+  if ((m = cuckoo_8_8_bucket_match (b, key)))
+    goto found;
+
+  b = t->buckets + cuckoo_8_8_bucket_index_2 (t, key);
+  if ((m = cuckoo_8_8_bucket_match (b, key)))
+    goto found;
+
+  if (PREDICT_FALSE (t->n_stash))
+    return cuckoo_8_8_search_stash (t, key, valuep);
+  return -1;
+
+found:
+  valuep->key = key;
+  valuep->value = b->value[count_trailing_zeros (m)];
+  return 0;
+}
+
+/*
+ * Same contract as clib_bihash_search_batch_v4: up to 8 keys selected by
+ * key_mask, bit i of valid_key_idx set when search_key[i] was found.
+ * All 16 candidate buckets are prefetched before the first compare, then
+ * both buckets of a key are compared at once in one 512-bit register.
+ */
+static never_inline int
+cuckoo_8_8_search_batch (cuckoo_8_8_t * t, BVT (clib_bihash_kv) * search_key,
+			 u8 key_mask, BVT (clib_bihash_kv) * valuep,
+			 u8 * valid_key_idx)
+{
+  cuckoo_8_8_bucket_t *b1[8], *b2[8], *b;
+  u32 i, m, n_keys = _mm_popcnt_u32 (key_mask);
+  u8 bitmap = 0;
+  int ret = 0;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      b1[i] = t->buckets + cuckoo_8_8_bucket_index_1 (t, search_key[i].key);
+      b2[i] = t->buckets + cuckoo_8_8_bucket_index_2 (t, search_key[i].key);
+      CLIB_PREFETCH (b1[i], CLIB_CACHE_LINE_BYTES, LOAD);
+      CLIB_PREFETCH (b2[i], CLIB_CACHE_LINE_BYTES, LOAD);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    {
+      u64 key = search_key[i].key;
+#ifdef __AVX512F__
+      __m512i keys = _mm512_inserti64x4 (_mm512_castsi256_si512
+					 (_mm256_load_si256
+					  ((__m256i *) b1[i]->key)),
+					 _mm256_load_si256 ((__m256i *)
+							    b2[i]->key), 1);
+      m = _mm512_cmpeq_epi64_mask (keys, _mm512_set1_epi64 (key));
+      b = (m & 0xf) ? b1[i] : b2[i];
+      m = (m & 0xf) ? m : m >> 4;
+#else
+      b = b1[i];
+      if (!(m = cuckoo_8_8_bucket_match (b, key)))
+	{
+	  b = b2[i];
+	  m = cuckoo_8_8_bucket_match (b, key);
+	}
+#endif
+      if (m)
+	{
+	  valuep[i].key = key;
+	  valuep[i].value = b->value[count_trailing_zeros (m)];
+	}
+      else if (PREDICT_TRUE (t->n_stash == 0) ||
+	       cuckoo_8_8_search_stash (t, key, &valuep[i]) < 0)
+	continue;
+      bitmap |= 1 << i;
+      ret++;
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+#endif /* __included_cuckoo_8_8_h__ */
@@ -0,0 +1,157 @@
+/*
+ * Direct index mode: V0/V4 against the direct kernels V18/V19
+ * (direct_index_8_8.h) on one profile of each key category. Included by
+ * bihash_application.c.
+ *
+ * Each profile's table is built by init_hash_table with its direct index
+ * filled through the same insert path, so the dense ranges are the ones
+ * found while inserting. Every key of the table is looked up in key
+ * order (0, 1, 2, ... for category I, as shift_keys does) and in random
+ * order. Reported: the share of the keys served by the index, its memory
+ * next to the bihash's, and CPO. The index is checked against
+ * clib_bihash_search on present and absent keys, then again after
+ * deleting 1 in DIRECT_INDEX_CHECK_DEL_EVERY keys through
+ * direct_index_bihash_add_del.
+ */
+
+#define DIRECT_INDEX_CHECK_DEL_EVERY 64
+
+/* categories I, II, III, IV, V at 1e6 keys (III: 2e6) */
+static u32 direct_index_profiles[] = { 4, 14, 20, 34, 45 };
+static char *direct_index_categories[] = { "I", "II", "III", "IV", "V" };
+
+static char *direct_index_kernels[] = { "V0", "V18", "V4", "V19" };
+
+static int
+direct_index_key_cmp (void *a1, void *a2)
+{
+  u64 *a = a1, *b = a2;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* V18 against clib_bihash_search on keys and key + 1, 0: same results */
+static int
+direct_index_check (direct_index_bihash_t * t, u64 * keys)
+{
+  BVT (clib_bihash_kv) kv, r0, r1;
+  u64 *key;
+  int rv0, rv1, d;
+
+  vec_foreach (key, keys)
+    for (d = 0; d < 2; d++)
+      {
+	kv.key = key[0] + d;
+	rv0 = BV (clib_bihash_search) (t->h, &kv, &r0);
+	rv1 = direct_index_bihash_search (t, &kv, &r1);
+	if (rv0 != rv1 || (rv0 == 0 && (r0.key != r1.key ||
+					r0.value != r1.value)))
+	  return 1;
+      }
+  return 0;
+}
+
+void
+direct_index_perf_test (bihash_profiler_main_t * bpm)
+{
+  BVT (clib_bihash) _h, *h = &_h, *profile_h = bpm->h;
+  BVT (clib_bihash_kv) kv, *deleted = 0, *dkv;
+  direct_index_bihash_t profile_direct = bpm->direct;
+  search_kernel_t *k;
+  u64 *keys = 0, *shuffled = 0, n, i, j, t, hits, loops;
+  u64 cycles[2][ARRAY_LEN (direct_index_kernels)];
+  u64 profile_n_elts = bpm->n_elts;
+  u32 p, o;
+  int failed;
+
+  fformat (stdout, "Direct index:ranges of %d keys,%d%% dense -> direct,every key of the table in key and in random order\n"
+	   "category |---| profile |---| keys |---| order |---| direct |---| chunks |---| bihash MB |---| index MB |---| V0 CPO |---| V18 CPO |---| V4 CPO |---| V19 CPO | \n",
+	   DIRECT_INDEX_8_8_CHUNK, bpm->direct_density_pct ?
+	   bpm->direct_density_pct : DIRECT_INDEX_8_8_DEFAULT_DENSITY_PCT);
+
+  for (p = 0; p < ARRAY_LEN (direct_index_profiles); p++)
+    {
+      clib_memset (h, 0, sizeof (*h));
+      clib_memset (&bpm->direct, 0, sizeof (bpm->direct));
+      direct_index_8_8_init (&bpm->direct.index, bpm->direct_density_pct);
+      init_hash_table_direct = &bpm->direct;
+      if (init_hash_table (g_p_table, direct_index_profiles[p], h, &loops) < 0)
+	{
+	  init_hash_table_direct = 0;
+	  continue;
+	}
+      init_hash_table_direct = 0;
+      direct_index_8_8_seal (&bpm->direct.index);
+      bpm->direct.h = h;
+      bpm->direct.is_init = 1;
+      bpm->h = h;
+      bpm->n_elts = loops;
+
+      keys = search_kernel_table_keys (bpm);
+      vec_sort_with_function (keys, direct_index_key_cmp);
+      while (vec_len (keys) & 7)
+	vec_pop (keys);
+      n = vec_len (keys);
+      shuffled = vec_dup (keys);
+      for (i = n - 1; n && i > 0; i--)
+	{
+	  j = random () % (i + 1);
+	  t = shuffled[i];
+	  shuffled[i] = shuffled[j];
+	  shuffled[j] = t;
+	}
+
+      for (i = 0; i < ARRAY_LEN (direct_index_kernels); i++)
+	{
+	  k = vec_elt_at_index (bpm->kernels, search_kernel_index_by_name
+				(bpm, direct_index_kernels[i]));
+	  for (o = 0; o < 2; o++)
+	    {
+	      cycles[o][i] = search_kernel_time_keys (bpm, k, o ? shuffled :
+						      keys, &hits);
+	      if (hits != n)
+		fformat (stdout, "%s found %ld of %ld keys ---[FAILED]\n",
+			 k->name, hits, n);
+	    }
+	}
+
+      for (o = 0; o < 2; o++)
+	fformat (stdout, "%s       %d       %ld       %s       %.2f%%       %d       %.2f       %.2f       %.2f       %.2f       %.2f       %.2f \n",
+		 direct_index_categories[p], direct_index_profiles[p], n,
+		 o ? "random" : "key",
+		 100.0 * bpm->direct.index.n_keys / vec_len (keys),
+		 vec_len (bpm->direct.index.chunks),
+		 (f64) BV (clib_bihash_bytes_in_use) (h) / (1 << 20),
+		 (f64) direct_index_8_8_memory_bytes (&bpm->direct.index) /
+		 (1 << 20), (f64) cycles[o][0] / n, (f64) cycles[o][1] / n,
+		 (f64) cycles[o][2] / n, (f64) cycles[o][3] / n);
+
+      /* the index against the bihash, then after deletes through it */
+      failed = direct_index_check (&bpm->direct, keys);
+      for (i = 0; i < n; i += DIRECT_INDEX_CHECK_DEL_EVERY)
+	{
+	  kv.key = keys[i];
+	  if (BV (clib_bihash_search) (h, &kv, &kv) == 0)
+	    vec_add1 (deleted, kv);
+	  direct_index_bihash_add_del (&bpm->direct, &kv, 0 /* is_add */ );
+	}
+      failed |= direct_index_check (&bpm->direct, keys);
+      vec_foreach (dkv, deleted)
+	direct_index_bihash_add_del (&bpm->direct, dkv, 1 /* is_add */ );
+      failed |= direct_index_check (&bpm->direct, keys);
+      fformat (stdout, "clib_bihash_search|-> MATCH <-|direct_index_bihash_search ---[%s]\n",
+	       failed ? "FAILED" : "PASS");
+
+      direct_index_8_8_free (&bpm->direct.index);
+      BV (clib_bihash_free) (h);
+      vec_reset_length (deleted);
+      vec_free (keys);
+      vec_free (shuffled);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  bpm->h = profile_h;
+  bpm->n_elts = profile_n_elts;
+  bpm->direct = profile_direct;
+  vec_free (deleted);
+}
@@ -0,0 +1,265 @@
+/*
+ * Direct index in front of a bihash for dense key ranges: the keys of a
+ * range of DIRECT_INDEX_8_8_CHUNK consecutive keys holding enough of
+ * them are served from a flat array of values and a presence bitmap,
+ * without hash, bucket or page. Keys outside such ranges go to the bihash.
+ *
+ * Two levels: chunk_of[key >> DIRECT_INDEX_8_8_LOG2_CHUNK] is the chunk
+ * of the key's range, or DIRECT_INDEX_8_8_NONE. One dense range from 0
+ * (interface or session indexes) is a flat array with one lookup more.
+ *
+ * Ranges are found while the table is built: every add counts its range
+ * (keys below DIRECT_INDEX_8_8_MAX_CHUNKS chunks), and a range which
+ * reaches density_pct % of its keys becomes a chunk, filled from the
+ * bihash once, then kept in sync by every add and delete. The bihash
+ * still holds every key. direct_index_8_8_seal ends the build: it drops
+ * the counts, later adds go to the chunks there are.
+ */
+#ifndef __included_direct_index_8_8_h__
+#define __included_direct_index_8_8_h__
+
+#define DIRECT_INDEX_8_8_LOG2_CHUNK 12
+#define DIRECT_INDEX_8_8_CHUNK (1 << DIRECT_INDEX_8_8_LOG2_CHUNK)
+#define DIRECT_INDEX_8_8_MAX_CHUNKS (1 << 20)	/* keys below 2^32 */
+#define DIRECT_INDEX_8_8_DEFAULT_DENSITY_PCT 25
+#define DIRECT_INDEX_8_8_NONE ((u32) ~0)
+
+typedef struct
+{
+  u64 present[DIRECT_INDEX_8_8_CHUNK / 64];
+  u64 value[DIRECT_INDEX_8_8_CHUNK];
+} direct_index_8_8_chunk_t;
+
+typedef struct
+{
+  u32 *chunk_of;
+  direct_index_8_8_chunk_t **chunks;
+  u16 *counts;			/* keys added per range, until sealed */
+  u32 density_pct;
+  u64 n_keys;			/* keys in the chunks */
+} direct_index_8_8_t;
+
+static void
+direct_index_8_8_init (direct_index_8_8_t * di, u32 density_pct)
+{
+  clib_memset (di, 0, sizeof (*di));
+  di->density_pct = density_pct ? density_pct :
+    DIRECT_INDEX_8_8_DEFAULT_DENSITY_PCT;
+}
+
+static void
+direct_index_8_8_free (direct_index_8_8_t * di)
+{
+  direct_index_8_8_chunk_t **ch;
+
+  vec_foreach (ch, di->chunks)
+    clib_mem_free (ch[0]);
+  vec_free (di->chunks);
+  vec_free (di->chunk_of);
+  vec_free (di->counts);
+  di->n_keys = 0;
+}
+
+always_inline direct_index_8_8_chunk_t *
+direct_index_8_8_chunk (direct_index_8_8_t * di, u64 key)
+{
+  u64 c = key >> DIRECT_INDEX_8_8_LOG2_CHUNK;
+
+  if (c >= vec_len (di->chunk_of) || di->chunk_of[c] == DIRECT_INDEX_8_8_NONE)
+    return 0;
+  return di->chunks[di->chunk_of[c]];
+}
+
+always_inline void
+direct_index_8_8_set (direct_index_8_8_t * di, direct_index_8_8_chunk_t * ch,
+		      u64 key, u64 value)
+{
+  u32 i = key & (DIRECT_INDEX_8_8_CHUNK - 1);
+
+  di->n_keys += !(ch->present[i / 64] & (1ULL << (i % 64)));
+  ch->present[i / 64] |= 1ULL << (i % 64);
+  ch->value[i] = value;
+}
+
+/* range c becomes a chunk, filled with the keys h holds in it */
+static void
+direct_index_8_8_promote (direct_index_8_8_t * di, BVT (clib_bihash) * h,
+			  u64 c)
+{
+  direct_index_8_8_chunk_t *ch;
+  BVT (clib_bihash_kv) kv;
+  u32 i;
+
+  ch = clib_mem_alloc_aligned (sizeof (*ch), CLIB_CACHE_LINE_BYTES);
+  clib_memset (ch->present, 0, sizeof (ch->present));
+  for (i = 0; i < DIRECT_INDEX_8_8_CHUNK; i++)
+    {
+      kv.key = (c << DIRECT_INDEX_8_8_LOG2_CHUNK) + i;
+      if (BV (clib_bihash_search) (h, &kv, &kv) == 0)
+	direct_index_8_8_set (di, ch, kv.key, kv.value);
+    }
+  vec_validate_init_empty (di->chunk_of, c, DIRECT_INDEX_8_8_NONE);
+  di->chunk_of[c] = vec_len (di->chunks);
+  vec_add1 (di->chunks, ch);
+}
+
+/* kv was just added to h */
+static void
+direct_index_8_8_add (direct_index_8_8_t * di, BVT (clib_bihash) * h,
+		      BVT (clib_bihash_kv) * kv)
+{
+  direct_index_8_8_chunk_t *ch = direct_index_8_8_chunk (di, kv->key);
+  u64 c = kv->key >> DIRECT_INDEX_8_8_LOG2_CHUNK;
+
+  if (ch)
+    {
+      direct_index_8_8_set (di, ch, kv->key, kv->value);
+      return;
+    }
+  if (c >= DIRECT_INDEX_8_8_MAX_CHUNKS || !di->density_pct)
+    return;
+  vec_validate (di->counts, c);
+  if (++di->counts[c] * 100 >= di->density_pct * DIRECT_INDEX_8_8_CHUNK)
+    direct_index_8_8_promote (di, h, c);
+}
+
+static void
+direct_index_8_8_del (direct_index_8_8_t * di, u64 key)
+{
+  direct_index_8_8_chunk_t *ch = direct_index_8_8_chunk (di, key);
+  u32 i = key & (DIRECT_INDEX_8_8_CHUNK - 1);
+
+  if (!ch || !(ch->present[i / 64] & (1ULL << (i % 64))))
+    return;
+  ch->present[i / 64] &= ~(1ULL << (i % 64));
+  di->n_keys--;
+}
+
+/* end of the build: no more ranges become chunks */
+static void
+direct_index_8_8_seal (direct_index_8_8_t * di)
+{
+  vec_free (di->counts);
+  di->density_pct = 0;
+}
+
+static uword
+direct_index_8_8_memory_bytes (direct_index_8_8_t * di)
+{
+  return vec_len (di->chunk_of) * sizeof (di->chunk_of[0]) +
+    vec_len (di->chunks) * (sizeof (di->chunks[0]) +
+			    sizeof (direct_index_8_8_chunk_t)) +
+    vec_len (di->counts) * sizeof (di->counts[0]);
+}
+
+/* 0: found, 1: absent from its chunk, -1: not in a chunk, ask the bihash */
+always_inline int
+direct_index_8_8_lookup (direct_index_8_8_t * di, u64 key, u64 * value)
+{
+  direct_index_8_8_chunk_t *ch = direct_index_8_8_chunk (di, key);
+  u32 i = key & (DIRECT_INDEX_8_8_CHUNK - 1);
+
+  if (!ch)
+    return -1;
+  if (!(ch->present[i / 64] & (1ULL << (i % 64))))
+    return 1;
+  *value = ch->value[i];
+  return 0;
+}
+
+/*
+ * The bihash behind its direct index, the table searched by the direct
+ * kernels V18 (scalar) and V19 (direct lookup of 8 keys, then
+ * clib_bihash_search_batch_v4 on the keys of no chunk).
+ */
+typedef struct
+{
+  direct_index_8_8_t index;
+  BVT (clib_bihash) * h;
+  u8 is_init;
+} direct_index_bihash_t;
+
+/* clib_bihash_add_del for a table behind a direct index */
+static inline int
+direct_index_bihash_add_del (direct_index_bihash_t * t,
+			     BVT (clib_bihash_kv) * kv, int is_add)
+{
+  int rv = BV (clib_bihash_add_del) (t->h, kv, is_add);
+
+  if (rv == 0 && is_add)
+    direct_index_8_8_add (&t->index, t->h, kv);
+  else if (rv == 0)
+    direct_index_8_8_del (&t->index, kv->key);
+  return rv;
+}
+
+/* Same contract as clib_bihash_search, never_inline as in cuckoo_8_8.h */
+static never_inline int
+direct_index_bihash_search (direct_index_bihash_t * t,
+			    BVT (clib_bihash_kv) * search_key,
+			    BVT (clib_bihash_kv) * valuep)
+{
+  u64 key = search_key->key, value;
+
+  switch (direct_index_8_8_lookup (&t->index, key, &value))
+    {
+    case 0:
+      valuep->key = key;
+      valuep->value = value;
+      return 0;
+    case 1:
+      return -1;
+    }
+  return BV (clib_bihash_search) (t->h, search_key, valuep);
+}
+
+/* Same contract as clib_bihash_search_batch_v4 */
+static never_inline int
+direct_index_bihash_search_batch (direct_index_bihash_t * t,
+				  BVT (clib_bihash_kv) * search_key,
+				  u8 key_mask, BVT (clib_bihash_kv) * valuep,
+				  u8 * valid_key_idx)
+{
+  BVT (clib_bihash_kv) kv[8], result[8];
+  u32 i, n = 0, n_keys = count_set_bits (key_mask);
+  u64 key, value;
+  u8 idx[8], found = 0, bitmap = 0;
+  int ret = 0, rv;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      key = search_key[i].key;
+      rv = direct_index_8_8_lookup (&t->index, key, &value);
+      if (rv == 0)
+	{
+	  valuep[i].key = key;
+	  valuep[i].value = value;
+	  bitmap |= 1 << i;
+	  ret++;
+	}
+      else if (rv < 0)
+	{
+	  /* keys of no chunk, packed for the batch search */
+	  kv[n] = search_key[i];
+	  idx[n++] = i;
+	}
+    }
+
+  if (n)
+    {
+      BV (clib_bihash_search_batch_v4) (t->h, kv, pow2_mask (n), result,
+					&found);
+      for (i = 0; i < n; i++)
+	if (found & (1 << i))
+	  {
+	    valuep[idx[i]] = result[i];
+	    bitmap |= 1 << idx[i];
+	    ret++;
+	  }
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+#endif /* __included_direct_index_8_8_h__ */
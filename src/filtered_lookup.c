@@ -0,0 +1,79 @@
+/*
+ * Bloom pre-filter sweep: V0/V4 against the filtered kernels V12/V13
+ * over growing shares of absent keys. Included by bihash_application.c.
+ *
+ * Present keys are taken from the profile's table, absent keys have bit
+ * 63 set, which no profile category ever inserts.
+ */
+
+static u32 filtered_sweep_miss_pct[] = { 0, 10, 50, 90, 99 };
+
+static char *filtered_sweep_kernels[] = { "V0", "V12", "V4", "V13" };
+
+void
+filtered_perf_sweep (bihash_profiler_main_t * bpm)
+{
+  bloom_bihash_t *fb;
+  search_kernel_t *k;
+  u64 *present = 0, *keys = 0, n, i, key, n_absent, n_fp;
+  u64 hits, hits0, cycles[ARRAY_LEN (filtered_sweep_kernels)];
+  u32 m, j, pct;
+
+  k = vec_elt_at_index (bpm->kernels,
+			search_kernel_index_by_name (bpm, "V12"));
+  fb = search_kernel_table (bpm, k);
+
+  present = search_kernel_table_keys (bpm);
+  n = vec_len (present) & ~7ULL;
+  if (n == 0)
+    goto done;
+
+  fformat (stdout, "Filter:blocked bloom,%d bits/key,%.2f MB,%.2f bytes/key,%ld keys\n"
+	   "miss%%  |---| V0 CPO |---| V12 CPO |---| V4 CPO |---| V13 CPO |---| FP rate | \n",
+	   fb->filter.bits_per_key,
+	   (f64) bloom_8_8_memory_bytes (&fb->filter) / (1 << 20),
+	   (f64) bloom_8_8_memory_bytes (&fb->filter) / vec_len (present),
+	   vec_len (present));
+
+  for (m = 0; m < ARRAY_LEN (filtered_sweep_miss_pct); m++)
+    {
+      pct = filtered_sweep_miss_pct[m];
+      vec_reset_length (keys);
+      n_absent = n_fp = 0;
+      for (i = 0; i < n; i++)
+	{
+	  if ((u32) (random () % 100) < pct)
+	    {
+	      key = (1ULL << 63) | ((u64) random () << 31) | random ();
+	      n_absent++;
+	      n_fp += bloom_8_8_check (&fb->filter, key);
+	    }
+	  else
+	    key = present[random () % vec_len (present)];
+	  vec_add1 (keys, key);
+	}
+
+      hits0 = ~0ULL;
+      for (j = 0; j < ARRAY_LEN (filtered_sweep_kernels); j++)
+	{
+	  k = vec_elt_at_index (bpm->kernels, search_kernel_index_by_name
+				(bpm, filtered_sweep_kernels[j]));
+	  cycles[j] = search_kernel_time_keys (bpm, k, keys, &hits);
+	  if (hits0 == ~0ULL)
+	    hits0 = hits;
+	  else if (hits != hits0)
+	    fformat (stdout, "%s found %ld keys, V0 found %ld ---[FAILED]\n",
+		     k->name, hits, hits0);
+	}
+
+      fformat (stdout, "%d       %.2f       %.2f       %.2f       %.2f       %.4f%% \n",
+	       pct, (f64) cycles[0] / n, (f64) cycles[1] / n,
+	       (f64) cycles[2] / n, (f64) cycles[3] / n,
+	       n_absent ? 100.0 * n_fp / n_absent : 0);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+done:
+  vec_free (present);
+  vec_free (keys);
+}
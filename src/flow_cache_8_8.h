@@ -0,0 +1,296 @@
+/*
+ * Set-associative exact-match flow cache for 8-byte keys / 8-byte values,
+ * layered over a bihash_8_8 for skewed traffic.
+ *
+ * 4 ways per set, one 64-byte cache line per set (keys first, values
+ * second), sized to stay in L1/L2. The set is picked with the bihash hash
+ * of the key, so a miss goes on to the bihash without hashing again.
+ * Only hits of the bihash are cached, absent keys always reach it.
+ *
+ * The cache is only coherent if the table is updated through
+ * flow_cache_bihash_add_del, which invalidates the key first.
+ */
+#ifndef __included_flow_cache_8_8_h__
+#define __included_flow_cache_8_8_h__
+
+#define FLOW_CACHE_8_8_WAYS       4
+#define FLOW_CACHE_8_8_EMPTY_KEY  (~0ULL)
+#define FLOW_CACHE_8_8_DEFAULT_ENTRIES 4096
+
+#define foreach_flow_cache_policy                                       \
+  _(LRU, "lru")                                                         \
+  _(FIFO, "fifo")                                                       \
+  _(RANDOM, "random")
+
+typedef enum
+{
+#define _(v, s) FLOW_CACHE_POLICY_##v,
+  foreach_flow_cache_policy
+#undef _
+} flow_cache_policy_t;
+
+static char *flow_cache_policy_names[] = {
+#define _(v, s) [FLOW_CACHE_POLICY_##v] = s,
+  foreach_flow_cache_policy
+#undef _
+};
+
+typedef struct
+{
+  u64 key[FLOW_CACHE_8_8_WAYS];
+  u64 value[FLOW_CACHE_8_8_WAYS];
+} flow_cache_8_8_set_t;
+
+typedef struct
+{
+  flow_cache_8_8_set_t *sets;
+  u8 *fifo_next;		/* FIFO: next way to replace, per set */
+  u64 set_mask;
+  u32 n_sets;
+  u32 random_state;		/* RANDOM: xorshift */
+  flow_cache_policy_t policy;
+
+  u64 hits;
+  u64 misses;
+} flow_cache_8_8_t;
+
+always_inline flow_cache_8_8_set_t *
+flow_cache_8_8_set (flow_cache_8_8_t * fc, u64 hash)
+{
+  return fc->sets + (hash & fc->set_mask);
+}
+
+/* bitmap of ways in s holding key */
+always_inline u32
+flow_cache_8_8_match (flow_cache_8_8_set_t * s, u64 key)
+{
+#ifdef __AVX2__
+  __m256i k = _mm256_set1_epi64x (key);
+  __m256i m = _mm256_cmpeq_epi64 (k, _mm256_load_si256 ((__m256i *) s->key));
+  return _mm256_movemask_pd (_mm256_castsi256_pd (m));
+#else
+  u32 i, rv = 0;
+  for (i = 0; i < FLOW_CACHE_8_8_WAYS; i++)
+    rv |= (s->key[i] == key) << i;
+  return rv;
+#endif
+}
+
+static inline void
+flow_cache_8_8_flush (flow_cache_8_8_t * fc)
+{
+  clib_memset (fc->sets, 0xff, fc->n_sets * sizeof (fc->sets[0]));
+  clib_memset (fc->fifo_next, 0, fc->n_sets);
+  fc->hits = fc->misses = 0;
+}
+
+static inline int
+flow_cache_8_8_init (flow_cache_8_8_t * fc, u32 n_entries,
+		     flow_cache_policy_t policy)
+{
+  clib_memset (fc, 0, sizeof (*fc));
+  fc->n_sets = 1 << max_log2 (clib_max (n_entries / FLOW_CACHE_8_8_WAYS, 1));
+  fc->set_mask = fc->n_sets - 1;
+  fc->policy = policy;
+  fc->random_state = 0x9e3779b9;
+  fc->sets = clib_mem_alloc_aligned (fc->n_sets * sizeof (fc->sets[0]),
+				     CLIB_CACHE_LINE_BYTES);
+  fc->fifo_next = clib_mem_alloc (fc->n_sets);
+  if (!fc->sets || !fc->fifo_next)
+    return -1;
+  flow_cache_8_8_flush (fc);
+  return 0;
+}
+
+static inline void
+flow_cache_8_8_free (flow_cache_8_8_t * fc)
+{
+  if (fc->sets)
+    clib_mem_free (fc->sets);
+  if (fc->fifo_next)
+    clib_mem_free (fc->fifo_next);
+  clib_memset (fc, 0, sizeof (*fc));
+}
+
+always_inline uword
+flow_cache_8_8_memory_bytes (flow_cache_8_8_t * fc)
+{
+  return fc->n_sets * (sizeof (fc->sets[0]) + 1);
+}
+
+/* LRU keeps the ways of a set in recency order, way 0 most recent */
+always_inline void
+flow_cache_8_8_promote (flow_cache_8_8_set_t * s, u32 way, u64 key,
+			u64 value)
+{
+  for (; way > 0; way--)
+    {
+      s->key[way] = s->key[way - 1];
+      s->value[way] = s->value[way - 1];
+    }
+  s->key[0] = key;
+  s->value[0] = value;
+}
+
+always_inline int
+flow_cache_8_8_lookup (flow_cache_8_8_t * fc, u64 hash, u64 key, u64 * value)
+{
+  flow_cache_8_8_set_t *s = flow_cache_8_8_set (fc, hash);
+  u32 m = flow_cache_8_8_match (s, key), way;
+
+  if (!m)
+    return -1;
+  way = count_trailing_zeros (m);
+  *value = s->value[way];
+  if (fc->policy == FLOW_CACHE_POLICY_LRU && way)
+    flow_cache_8_8_promote (s, way, key, *value);
+  return 0;
+}
+
+always_inline void
+flow_cache_8_8_insert (flow_cache_8_8_t * fc, u64 hash, u64 key, u64 value)
+{
+  flow_cache_8_8_set_t *s = flow_cache_8_8_set (fc, hash);
+  u32 way, empty;
+
+  switch (fc->policy)
+    {
+    case FLOW_CACHE_POLICY_LRU:
+      /* the least recent way falls off the end */
+      flow_cache_8_8_promote (s, FLOW_CACHE_8_8_WAYS - 1, key, value);
+      return;
+    case FLOW_CACHE_POLICY_FIFO:
+      way = fc->fifo_next[hash & fc->set_mask]++ % FLOW_CACHE_8_8_WAYS;
+      break;
+    case FLOW_CACHE_POLICY_RANDOM:
+    default:
+      empty = flow_cache_8_8_match (s, FLOW_CACHE_8_8_EMPTY_KEY);
+      if (empty)
+	way = count_trailing_zeros (empty);
+      else
+	{
+	  fc->random_state ^= fc->random_state << 13;
+	  fc->random_state ^= fc->random_state >> 17;
+	  fc->random_state ^= fc->random_state << 5;
+	  way = fc->random_state % FLOW_CACHE_8_8_WAYS;
+	}
+      break;
+    }
+  s->key[way] = key;
+  s->value[way] = value;
+}
+
+always_inline void
+flow_cache_8_8_invalidate (flow_cache_8_8_t * fc, u64 hash, u64 key)
+{
+  flow_cache_8_8_set_t *s = flow_cache_8_8_set (fc, hash);
+  u32 m = flow_cache_8_8_match (s, key);
+
+  if (m)
+    s->key[count_trailing_zeros (m)] = FLOW_CACHE_8_8_EMPTY_KEY;
+}
+
+/*
+ * The bihash behind its flow cache, the table searched by the cached
+ * kernels V14 (scalar) and V15 (cache probe of 8 keys, then
+ * clib_bihash_search_batch_v4 on the misses).
+ */
+typedef struct
+{
+  flow_cache_8_8_t cache;
+  BVT (clib_bihash) * h;
+  u8 is_init;
+} flow_cache_bihash_t;
+
+/* clib_bihash_add_del for a table behind a flow cache */
+static inline int
+flow_cache_bihash_add_del (flow_cache_bihash_t * t, BVT (clib_bihash_kv) * kv,
+			   int is_add)
+{
+  flow_cache_8_8_invalidate (&t->cache, BV (clib_bihash_hash) (kv), kv->key);
+  return BV (clib_bihash_add_del) (t->h, kv, is_add);
+}
+
+/* Same contract as clib_bihash_search, never_inline as in cuckoo_8_8.h */
+static never_inline int
+flow_cache_bihash_search (flow_cache_bihash_t * t,
+			  BVT (clib_bihash_kv) * search_key,
+			  BVT (clib_bihash_kv) * valuep)
+{
+  u64 hash = BV (clib_bihash_hash) (search_key);
+  u64 key = search_key->key, value;
+
+  if (flow_cache_8_8_lookup (&t->cache, hash, key, &value) == 0)
+    {
+      t->cache.hits++;
+      valuep->key = key;
+      valuep->value = value;
+      return 0;
+    }
+
+  t->cache.misses++;
+  if (BV (clib_bihash_search_inline_2_with_hash) (t->h, hash, search_key,
+						   valuep) < 0)
+    return -1;
+  flow_cache_8_8_insert (&t->cache, hash, key, valuep->value);
+  return 0;
+}
+
+/* Same contract as clib_bihash_search_batch_v4 */
+static never_inline int
+flow_cache_bihash_search_batch (flow_cache_bihash_t * t,
+				BVT (clib_bihash_kv) * search_key,
+				u8 key_mask, BVT (clib_bihash_kv) * valuep,
+				u8 * valid_key_idx)
+{
+  BVT (clib_bihash_kv) kv[8], result[8];
+  u32 i, n = 0, n_keys = count_set_bits (key_mask);
+  u64 hash[8], value;
+  u8 idx[8], found = 0, bitmap = 0;
+  int ret = 0;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = BV (clib_bihash_hash) (&search_key[i]);
+      CLIB_PREFETCH (flow_cache_8_8_set (&t->cache, hash[i]),
+		     CLIB_CACHE_LINE_BYTES, LOAD);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    {
+      u64 key = search_key[i].key;
+      if (flow_cache_8_8_lookup (&t->cache, hash[i], key, &value) == 0)
+	{
+	  valuep[i].key = key;
+	  valuep[i].value = value;
+	  bitmap |= 1 << i;
+	  ret++;
+	  continue;
+	}
+      /* misses, packed for the batch search */
+      kv[n] = search_key[i];
+      idx[n++] = i;
+    }
+  t->cache.hits += ret;
+  t->cache.misses += n;
+
+  if (n)
+    {
+      BV (clib_bihash_search_batch_v4) (t->h, kv, pow2_mask (n), result,
+					&found);
+      for (i = 0; i < n; i++)
+	if (found & (1 << i))
+	  {
+	    valuep[idx[i]] = result[i];
+	    flow_cache_8_8_insert (&t->cache, hash[idx[i]], result[i].key,
+				   result[i].value);
+	    bitmap |= 1 << idx[i];
+	    ret++;
+	  }
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+#endif /* __included_flow_cache_8_8_h__ */
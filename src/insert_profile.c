@@ -0,0 +1,273 @@
+/*
+ * Insert profile: cycles of every clib_bihash_add_del of init_hash_table
+ * and the bucket events it triggered, to see what a split costs a
+ * control-plane add as the table fills. Included by bihash_application.c,
+ * ahead of init_hash_table, which calls insert_profile_add through
+ * profile_table_add while init_hash_table_inserts is set.
+ *
+ * Events are read off the key's bucket before and after the add, in the
+ * names of the bihash stats (see inc_stats_callback):
+ *   alloc_add  the bucket was empty
+ *   splits[k]  the bucket of k pages was split
+ *   resplit    the split grew the bucket by more than one step
+ *   linear     the bucket ended up in linear search
+ * so they exist without BIHASH_ENABLE_STATS; with it, the totals are
+ * checked against the stats counters. The bucket is read before the timed
+ * add, its cache miss is not in the cycles.
+ */
+
+#define INSERT_PROFILE_DEFAULT_WORST 10
+#define INSERT_PROFILE_MAX_LOG2_PAGES 16
+#define INSERT_PROFILE_HIST_BINS 24	/* log2 cycle bins */
+#define INSERT_PROFILE_USAGE_BINS 10
+
+#define INSERT_PROFILE_F_ALLOC   (1 << 0)
+#define INSERT_PROFILE_F_SPLIT   (1 << 1)
+#define INSERT_PROFILE_F_RESPLIT (1 << 2)
+#define INSERT_PROFILE_F_LINEAR  (1 << 3)
+
+typedef struct
+{
+  u64 key;
+  u32 cycles;
+  u8 log2_pages;		/* of the bucket before the add */
+  u8 flags;			/* INSERT_PROFILE_F_* */
+  u16 usage;			/* bucket usage before the add, 1/10000 */
+} insert_profile_rec_t;
+
+typedef struct
+{
+  insert_profile_rec_t *recs;
+  u64 n_active_buckets;
+  timer_calib_t *timer;		/* calibrated, the perf runs' own */
+} insert_profile_t;
+
+static void
+insert_profile_init (insert_profile_t * ip, timer_calib_t * timer)
+{
+  clib_memset (ip, 0, sizeof (*ip));
+  ip->timer = timer;
+}
+
+static void
+insert_profile_add (insert_profile_t * ip, BVT (clib_bihash) * h,
+		    BVT (clib_bihash_kv) * kv)
+{
+  BVT (clib_bihash_bucket) * b = 0, before;
+  insert_profile_rec_t *r;
+  u64 t0, t1;
+
+  vec_add2 (ip->recs, r, 1);
+  r->key = kv->key;
+  r->usage = h->nbuckets ? ip->n_active_buckets * 10000 / h->nbuckets : 0;
+
+  /* buckets come with the first add when the table is lazily instantiated */
+  clib_memset (&before, 0, sizeof (before));
+  if (h->instantiated)
+    {
+      b = BV (clib_bihash_get_bucket) (h, BV (clib_bihash_hash) (kv));
+      before = *b;
+    }
+
+  t0 = timer_begin ();
+  BV (clib_bihash_add_del) (h, kv, 1 /* is_add */ );
+  t1 = timer_end ();
+  r->cycles = clib_min (timer_cycles (ip->timer, t0, t1), (u64) ~0U);
+
+  if (!b)
+    b = BV (clib_bihash_get_bucket) (h, BV (clib_bihash_hash) (kv));
+  r->log2_pages = before.log2_pages;
+  if (BV (clib_bihash_bucket_is_empty) (&before))
+    {
+      r->flags |= INSERT_PROFILE_F_ALLOC;
+      ip->n_active_buckets++;
+    }
+  else if (b->log2_pages != before.log2_pages)
+    {
+      r->flags |= INSERT_PROFILE_F_SPLIT;
+      if (b->linear_search)
+	r->flags |= INSERT_PROFILE_F_LINEAR;
+      else if (b->log2_pages > before.log2_pages + 1)
+	r->flags |= INSERT_PROFILE_F_RESPLIT;
+    }
+}
+
+/* event class: 0 no split, 1 + k split of a 2^k page bucket */
+always_inline u32
+insert_profile_class (insert_profile_rec_t * r)
+{
+  if (!(r->flags & INSERT_PROFILE_F_SPLIT))
+    return 0;
+  return 1 + clib_min (r->log2_pages, INSERT_PROFILE_MAX_LOG2_PAGES);
+}
+
+static u8 *
+format_insert_profile_class (u8 * s, va_list * args)
+{
+  u32 class = va_arg (*args, u32);
+
+  if (class == 0)
+    return format (s, "no split");
+  return format (s, "splits[%d]", 1 << (class - 1));
+}
+
+static u8 *
+format_insert_profile_flags (u8 * s, va_list * args)
+{
+  insert_profile_rec_t *r = va_arg (*args, insert_profile_rec_t *);
+
+  if (r->flags & INSERT_PROFILE_F_ALLOC)
+    s = format (s, "alloc_add");
+  else if (r->flags & INSERT_PROFILE_F_SPLIT)
+    s = format (s, "splits[%d]", 1 << r->log2_pages);
+  else
+    s = format (s, "add");
+  if (r->flags & INSERT_PROFILE_F_RESPLIT)
+    s = format (s, ",resplit");
+  if (r->flags & INSERT_PROFILE_F_LINEAR)
+    s = format (s, ",linear");
+  return s;
+}
+
+static int
+insert_profile_worst_cmp (void *a1, void *a2)
+{
+  insert_profile_rec_t *a = *(insert_profile_rec_t **) a1;
+  insert_profile_rec_t *b = *(insert_profile_rec_t **) a2;
+
+  return a->cycles > b->cycles ? -1 : a->cycles < b->cycles;
+}
+
+void
+insert_profile_report (insert_profile_t * ip, BVT (clib_bihash) * h,
+		       int profile_id, u32 n_worst)
+{
+  u32 n_classes = 1 + 1 + INSERT_PROFILE_MAX_LOG2_PAGES;
+  u32 **cycles = 0, *c, class, bin, min_bin = ~0, max_bin = 0, i;
+  u64 hist[INSERT_PROFILE_HIST_BINS][1 + 1 + INSERT_PROFILE_MAX_LOG2_PAGES];
+  u64 usage_splits[INSERT_PROFILE_USAGE_BINS];
+  u32 *usage_cycles[INSERT_PROFILE_USAGE_BINS] = { 0 };
+  insert_profile_rec_t *r, **worst = 0;
+  u64 n_resplit = 0, n_linear = 0, n_alloc = 0, total = 0, sum;
+  u64 n = vec_len (ip->recs);
+
+  if (n == 0)
+    return;
+
+  vec_validate (cycles, n_classes - 1);
+  clib_memset (hist, 0, sizeof (hist));
+  clib_memset (usage_splits, 0, sizeof (usage_splits));
+  vec_foreach (r, ip->recs)
+  {
+    class = insert_profile_class (r);
+    vec_add1 (cycles[class], r->cycles);
+    bin = clib_min (r->cycles ? min_log2 (r->cycles) : 0,
+		    INSERT_PROFILE_HIST_BINS - 1);
+    hist[bin][class]++;
+    min_bin = clib_min (min_bin, bin);
+    max_bin = clib_max (max_bin, bin);
+    i = clib_min (r->usage * INSERT_PROFILE_USAGE_BINS / 10000,
+		  INSERT_PROFILE_USAGE_BINS - 1);
+    vec_add1 (usage_cycles[i], r->cycles);
+    usage_splits[i] += class != 0;
+    n_alloc += (r->flags & INSERT_PROFILE_F_ALLOC) != 0;
+    n_resplit += (r->flags & INSERT_PROFILE_F_RESPLIT) != 0;
+    n_linear += (r->flags & INSERT_PROFILE_F_LINEAR) != 0;
+    total += r->cycles;
+    vec_add1 (worst, r);
+  }
+
+  fformat (stdout, "Insert profile:profile_id[%d],%ld inserts,%d buckets,%.2f%% bucket usage at the end\n"
+	   "    events: alloc_add %ld, split %ld, resplit %ld, linear %ld\n"
+	   "event  |---| Inserts |---| Share |---| Mean |---| p50 |---| p99 |---| Max |---| Cycle share | \n",
+	   profile_id, n, h->nbuckets,
+	   100.0 * ip->n_active_buckets / clib_max (h->nbuckets, 1), n_alloc,
+	   n - vec_len (cycles[0]), n_resplit, n_linear);
+  for (class = 0; class < n_classes; class++)
+    {
+      c = cycles[class];
+      if (vec_len (c) == 0)
+	continue;
+      vec_sort_with_function (c, profiler_u32_cmp);
+      sum = 0;
+      for (i = 0; i < vec_len (c); i++)
+	sum += c[i];
+      fformat (stdout, "%U       %ld       %.2f%%       %.2f       %d       %d       %d       %.2f%% \n",
+	       format_insert_profile_class, class, vec_len (c),
+	       100.0 * vec_len (c) / n, (f64) sum / vec_len (c),
+	       profiler_pct (c, 50), profiler_pct (c, 99),
+	       vec_elt (c, vec_len (c) - 1), total ? 100.0 * sum / total : 0);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  /* latency histogram, one column per event class */
+  fformat (stdout, "Insert latency:inserts per cycle bin\ncycles ");
+  for (class = 0; class < n_classes; class++)
+    if (vec_len (cycles[class]))
+      fformat (stdout, " |---| %U", format_insert_profile_class, class);
+  fformat (stdout, " | \n");
+  for (bin = min_bin; bin <= max_bin; bin++)
+    {
+      fformat (stdout, "%ld-%ld", bin ? 1ULL << bin : 0, (2ULL << bin) - 1);
+      for (class = 0; class < n_classes; class++)
+	if (vec_len (cycles[class]))
+	  fformat (stdout, "       %ld", hist[bin][class]);
+      fformat (stdout, " \n");
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  /* cost of an add as the buckets fill */
+  fformat (stdout, "Insert by bucket usage:\n"
+	   "usage  |---| Inserts |---| Mean |---| p99 |---| Max |---| Splits |---| Split share | \n");
+  for (i = 0; i < INSERT_PROFILE_USAGE_BINS; i++)
+    {
+      c = usage_cycles[i];
+      if (vec_len (c) == 0)
+	continue;
+      vec_sort_with_function (c, profiler_u32_cmp);
+      sum = 0;
+      for (bin = 0; bin < vec_len (c); bin++)
+	sum += c[bin];
+      fformat (stdout, "%d-%d%%       %ld       %.2f       %d       %d       %ld       %.2f%% \n",
+	       i * 100 / INSERT_PROFILE_USAGE_BINS,
+	       (i + 1) * 100 / INSERT_PROFILE_USAGE_BINS, vec_len (c),
+	       (f64) sum / vec_len (c), profiler_pct (c, 99),
+	       vec_elt (c, vec_len (c) - 1), usage_splits[i],
+	       100.0 * usage_splits[i] / vec_len (c));
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  vec_sort_with_function (worst, insert_profile_worst_cmp);
+  fformat (stdout, "Worst inserts:\n"
+	   "insert  |---| key |---| cycles |---| event |---| bucket usage | \n");
+  for (i = 0; i < clib_min (n_worst, vec_len (worst)); i++)
+    fformat (stdout, "%ld       0x%lx       %d       %U       %.2f%% \n",
+	     worst[i] - ip->recs, worst[i]->key, worst[i]->cycles,
+	     format_insert_profile_flags, worst[i], worst[i]->usage / 100.0);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+#if BIHASH_ENABLE_STATS
+  {
+    int n_diff = stats.linear != n_linear;
+
+    for (class = 1; class < n_classes; class++)
+      n_diff += (class - 1 < vec_len (stats.splits) ?
+		 stats.splits[class - 1] : 0) != vec_len (cycles[class]);
+    fformat (stdout, "insert profile events|-> MATCH <-|bihash stats ---[%s]\n",
+	     n_diff ? "FAILED" : "PASS");
+  }
+#endif
+
+  for (class = 0; class < n_classes; class++)
+    vec_free (cycles[class]);
+  vec_free (cycles);
+  for (i = 0; i < INSERT_PROFILE_USAGE_BINS; i++)
+    vec_free (usage_cycles[i]);
+  vec_free (worst);
+}
+
+void
+insert_profile_free (insert_profile_t * ip)
+{
+  vec_free (ip->recs);
+}
@@ -0,0 +1,256 @@
+/*
+ * Lookup-and-update mode: the search kernels V0/V4 against searches which
+ * add 1 to the value of the kvp they hit, in the table (bihash_update.h),
+ * plain and atomic. Included by bihash_application.c.
+ *
+ * First one thread, then "update <n>" threads pinned to their own CPUs,
+ * every one of them over the same present keys in its own random order,
+ * so the updates dirty lines the other threads read and write. Lost
+ * updates are the hits the values in the table do not account for: the
+ * plain updates of threads racing on one kvp. The values are put back
+ * once done.
+ */
+
+#define LOOKUP_UPDATE_DEFAULT_THREADS 4
+#define LOOKUP_UPDATE_MAX_KEYS (1 << 20)
+
+/* _(variant, name, batch_width, is_update) */
+#define foreach_lookup_update_variant                                   \
+  _(V0, "V0", 1, 0)                                                     \
+  _(V4, "V4", 8, 0)                                                     \
+  _(U0, "U0", 1, 1)                                                     \
+  _(U0_ATOMIC, "U0 atomic", 1, 1)                                       \
+  _(U8, "U8", 8, 1)                                                     \
+  _(U8_ATOMIC, "U8 atomic", 8, 1)
+
+typedef enum
+{
+#define _(v, n, w, u) LOOKUP_UPDATE_##v,
+  foreach_lookup_update_variant
+#undef _
+  LOOKUP_UPDATE_N_VARIANTS,
+} lookup_update_variant_t;
+
+static char *lookup_update_names[] = {
+#define _(v, n, w, u) [LOOKUP_UPDATE_##v] = n,
+  foreach_lookup_update_variant
+#undef _
+};
+
+static u8 lookup_update_is_update[] = {
+#define _(v, n, w, u) [LOOKUP_UPDATE_##v] = u,
+  foreach_lookup_update_variant
+#undef _
+};
+
+typedef struct
+{
+  pthread_t thread;
+  u32 index;
+  u32 cpu;
+  lookup_update_variant_t variant;
+  BVT (clib_bihash) * h;
+  u64 *keys;
+  pthread_barrier_t *barrier;
+
+  /* results */
+  u64 start, end;
+  u64 hits;
+} lookup_update_worker_t;
+
+/* hits of variant over keys, vec_len (keys) a multiple of 8 */
+static u64
+lookup_update_run (BVT (clib_bihash) * h, lookup_update_variant_t variant,
+		   u64 * keys)
+{
+  BVT (clib_bihash_kv) kv[8];
+  u64 i, n = vec_len (keys), hits = 0;
+  u8 valid_key_idx;
+  u32 j;
+
+#define lookup_update_loop(call)                                        \
+  for (i = 0; i < n; i++)                                               \
+    {                                                                   \
+      kv[0].key = keys[i];                                              \
+      hits += (call) == 0;                                              \
+    }
+#define lookup_update_batch_loop(call)                                  \
+  for (i = 0; i < n; i += 8)                                            \
+    {                                                                   \
+      for (j = 0; j < 8; j++)                                           \
+        kv[j].key = keys[i + j];                                        \
+      if ((call) > 0)                                                   \
+        hits += count_set_bits (valid_key_idx);                         \
+    }
+
+  switch (variant)
+    {
+    case LOOKUP_UPDATE_V0:
+      lookup_update_loop (BV (clib_bihash_search) (h, kv, kv));
+      break;
+    case LOOKUP_UPDATE_V4:
+      lookup_update_batch_loop (BV (clib_bihash_search_batch_v4)
+				(h, kv, 0xFF, kv, &valid_key_idx));
+      break;
+    case LOOKUP_UPDATE_U0:
+      lookup_update_loop (BV (clib_bihash_search_update) (h, kv, 1));
+      break;
+    case LOOKUP_UPDATE_U0_ATOMIC:
+      lookup_update_loop (BV (clib_bihash_search_update_atomic) (h, kv, 1));
+      break;
+    case LOOKUP_UPDATE_U8:
+      lookup_update_batch_loop (BV (clib_bihash_search_update_batch)
+				(h, kv, 0xFF, 1, &valid_key_idx));
+      break;
+    case LOOKUP_UPDATE_U8_ATOMIC:
+      lookup_update_batch_loop (BV (clib_bihash_search_update_batch_atomic)
+				(h, kv, 0xFF, 1, &valid_key_idx));
+      break;
+    default:
+      break;
+    }
+#undef lookup_update_loop
+#undef lookup_update_batch_loop
+  return hits;
+}
+
+static void *
+lookup_update_worker_fn (void *arg)
+{
+  lookup_update_worker_t *w = arg;
+  cpu_set_t cpuset;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (w->cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+
+  pthread_barrier_wait (w->barrier);
+  w->start = timer_begin ();
+  w->hits = lookup_update_run (w->h, w->variant, w->keys);
+  w->end = timer_end ();
+  return 0;
+}
+
+static int
+lookup_update_kv_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  BVT (clib_bihash_kv) ** kvs = arg;
+  vec_add1 (*kvs, kv[0]);
+  return BIHASH_WALK_CONTINUE;
+}
+
+static int
+lookup_update_sum_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  u64 *sum = arg;
+  *sum += kv->value;
+  return BIHASH_WALK_CONTINUE;
+}
+
+static u64
+lookup_update_value_sum (BVT (clib_bihash) * h)
+{
+  u64 sum = 0;
+
+  BV (clib_bihash_foreach_key_value_pair) (h, lookup_update_sum_cb, &sum);
+  return sum;
+}
+
+void
+lookup_update_perf_test (bihash_profiler_main_t * bpm,
+			 f64 cycles_per_second)
+{
+  BVT (clib_bihash) * h = bpm->h;
+  BVT (clib_bihash_kv) * saved = 0, *kv;
+  lookup_update_worker_t *workers = 0, *w;
+  lookup_update_variant_t variant;
+  pthread_barrier_t barrier;
+  u32 n = bpm->update_threads ? bpm->update_threads :
+    LOOKUP_UPDATE_DEFAULT_THREADS, n_cpus = clib_max (get_nprocs (), 1);
+  u64 *keys = 0, start, end, hits, options, sum0, lost, i, n_keys;
+  u64 cycles[LOOKUP_UPDATE_N_VARIANTS];
+  int warm;
+
+  BV (clib_bihash_foreach_key_value_pair) (h, lookup_update_kv_cb, &saved);
+  n_keys = clib_min (vec_len (saved), LOOKUP_UPDATE_MAX_KEYS) & ~7ULL;
+  if (n_keys == 0)
+    goto done;
+  for (i = 0; i < n_keys; i++)
+    vec_add1 (keys, saved[random () % vec_len (saved)].key);
+
+  fformat (stdout, "Lookup-and-update:%ld present keys in random order,U: add 1 to the value in place\n"
+	   "API  |---|  CPO  |---| MOPS  |---|Ratio for OPS|---| Hits | \n",
+	   vec_len (keys));
+  for (variant = 0; variant < LOOKUP_UPDATE_N_VARIANTS; variant++)
+    {
+      for (warm = 0; warm < 2; warm++)
+	{
+	  perf_timer_begin (start);
+	  hits = lookup_update_run (h, variant, keys);
+	  perf_timer_end (start, cycles[variant]);
+	}
+      fformat (stdout, "%s       %.2f       %.2f      %.2f%%       %ld \n",
+	       lookup_update_names[variant],
+	       (f64) cycles[variant] / vec_len (keys),
+	       vec_len (keys) / ((f64) cycles[variant] / cycles_per_second) /
+	       1e6, 100.0 * cycles[0] / cycles[variant], hits);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  /* every thread over the same keys, each in its own order */
+  vec_validate (workers, n - 1);
+  vec_foreach (w, workers)
+    w->keys = profiler_shuffle (keys);
+
+  fformat (stdout, "Lookup-and-update:%d threads on %d cpus,all over the same %ld keys\n"
+	   "API  |---| MOPS |---| CPO/thread |---| Hits |---| Lost updates | \n",
+	   n, n_cpus, vec_len (keys));
+  for (variant = 0; variant < LOOKUP_UPDATE_N_VARIANTS; variant++)
+    {
+      sum0 = lookup_update_value_sum (h);
+      pthread_barrier_init (&barrier, 0, n);
+      vec_foreach (w, workers)
+      {
+	w->index = w - workers;
+	w->cpu = w->index % n_cpus;
+	w->variant = variant;
+	w->h = h;
+	w->barrier = &barrier;
+	w->hits = 0;
+	pthread_create (&w->thread, 0, lookup_update_worker_fn, w);
+      }
+
+      start = ~0ULL;
+      end = hits = 0;
+      vec_foreach (w, workers)
+      {
+	pthread_join (w->thread, 0);
+	start = clib_min (start, w->start);
+	end = clib_max (end, w->end);
+	hits += w->hits;
+      }
+      pthread_barrier_destroy (&barrier);
+
+      options = vec_len (keys) * n;
+      lost = hits - (lookup_update_value_sum (h) - sum0);
+      fformat (stdout, "%s       %.2f       %.2f       %ld       ",
+	       lookup_update_names[variant],
+	       options / ((f64) (end - start) / cycles_per_second) / 1e6,
+	       (f64) (end - start) * n / options, hits);
+      if (lookup_update_is_update[variant])
+	fformat (stdout, "%ld \n", lost);
+      else
+	fformat (stdout, "n/a \n");
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+done:
+  /* values as init_hash_table left them */
+  vec_foreach (kv, saved)
+    BV (clib_bihash_add_del) (h, kv, 1 /* is_add */ );
+  vec_foreach (w, workers)
+    vec_free (w->keys);
+  vec_free (workers);
+  vec_free (saved);
+  vec_free (keys);
+}
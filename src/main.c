@@ -25,10 +25,150 @@ int main(int argc,char *argv[])
     is_consistency = atoi(argv[3]);
   }
 
-  start_mod = 1;
+  start_mod = START_MODE_WARM;
 
   // clib_mem_init_with_page_size (1ULL << 30, CLIB_MEM_PAGE_SZ_1G);
   clib_mem_init (0, 1ULL << 31);
-  
+
+  /*
+   * Optional trailing options:
+   *   kernel <name>  run this kernel, may be repeated (V0, V4, V5, V8..V19)
+   *   plugin <path>  load search kernels from a shared object
+   *   cold           also time each kernel once with its table evicted
+   *   tlb            as cold, and disturb the TLB before the cold run
+   *   shards <n>     also split the keys across n shards searched by n workers
+   *   bloom <bits>   fill a <bits> per key bloom filter while building the
+   *                  table, sweep V0/V4 against filtered V12/V13 by miss ratio
+   *   flowcache <n>  n entry flow cache for V14/V15, sweep V0/V4 against them
+   *                  over uniform, sequential and hot-set keys
+   *   policy <name>  flow cache replacement: lru (default), fifo, random
+   *   wide           V0 against the wide key batch search for 16_8, 40_8, 48_8
+   *   build <n>      build the profile's table again with n threads, prefaulted
+   *                  arena and keys partitioned by bucket, against the serial build
+   *   soak <s>       run every kernel for s seconds, one MOPS/CPO sample per interval
+   *   interval <ms>  soak sample interval, default 100
+   *   counters       add page faults, core/tsc and rss to the soak samples
+   *   record <file>  append the CPO of every kernel to a baseline file
+   *   compare <file> compare every kernel with the baseline, exit 2 on regression
+   *   repeat <n>     warm runs per kernel, default 5 with record/compare, else 1
+   *   threshold <p>  slowdown in percent a compare tolerates, default 5
+   *   inserts [<n>] time every add of the table build, report latency by
+   *                  split event and bucket usage and the n (10) worst adds
+   *   heatmap <n>    walk 1 in n keys of the perf key stream down the table, report
+   *                  bucket skew and pages read, write bihash_heatmap_<id>_<keys>.csv
+   *   cachesweep [<MB>] V0/V4/V5 CPO over tables from L1d / 8 to 8x the last
+   *                  level cache (or <MB>), cache sizes from sysfs
+   *   update [<n>]   V0/V4 against searches adding to the value they hit, plain
+   *                  and atomic, on one thread then on n (4) over the same keys
+   *   noisy <cpus>   V0/V4/V5 with a stream, LLC and pointer chase hog on each of
+   *                  <cpus>: sibling, socket or a list such as 2,4-7
+   *   readers [<n>]  export the table to a memfd, V0/V4/V5 in n (4) reader
+   *                  processes attached read-only against n threads
+   *   masked         V0/V4/V5 against the any n batch search on frames of random
+   *                  sizes and sparse valid masks
+   *   direct [<pct>] fill the direct index of V18/V19 while building the table
+   *                  (ranges <pct> (25) % dense), time V0/V4 against them on a
+   *                  profile of each category
+   *   resize [<n>]   grow a copy of the table to twice its buckets, n (64)
+   *                  buckets per step between rounds of lookups, CPO and
+   *                  latency percentiles before, during and after
+   *   chain <id>     also search every key in the table of profile <id> after
+   *                  the profile's own, may be repeated
+   */
+  if(argc > 4){
+    bihash_profiler_main_t *bpm = &bihash_profiler_main;
+    unformat_input_t input;
+    u8 *s;
+    u32 id;
+
+    unformat_init_command_line (&input, argv + 3);
+    while (unformat_check_input (&input) != UNFORMAT_END_OF_INPUT)
+      {
+        if (unformat (&input, "kernel %s", &s))
+          vec_add1 (bpm->kernel_names, s);
+        else if (unformat (&input, "plugin %s", &s))
+          vec_add1 (bpm->plugin_paths, s);
+        else if (unformat (&input, "shards %d", &bpm->n_shards))
+          ;
+        else if (unformat (&input, "chain %d", &id))
+          vec_add1 (bpm->chain_profiles, id);
+        else if (unformat (&input, "bloom %d", &bpm->bloom_bits_per_key))
+          ;
+        else if (unformat (&input, "flowcache %d", &bpm->flow_cache_entries))
+          ;
+        else if (unformat (&input, "policy %s", &s))
+          {
+            for (id = 0; id < ARRAY_LEN (flow_cache_policy_names); id++)
+              if (!strcmp ((char *) s, flow_cache_policy_names[id]))
+                bpm->flow_cache_policy = id;
+            vec_free (s);
+          }
+        else if (unformat (&input, "build %d", &bpm->build_threads))
+          ;
+        else if (unformat (&input, "soak %d", &bpm->soak_seconds))
+          ;
+        else if (unformat (&input, "interval %d", &bpm->soak_interval_ms))
+          ;
+        else if (unformat (&input, "counters"))
+          bpm->soak_counters = 1;
+        else if (unformat (&input, "record %s", &bpm->baseline_path))
+          vec_add1 (bpm->baseline_path, 0);
+        else if (unformat (&input, "compare %s", &bpm->baseline_path))
+          {
+            vec_add1 (bpm->baseline_path, 0);
+            bpm->baseline_compare = 1;
+          }
+        else if (unformat (&input, "repeat %d", &bpm->repeat))
+          ;
+        else if (unformat (&input, "threshold %f", &bpm->regression_threshold))
+          ;
+        else if (unformat (&input, "inserts %d", &bpm->insert_worst))
+          bpm->insert_profile = 1;
+        else if (unformat (&input, "inserts"))
+          bpm->insert_profile = 1;
+        else if (unformat (&input, "heatmap %d", &bpm->heatmap_every))
+          ;
+        else if (unformat (&input, "cachesweep %d", &bpm->cache_sweep_max_mb))
+          bpm->cache_sweep = 1;
+        else if (unformat (&input, "cachesweep"))
+          bpm->cache_sweep = 1;
+        else if (unformat (&input, "update %d", &bpm->update_threads))
+          bpm->lookup_update = 1;
+        else if (unformat (&input, "update"))
+          bpm->lookup_update = 1;
+        else if (unformat (&input, "noisy %s", &bpm->noisy_cpus))
+          vec_add1 (bpm->noisy_cpus, 0);
+        else if (unformat (&input, "direct %d", &bpm->direct_density_pct))
+          bpm->direct_index = 1;
+        else if (unformat (&input, "direct"))
+          bpm->direct_index = 1;
+        else if (unformat (&input, "readers %d", &bpm->shared_readers))
+          bpm->shared_readers_mode = 1;
+        else if (unformat (&input, "readers"))
+          bpm->shared_readers_mode = 1;
+        else if (unformat (&input, "resize %d", &bpm->resize_step))
+          bpm->online_resize = 1;
+        else if (unformat (&input, "resize"))
+          bpm->online_resize = 1;
+        else if (unformat (&input, "masked"))
+          bpm->masked_batch = 1;
+        else if (unformat (&input, "wide"))
+          bpm->wide_keys = 1;
+        else if (unformat (&input, "cold"))
+          start_mod = START_MODE_COLD;
+        else if (unformat (&input, "tlb"))
+          {
+            start_mod = START_MODE_COLD;
+            bpm->cold_cache.disturb_tlb = 1;
+          }
+        else
+          {
+            fformat (stderr, "unknown input '%U'\n", format_unformat_error, &input);
+            return 1;
+          }
+      }
+    unformat_free (&input);
+  }
+
   return perf_cmp_body(is_which_profile,start_mod,is_which_cmp, is_consistency);
 }
@@ -0,0 +1,303 @@
+/*
+ * Masked batch mode: frames of any size with sparse valid masks, as a
+ * node gets its packets, searched by V0, V4 and V5 against the any n
+ * batch search of bihash_batch_n.h. Included by bihash_application.c.
+ *
+ * V4 and V5 search the first count_set_bits (key_mask) keys of 8, so the
+ * valid keys of a frame are packed into groups of 8 first and what they
+ * find is put back at the keys' places in the frame. The last group goes
+ * either to clib_bihash_search key by key, as perf_test_batch_vars does,
+ * or to one batch call with the key_mask of its keys. The batch_n search
+ * takes the frame and its mask as they are.
+ *
+ * Every pattern is MASKED_BATCH_KEYS keys of the table in random order,
+ * cut in frames of the pattern's sizes and valid masks; CPO is per valid
+ * key. Each API is checked against V0 on the kvps it finds.
+ */
+
+#define MASKED_BATCH_KEYS (1 << 20)
+
+/* _(pattern, name, min frame, max frame, valid keys) */
+#define foreach_masked_batch_pattern                                    \
+  _(FULL, "256 all", 256, 256, ALL)                                     \
+  _(RANDOM, "1-256 all", 1, 256, ALL)                                   \
+  _(TAILS, "1-7 all", 1, 7, ALL)                                        \
+  _(HALF, "1-256 50%", 1, 256, HALF)                                    \
+  _(ALTERNATE, "1-256 0x55", 1, 256, ALTERNATE)                         \
+  _(ONE_IN_8, "1-256 1 in 8", 1, 256, ONE_IN_8)
+
+typedef enum
+{
+  MASKED_BATCH_VALID_ALL,
+  MASKED_BATCH_VALID_HALF,
+  MASKED_BATCH_VALID_ALTERNATE,
+  MASKED_BATCH_VALID_ONE_IN_8,
+} masked_batch_valid_t;
+
+typedef struct
+{
+  char *name;
+  u32 min_n, max_n;
+  masked_batch_valid_t valid;
+} masked_batch_pattern_t;
+
+static masked_batch_pattern_t masked_batch_patterns[] = {
+#define _(p, s, lo, hi, v) { s, lo, hi, MASKED_BATCH_VALID_##v },
+  foreach_masked_batch_pattern
+#undef _
+};
+
+/* _(variant, name) */
+#define foreach_masked_batch_variant                                    \
+  _(V0, "V0")                                                           \
+  _(V4_SCALAR_TAIL, "V4+V0 tail")                                       \
+  _(V4, "V4")                                                           \
+  _(V5, "V5")                                                           \
+  _(N, "batch_n")
+
+typedef enum
+{
+#define _(v, n) MASKED_BATCH_##v,
+  foreach_masked_batch_variant
+#undef _
+  MASKED_BATCH_N_VARIANTS,
+} masked_batch_variant_t;
+
+static char *masked_batch_names[] = {
+#define _(v, n) [MASKED_BATCH_##v] = n,
+  foreach_masked_batch_variant
+#undef _
+};
+
+typedef struct
+{
+  u32 offset;
+  u32 n;
+  u32 n_valid;
+  u64 mask[BIHASH_BATCH_N_MAX / 64];
+} masked_batch_frame_t;
+
+/* frames of pattern over n_keys keys */
+static masked_batch_frame_t *
+masked_batch_frames (masked_batch_pattern_t * pt, u64 n_keys)
+{
+  masked_batch_frame_t *frames = 0, *f;
+  u64 offset = 0;
+  u32 i;
+
+  while (offset < n_keys)
+    {
+      vec_add2 (frames, f, 1);
+      clib_memset (f, 0, sizeof (*f));
+      f->offset = offset;
+      f->n = pt->min_n + random () % (pt->max_n - pt->min_n + 1);
+      f->n = clib_min (f->n, n_keys - offset);
+      for (i = 0; i < f->n; i++)
+	if (pt->valid == MASKED_BATCH_VALID_ALL ||
+	    (pt->valid == MASKED_BATCH_VALID_HALF && (random () & 1)) ||
+	    (pt->valid == MASKED_BATCH_VALID_ALTERNATE && !(i & 1)))
+	  f->mask[i / 64] |= 1ULL << (i % 64);
+      if (pt->valid == MASKED_BATCH_VALID_ONE_IN_8)
+	for (i = 0; i < f->n; i += 8)
+	  {
+	    u32 lane = i + random () % clib_min (8, f->n - i);
+	    f->mask[lane / 64] |= 1ULL << (lane % 64);
+	  }
+      for (i = 0; i < ARRAY_LEN (f->mask); i++)
+	f->n_valid += count_set_bits (f->mask[i]);
+      offset += f->n;
+    }
+  return frames;
+}
+
+/* keys found by variant over the frames, their kvps to out at their place */
+static u64
+masked_batch_run (BVT (clib_bihash) * h, masked_batch_variant_t variant,
+		  masked_batch_frame_t * frames, BVT (clib_bihash_kv) * kvs,
+		  BVT (clib_bihash_kv) * out)
+{
+  BVT (clib_bihash_kv) packed[BIHASH_BATCH_N_MAX], *kv, *o;
+  masked_batch_frame_t *f;
+  u64 hits = 0, hit_bitmap[BIHASH_BATCH_N_MAX / 64], m;
+  u32 idx[BIHASH_BATCH_N_MAX], i, j, g, n_packed;
+  u8 valid_key_idx, b;
+
+  vec_foreach (f, frames)
+  {
+    kv = kvs + f->offset;
+    o = out + f->offset;
+
+    if (variant == MASKED_BATCH_N)
+      {
+	hits += BV (clib_bihash_search_batch_n) (h, kv, f->n, f->mask, o,
+						 hit_bitmap);
+	continue;
+      }
+
+    /* the valid keys, in frame order */
+    n_packed = 0;
+    for (j = 0; j < ARRAY_LEN (f->mask); j++)
+      for (m = f->mask[j]; m; m &= m - 1)
+	{
+	  i = j * 64 + count_trailing_zeros (m);
+	  if (variant == MASKED_BATCH_V0)
+	    hits += BV (clib_bihash_search) (h, &kv[i], &o[i]) == 0;
+	  else
+	    {
+	      packed[n_packed] = kv[i];
+	      idx[n_packed++] = i;
+	    }
+	}
+    if (variant == MASKED_BATCH_V0)
+      continue;
+
+    for (g = 0; g < n_packed; g += 8)
+      {
+	if (n_packed - g < 8 && variant == MASKED_BATCH_V4_SCALAR_TAIL)
+	  {
+	    for (i = g; i < n_packed; i++)
+	      hits += BV (clib_bihash_search) (h, &packed[i], &o[idx[i]]) == 0;
+	    break;
+	  }
+	if (variant == MASKED_BATCH_V5)
+	  BV (clib_bihash_search_batch_v5) (h, packed + g,
+					    pow2_mask (clib_min (n_packed - g, 8)),
+					    packed + g, &valid_key_idx);
+	else
+	  BV (clib_bihash_search_batch_v4) (h, packed + g,
+					    pow2_mask (clib_min (n_packed - g, 8)),
+					    packed + g, &valid_key_idx);
+	for (b = valid_key_idx; b; b &= b - 1)
+	  {
+	    i = count_trailing_zeros (b);
+	    o[idx[g + i]] = packed[g + i];
+	  }
+	hits += count_set_bits (valid_key_idx);
+      }
+  }
+  return hits;
+}
+
+/* 0: out0 and out1 hold the same kvps at the valid keys of the frames */
+static int
+masked_batch_diff (masked_batch_frame_t * frames, BVT (clib_bihash_kv) * out0,
+		   BVT (clib_bihash_kv) * out1)
+{
+  masked_batch_frame_t *f;
+  u64 m;
+  u32 i, j;
+
+  vec_foreach (f, frames)
+    for (j = 0; j < ARRAY_LEN (f->mask); j++)
+      for (m = f->mask[j]; m; m &= m - 1)
+	{
+	  i = f->offset + j * 64 + count_trailing_zeros (m);
+	  if (out0[i].key != out1[i].key || out0[i].value != out1[i].value)
+	    return 1;
+	}
+  return 0;
+}
+
+static int
+masked_batch_kv_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  BVT (clib_bihash_kv) ** kvs = arg;
+  vec_add1 (*kvs, kv[0]);
+  return BIHASH_WALK_CONTINUE;
+}
+
+void
+masked_batch_perf_test (bihash_profiler_main_t * bpm)
+{
+  BVT (clib_bihash) * h = bpm->h;
+  BVT (clib_bihash_kv) * present = 0, *kvs = 0, *out[MASKED_BATCH_N_VARIANTS];
+  masked_batch_frame_t *frames;
+  masked_batch_pattern_t *pt;
+  masked_batch_variant_t variant;
+  u64 i, start, n_valid, hits[MASKED_BATCH_N_VARIANTS];
+  u64 cycles[MASKED_BATCH_N_VARIANTS];
+  u8 failed[MASKED_BATCH_N_VARIANTS];
+  int warm;
+#if BIHASH_PROBE_STATS
+  bihash_probe_t probes[MASKED_BATCH_N_VARIANTS];
+
+  clib_memset (probes, 0, sizeof (probes));
+#endif
+
+  BV (clib_bihash_foreach_key_value_pair) (h, masked_batch_kv_cb, &present);
+  if (vec_len (present) == 0)
+    return;
+  for (i = 0; i < MASKED_BATCH_KEYS; i++)
+    vec_add1 (kvs, present[random () % vec_len (present)]);
+  for (variant = 0; variant < MASKED_BATCH_N_VARIANTS; variant++)
+    {
+      out[variant] = 0;
+      vec_validate (out[variant], MASKED_BATCH_KEYS - 1);
+    }
+  clib_memset (failed, 0, sizeof (failed));
+
+  fformat (stdout, "Masked batch:%d keys of the table in random order,frames of any size and valid mask,CPO per valid key\n"
+	   "frames |---| mean n |---| valid |", MASKED_BATCH_KEYS);
+  for (variant = 0; variant < MASKED_BATCH_N_VARIANTS; variant++)
+    fformat (stdout, "---| %s |", masked_batch_names[variant]);
+  fformat (stdout, "---|batch_n vs V4+V0 tail| \n");
+
+  for (pt = masked_batch_patterns;
+       pt < masked_batch_patterns + ARRAY_LEN (masked_batch_patterns); pt++)
+    {
+      frames = masked_batch_frames (pt, vec_len (kvs));
+      n_valid = 0;
+      for (i = 0; i < vec_len (frames); i++)
+	n_valid += frames[i].n_valid;
+
+      for (variant = 0; variant < MASKED_BATCH_N_VARIANTS; variant++)
+	{
+	  for (warm = 0; warm < 2; warm++)
+	    {
+	      clib_memset (out[variant], 0xff,
+			   vec_len (out[variant]) * sizeof (out[variant][0]));
+#if BIHASH_PROBE_STATS
+	      if (warm)
+		bihash_probe_start (&probes[variant]);
+#endif
+	      perf_timer_begin (start);
+	      hits[variant] = masked_batch_run (h, variant, frames, kvs,
+						out[variant]);
+	      perf_timer_end (start, cycles[variant]);
+#if BIHASH_PROBE_STATS
+	      bihash_probe_stop ();
+#endif
+	    }
+	  if (hits[variant] != n_valid ||
+	      masked_batch_diff (frames, out[MASKED_BATCH_V0], out[variant]))
+	    failed[variant] = 1;
+	}
+
+      fformat (stdout, "%s       %.1f       %.1f%%", pt->name,
+	       (f64) vec_len (kvs) / vec_len (frames),
+	       100.0 * n_valid / vec_len (kvs));
+      for (variant = 0; variant < MASKED_BATCH_N_VARIANTS; variant++)
+	fformat (stdout, "       %.2f", (f64) cycles[variant] / n_valid);
+      fformat (stdout, "       %.2f%% \n",
+	       100.0 * cycles[MASKED_BATCH_V4_SCALAR_TAIL] /
+	       cycles[MASKED_BATCH_N]);
+      vec_free (frames);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  for (variant = 1; variant < MASKED_BATCH_N_VARIANTS; variant++)
+    fformat (stdout, "%s|-> MATCH <-|%s ---[%s]\n",
+	     masked_batch_names[MASKED_BATCH_V0], masked_batch_names[variant],
+	     failed[variant] ? "FAILED" : "PASS");
+
+#if BIHASH_PROBE_STATS
+  for (variant = 0; variant < MASKED_BATCH_N_VARIANTS; variant++)
+    fformat (stdout, "%U", format_bihash_probe, &probes[variant],
+	     masked_batch_names[variant]);
+#endif
+
+  for (variant = 0; variant < MASKED_BATCH_N_VARIANTS; variant++)
+    vec_free (out[variant]);
+  vec_free (present);
+  vec_free (kvs);
+}
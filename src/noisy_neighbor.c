@@ -0,0 +1,350 @@
+/*
+ * Noisy neighbour mode: V0/V4/V5 CPO with interference threads running
+ * on other CPUs, against the same run on a quiet machine. Included by
+ * bihash_application.c, after cache_sweep.c.
+ *
+ * The lookup thread is pinned to the CPU it runs on. "noisy <cpus>" puts
+ * one hog thread on each of
+ *   sibling   the SMT siblings of the lookup CPU
+ *   socket    the other cores of its package, without the siblings
+ *   <list>    any CPUs, "2,4-7", the lookup CPU too (time sliced)
+ * and each hog type runs in turn:
+ *   stream    reads and writes a buffer far larger than the LLC:
+ *             memory bandwidth
+ *   llc       random stores over an LLC sized buffer: evicts the table
+ *   chase     a pointer chase over twice the LLC: one miss at a time,
+ *             the latency bound neighbour
+ * Hog buffers are capped at NOISY_MAX_BUFFER and shared by the hogs of a
+ * type, each hog starting at its own offset.
+ */
+
+#define NOISY_MAX_BUFFER (256ULL << 20)
+#define NOISY_LOOKUPS    (1 << 20)
+#define NOISY_WARMUP_MS  20
+
+/* _(hog, name, rate unit) */
+#define foreach_noisy_hog                                               \
+  _(NONE, "none", "")                                                   \
+  _(STREAM, "stream", "GB/s")                                           \
+  _(LLC, "llc", "M lines/s")                                            \
+  _(CHASE, "chase", "ns/hop")
+
+typedef enum
+{
+#define _(h, n, u) NOISY_HOG_##h,
+  foreach_noisy_hog
+#undef _
+  NOISY_N_HOGS,
+} noisy_hog_t;
+
+static char *noisy_hog_names[] = {
+#define _(h, n, u) [NOISY_HOG_##h] = n,
+  foreach_noisy_hog
+#undef _
+};
+
+static char *noisy_hog_units[] = {
+#define _(h, n, u) [NOISY_HOG_##h] = u,
+  foreach_noisy_hog
+#undef _
+};
+
+static char *noisy_kernels[] = { "V0", "V4", "V5" };
+
+typedef struct
+{
+  pthread_t thread;
+  u32 index;
+  u32 cpu;
+  noisy_hog_t hog;
+  volatile u32 *stop;
+
+  /* buffer of the hog type, and this hog's part of the work */
+  u64 *buf;
+  uword n_words;
+
+  /* results */
+  u64 start, end;
+  u64 work;			/* bytes, lines or hops */
+} noisy_worker_t;
+
+static void *
+noisy_worker_fn (void *arg)
+{
+  noisy_worker_t *w = arg;
+  u64 *buf = w->buf, n = w->n_words, i, j, x, work = 0;
+  cpu_set_t cpuset;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (w->cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+
+  w->start = timer_begin ();
+  x = 0x9e3779b97f4a7c15ULL * (w->index + 1);
+  i = (n / (w->index + 2)) & ~7ULL;
+  while (!*w->stop)
+    switch (w->hog)
+      {
+      case NOISY_HOG_STREAM:
+	/* one line read, one line written */
+	for (j = 0; j < 8; j++)
+	  buf[(i + n / 2 + j) % n] = buf[i + j] + 1;
+	i = (i + 8) % (n & ~7ULL);
+	work += 2 * CLIB_CACHE_LINE_BYTES;
+	break;
+      case NOISY_HOG_LLC:
+	/* xorshift over the lines of the buffer */
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	buf[(x % (n / 8)) * 8] += 1;
+	work++;
+	break;
+      case NOISY_HOG_CHASE:
+	i = buf[i];
+	work++;
+	break;
+      default:
+	*w->stop = 1;
+	break;
+      }
+  w->end = timer_end ();
+  w->work = work;
+  /* keeps the chase from being optimized away */
+  return (void *) (uword) i;
+}
+
+/* a random cycle through the lines of buf, one u64 per line */
+static void
+noisy_chase_init (u64 * buf, uword n_words)
+{
+  u64 n_lines = n_words / 8, *order = 0, i, j, t;
+
+  for (i = 0; i < n_lines; i++)
+    vec_add1 (order, i * 8);
+  for (i = n_lines - 1; i > 0; i--)
+    {
+      j = random () % (i + 1);
+      t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+  for (i = 0; i < n_lines; i++)
+    buf[order[i]] = order[(i + 1) % n_lines];
+  vec_free (order);
+}
+
+/* CPUs of a sysfs cpu list, "0-3,8" */
+static u32 *
+noisy_parse_cpu_list (char *s, u32 * cpus)
+{
+  u32 first, last;
+  char *end;
+
+  while (*s)
+    {
+      first = last = strtoul (s, &end, 10);
+      if (end == s)
+	break;
+      s = end;
+      if (*s == '-')
+	{
+	  last = strtoul (s + 1, &end, 10);
+	  s = end;
+	}
+      for (; first <= last; first++)
+	vec_add1 (cpus, first);
+      if (*s == ',')
+	s++;
+      else
+	break;
+    }
+  return cpus;
+}
+
+static u32 *
+noisy_sysfs_cpu_list (u32 cpu, char *file)
+{
+  char path[128], buf[256];
+  u32 *cpus = 0;
+
+  snprintf (path, sizeof (path),
+	    "/sys/devices/system/cpu/cpu%u/topology/%s", cpu, file);
+  if (cache_sweep_read_sysfs (path, buf, sizeof (buf)))
+    cpus = noisy_parse_cpu_list (buf, 0);
+  return cpus;
+}
+
+always_inline int
+noisy_cpu_in (u32 * cpus, u32 cpu)
+{
+  u32 *c;
+
+  vec_foreach (c, cpus)
+    if (*c == cpu)
+      return 1;
+  return 0;
+}
+
+/* hog CPUs for "noisy <spec>", lookup_cpu left out of sibling/socket */
+static u32 *
+noisy_hog_cpus (char *spec, u32 lookup_cpu)
+{
+  u32 *siblings = noisy_sysfs_cpu_list (lookup_cpu, "thread_siblings_list");
+  u32 *candidates, *cpus = 0, *c;
+  int is_socket = !strcmp (spec, "socket");
+
+  if (!strcmp (spec, "sibling"))
+    candidates = vec_dup (siblings);
+  else if (is_socket)
+    candidates = noisy_sysfs_cpu_list (lookup_cpu, "core_siblings_list");
+  else
+    {
+      vec_free (siblings);
+      return noisy_parse_cpu_list (spec, 0);
+    }
+
+  vec_foreach (c, candidates)
+  {
+    if (*c == lookup_cpu || (is_socket && noisy_cpu_in (siblings, *c)))
+      continue;
+    vec_add1 (cpus, *c);
+  }
+  vec_free (siblings);
+  vec_free (candidates);
+  return cpus;
+}
+
+void
+noisy_neighbor_perf_test (bihash_profiler_main_t * bpm,
+			  f64 cycles_per_second)
+{
+  char *spec = (char *) bpm->noisy_cpus;
+  noisy_worker_t *workers = 0, *w;
+  cache_sweep_caches_t caches;
+  cpu_set_t saved_cpuset, cpuset;
+  search_kernel_t *k;
+  volatile u32 stop;
+  u64 *present, *lookups = 0, *buf[NOISY_N_HOGS] = { 0 }, hits, i;
+  u64 llc, cycles[NOISY_N_HOGS][ARRAY_LEN (noisy_kernels)], work, ticks;
+  uword n_words[NOISY_N_HOGS] = { 0 };
+  u32 lookup_cpu = sched_getcpu (), *cpus, j;
+  noisy_hog_t hog;
+  f64 rate;
+
+  cpus = noisy_hog_cpus (spec, lookup_cpu);
+  if (vec_len (cpus) == 0)
+    {
+      fformat (stdout, "Noisy neighbour:no CPU for '%s' next to cpu %d, skipped\n",
+	       spec, lookup_cpu);
+      return;
+    }
+  present = search_kernel_table_keys (bpm);
+  if (vec_len (present) == 0)
+    goto done;
+  for (i = 0; i < NOISY_LOOKUPS; i++)
+    vec_add1 (lookups, present[random () % vec_len (present)]);
+
+  cache_sweep_caches_get (&caches);
+  llc = caches.last_level ? caches.bytes[caches.last_level] : 32ULL << 20;
+  n_words[NOISY_HOG_STREAM] = clib_min (8 * llc, NOISY_MAX_BUFFER) / 8;
+  n_words[NOISY_HOG_LLC] = clib_min (llc, NOISY_MAX_BUFFER) / 8;
+  n_words[NOISY_HOG_CHASE] = clib_min (2 * llc, NOISY_MAX_BUFFER) / 8;
+  for (hog = NOISY_HOG_STREAM; hog < NOISY_N_HOGS; hog++)
+    {
+      buf[hog] = clib_mem_alloc_aligned (n_words[hog] * 8,
+					 CLIB_CACHE_LINE_BYTES);
+      clib_memset (buf[hog], 0, n_words[hog] * 8);
+    }
+  noisy_chase_init (buf[NOISY_HOG_CHASE], n_words[NOISY_HOG_CHASE]);
+
+  /* the lookups stay on this CPU, next to the hogs */
+  pthread_getaffinity_np (pthread_self (), sizeof (saved_cpuset),
+			  &saved_cpuset);
+  CPU_ZERO (&cpuset);
+  CPU_SET (lookup_cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+
+  fformat (stdout, "Noisy neighbour:lookups on cpu %d,hogs on %d cpus (%s):",
+	   lookup_cpu, vec_len (cpus), spec);
+  for (j = 0; j < vec_len (cpus); j++)
+    fformat (stdout, " %d", cpus[j]);
+  fformat (stdout, ",LLC %ld KB,%d random lookups of present keys\n"
+	   "hog  |---| V0 CPO |---| V4 CPO |---| V5 CPO |---| V0 +%% |---| V4 +%% |---| V5 +%% |---| hog rate | \n",
+	   llc >> 10, NOISY_LOOKUPS);
+
+  vec_validate (workers, vec_len (cpus) - 1);
+  for (hog = 0; hog < NOISY_N_HOGS; hog++)
+    {
+      stop = 0;
+      if (hog != NOISY_HOG_NONE)
+	{
+	  vec_foreach (w, workers)
+	  {
+	    clib_memset (w, 0, sizeof (*w));
+	    w->index = w - workers;
+	    w->cpu = cpus[w->index];
+	    w->hog = hog;
+	    w->stop = &stop;
+	    w->buf = buf[hog];
+	    w->n_words = n_words[hog];
+	    pthread_create (&w->thread, 0, noisy_worker_fn, w);
+	  }
+	  /* let the hogs fill the caches first */
+	  usleep (NOISY_WARMUP_MS * 1000);
+	}
+
+      for (j = 0; j < ARRAY_LEN (noisy_kernels); j++)
+	{
+	  k = vec_elt_at_index (bpm->kernels, search_kernel_index_by_name
+				(bpm, noisy_kernels[j]));
+	  cycles[hog][j] = search_kernel_time_keys (bpm, k, lookups, &hits);
+	}
+
+      work = ticks = 0;
+      if (hog != NOISY_HOG_NONE)
+	{
+	  stop = 1;
+	  vec_foreach (w, workers)
+	  {
+	    pthread_join (w->thread, 0);
+	    work += w->work;
+	    ticks = clib_max (ticks, w->end - w->start);
+	  }
+	}
+
+      rate = 0;
+      if (ticks && work)
+	rate = hog == NOISY_HOG_STREAM ?
+	  work / ((f64) ticks / cycles_per_second) / 1e9 :
+	  hog == NOISY_HOG_LLC ?
+	  work / ((f64) ticks / cycles_per_second) / 1e6 :
+	  /* one chain per hog, ns per hop of one of them */
+	  (f64) ticks / cycles_per_second * 1e9 * vec_len (workers) / work;
+
+      fformat (stdout, "%s       %.2f       %.2f       %.2f       %.2f%%       %.2f%%       %.2f%%       ",
+	       noisy_hog_names[hog],
+	       (f64) cycles[hog][0] / NOISY_LOOKUPS,
+	       (f64) cycles[hog][1] / NOISY_LOOKUPS,
+	       (f64) cycles[hog][2] / NOISY_LOOKUPS,
+	       100.0 * cycles[hog][0] / cycles[0][0] - 100,
+	       100.0 * cycles[hog][1] / cycles[0][1] - 100,
+	       100.0 * cycles[hog][2] / cycles[0][2] - 100);
+      if (hog == NOISY_HOG_NONE)
+	fformat (stdout, "n/a \n");
+      else
+	fformat (stdout, "%.2f %s \n", rate, noisy_hog_units[hog]);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  pthread_setaffinity_np (pthread_self (), sizeof (saved_cpuset),
+			  &saved_cpuset);
+  for (hog = NOISY_HOG_STREAM; hog < NOISY_N_HOGS; hog++)
+    clib_mem_free (buf[hog]);
+
+done:
+  vec_free (workers);
+  vec_free (present);
+  vec_free (lookups);
+  vec_free (cpus);
+}
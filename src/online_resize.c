@@ -0,0 +1,307 @@
+/*
+ * Online resize mode: the profile's table copied into a resize_bihash_t
+ * (resize_bihash_8_8.h) and grown to twice its buckets while it is
+ * searched. Included by bihash_application.c.
+ *
+ * Lookups come in rounds over present keys in random order: a frame of
+ * ONLINE_RESIZE_FRAME keys through resize_bihash_search and one through
+ * resize_bihash_search_batch, each timed whole for CPO, then the
+ * ONLINE_RESIZE_SAMPLES keys after the frame, not searched yet in the
+ * round, timed one by one for the latency percentiles. Between rounds
+ * the main thread adds a key absent from the table, finds it and deletes
+ * it again.
+ *
+ * Before and after the growth rounds and adds/deletes alternate on the
+ * main thread. During it the rounds run concurrently on a reader thread
+ * (pinned to the last CPU) while the main thread, as VPP's does, adds and
+ * deletes and moves "resize <n>" buckets per step, each step timed; the
+ * reader is joined, the quiescent point, before resize_bihash_finish. On
+ * a single CPU the two threads only time-share. Every key must be found
+ * throughout, and the grown table must find what the profile's finds.
+ */
+
+#define ONLINE_RESIZE_DEFAULT_STEP 64
+#define ONLINE_RESIZE_FRAME 256
+#define ONLINE_RESIZE_SAMPLES 64
+#define ONLINE_RESIZE_ROUNDS 1024	/* before and after the growth */
+#define ONLINE_RESIZE_MAX_SAMPLES (1 << 20)
+
+typedef struct
+{
+  u64 v0_cycles;
+  u64 v4_cycles;
+  u64 n_rounds;
+  u64 hits;
+  u32 *samples;			/* cycles of single lookups, preallocated */
+  u32 n_samples;
+  u32 *step_cycles;
+  int failed;
+} online_resize_phase_t;
+
+static char *online_resize_phases[] = { "before", "migrating", "after" };
+
+static void
+online_resize_round (resize_bihash_t * t, u64 * keys, u64 * cursor,
+		     online_resize_phase_t * ph)
+{
+  timer_calib_t *tc = &bihash_profiler_main.timer;
+  BVT (clib_bihash_kv) kv[8];
+  u64 *k = keys + *cursor, t0;
+  u8 valid_key_idx;
+  u32 i, j;
+
+  t0 = timer_begin ();
+  for (i = 0; i < ONLINE_RESIZE_FRAME; i++)
+    {
+      kv[0].key = k[i];
+      ph->hits += resize_bihash_search (t, kv, kv) == 0;
+    }
+  ph->v0_cycles += timer_cycles (tc, t0, timer_end ());
+
+  t0 = timer_begin ();
+  for (i = 0; i < ONLINE_RESIZE_FRAME; i += 8)
+    {
+      for (j = 0; j < 8; j++)
+	kv[j].key = k[i + j];
+      resize_bihash_search_batch (t, kv, 0xFF, kv, &valid_key_idx);
+      ph->hits += count_set_bits (valid_key_idx);
+    }
+  ph->v4_cycles += timer_cycles (tc, t0, timer_end ());
+
+  for (i = 0; i < ONLINE_RESIZE_SAMPLES; i++)
+    {
+      kv[0].key = k[ONLINE_RESIZE_FRAME + i];
+      t0 = timer_begin ();
+      ph->hits += resize_bihash_search (t, kv, kv) == 0;
+      t0 = timer_cycles (tc, t0, timer_end ());
+      /* the reader thread does not allocate */
+      if (ph->n_samples < vec_len (ph->samples))
+	ph->samples[ph->n_samples++] = t0;
+    }
+
+  ph->n_rounds++;
+  *cursor += ONLINE_RESIZE_FRAME;
+  if (*cursor + ONLINE_RESIZE_FRAME + ONLINE_RESIZE_SAMPLES > vec_len (keys))
+    *cursor = 0;
+}
+
+/*
+ * Main thread: add a key absent from the table, find it, delete it. Adds
+ * and deletes go to the table holding the key; the keys of the rounds are
+ * never touched, so a concurrent reader keeps finding all of them.
+ */
+static void
+online_resize_churn (resize_bihash_t * t, online_resize_phase_t * ph)
+{
+  BVT (clib_bihash_kv) kv, r;
+
+  kv.key = (1ULL << 63) | random ();
+  kv.value = kv.key;
+  if (resize_bihash_search (t, &kv, &r) == 0)
+    return;
+  if (resize_bihash_add_del (t, &kv, 1 /* is_add */ ) != 0 ||
+      resize_bihash_search (t, &kv, &r) != 0 || r.value != kv.value ||
+      resize_bihash_add_del (t, &kv, 0 /* is_add */ ) != 0 ||
+      resize_bihash_search (t, &kv, &r) == 0)
+    ph->failed = 1;
+}
+
+typedef struct
+{
+  pthread_t thread;
+  resize_bihash_t *t;
+  u64 *keys;
+  u64 cursor;
+  u32 cpu;
+  online_resize_phase_t *ph;
+  volatile u32 started;
+  volatile u32 stop;
+} online_resize_reader_t;
+
+/* rounds until stopped, at least one */
+static void *
+online_resize_reader_fn (void *arg)
+{
+  online_resize_reader_t *r = arg;
+  cpu_set_t cpuset;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (r->cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+
+  __atomic_store_n (&r->started, 1, __ATOMIC_RELEASE);
+  do
+    online_resize_round (r->t, r->keys, &r->cursor, r->ph);
+  while (!__atomic_load_n (&r->stop, __ATOMIC_ACQUIRE));
+  return 0;
+}
+
+static void
+online_resize_buckets (BVT (clib_bihash) * h, u64 * n_active, u64 * n_linear)
+{
+  BVT (clib_bihash_bucket) * b;
+  u64 i;
+
+  *n_active = *n_linear = 0;
+  for (i = 0; i < h->nbuckets; i++)
+    {
+      b = BV (clib_bihash_get_bucket) (h, i);
+      if (BV (clib_bihash_bucket_is_empty) (b))
+	continue;
+      (*n_active)++;
+      *n_linear += b->linear_search;
+    }
+}
+
+static void
+online_resize_report (online_resize_phase_t * ph, int phase,
+		      BVT (clib_bihash) * h)
+{
+  u64 n_lookups = ph->n_rounds * ONLINE_RESIZE_FRAME, n_active, n_linear;
+  u32 *s = 0;
+
+  vec_add (s, ph->samples, ph->n_samples);
+  ph->failed |= ph->hits != ph->n_rounds * (2 * ONLINE_RESIZE_FRAME +
+					    ONLINE_RESIZE_SAMPLES);
+  vec_sort_with_function (s, profiler_u32_cmp);
+  fformat (stdout, "%s", online_resize_phases[phase]);
+  if (h)
+    {
+      online_resize_buckets (h, &n_active, &n_linear);
+      fformat (stdout, "       %d       %.2f%%       %ld", h->nbuckets,
+	       100.0 * n_active / h->nbuckets, n_linear);
+    }
+  else
+    fformat (stdout, "       n/a       n/a       n/a");
+  fformat (stdout, "       %.2f       %.2f       %d       %d       %d       %d \n",
+	   (f64) ph->v0_cycles / n_lookups, (f64) ph->v4_cycles / n_lookups,
+	   profiler_pct (s, 50), profiler_pct (s, 99),
+	   profiler_pct (s, 99.9), vec_elt (s, vec_len (s) - 1));
+  vec_free (s);
+}
+
+/* 0: t finds what h finds, on present keys and key + 1 */
+static int
+online_resize_check (BVT (clib_bihash) * h, resize_bihash_t * t, u64 * keys)
+{
+  BVT (clib_bihash_kv) kv, r0, r1;
+  u64 *key;
+  int rv0, rv1, d;
+
+  vec_foreach (key, keys)
+    for (d = 0; d < 2; d++)
+      {
+	kv.key = key[0] + d;
+	rv0 = BV (clib_bihash_search) (h, &kv, &r0);
+	rv1 = resize_bihash_search (t, &kv, &r1);
+	if (rv0 != rv1 || (rv0 == 0 && (r0.key != r1.key ||
+					r0.value != r1.value)))
+	  return 1;
+      }
+  return 0;
+}
+
+void
+online_resize_perf_test (bihash_profiler_main_t * bpm, int profile_id)
+{
+  BVT (clib_bihash) * h;
+  resize_bihash_t _t, *t = &_t;
+  online_resize_phase_t phases[3], *ph;
+  online_resize_reader_t _r, *r = &_r;
+  u32 step = bpm->resize_step ? bpm->resize_step :
+    ONLINE_RESIZE_DEFAULT_STEP, nbuckets, *sc;
+  u64 *present, *keys, cursor = 0, i, t0, step_total = 0;
+  int phase, done, failed = 0;
+
+  present = search_kernel_table_keys (bpm);
+  if (vec_len (present) < ONLINE_RESIZE_FRAME + ONLINE_RESIZE_SAMPLES)
+    {
+      vec_free (present);
+      return;
+    }
+  keys = profiler_shuffle (present);
+
+  /* a copy of the profile's table, which the other modes keep using */
+  h = clib_mem_alloc_aligned (sizeof (*h), CLIB_CACHE_LINE_BYTES);
+  BV (clib_bihash_init) (h, "resize", bpm->h->nbuckets, bpm->h->memory_size);
+  BV (clib_bihash_foreach_key_value_pair) (bpm->h, profiler_copy_kv_cb, h);
+  resize_bihash_init (t, h);
+  nbuckets = h->nbuckets * 2;
+  clib_memset (phases, 0, sizeof (phases));
+  vec_validate (phases[0].samples,
+		ONLINE_RESIZE_ROUNDS * ONLINE_RESIZE_SAMPLES - 1);
+  vec_validate (phases[1].samples, ONLINE_RESIZE_MAX_SAMPLES - 1);
+  vec_validate (phases[2].samples,
+		ONLINE_RESIZE_ROUNDS * ONLINE_RESIZE_SAMPLES - 1);
+
+  fformat (stdout, "Online resize:profile_id[%d],%ld keys,%d -> %d buckets,%d buckets moved per step,rounds of %d V0 + %d V4 lookups and %d lookups timed one by one,on a reader thread while migrating\n"
+	   "phase |---| buckets |---| usage |---| linear |---| V0 CPO |---| V4 CPO |---| p50 |---| p99 |---| p99.9 |---| max | \n",
+	   profile_id, vec_len (present), h->nbuckets, nbuckets, step,
+	   ONLINE_RESIZE_FRAME, ONLINE_RESIZE_FRAME, ONLINE_RESIZE_SAMPLES);
+
+  for (i = 0; i < ONLINE_RESIZE_ROUNDS; i++)
+    {
+      online_resize_round (t, keys, &cursor, &phases[0]);
+      online_resize_churn (t, &phases[0]);
+    }
+  online_resize_report (&phases[0], 0, t->h);
+
+  resize_bihash_start (t, nbuckets);
+  ph = &phases[1];
+  clib_memset (r, 0, sizeof (*r));
+  r->t = t;
+  r->keys = keys;
+  r->cursor = cursor;
+  r->cpu = clib_max (get_nprocs (), 1) - 1;
+  r->ph = ph;
+  pthread_create (&r->thread, 0, online_resize_reader_fn, r);
+  /* no step before the reader is in */
+  while (!__atomic_load_n (&r->started, __ATOMIC_ACQUIRE))
+    sched_yield ();
+  do
+    {
+      online_resize_churn (t, ph);
+      t0 = timer_begin ();
+      done = resize_bihash_step (t, step);
+      vec_add1 (ph->step_cycles, timer_cycles (&bpm->timer, t0, timer_end ()));
+    }
+  while (!done);
+  /* the quiescent point: once joined no lookup is left in the old table */
+  __atomic_store_n (&r->stop, 1, __ATOMIC_RELEASE);
+  pthread_join (r->thread, 0);
+  cursor = r->cursor;
+  resize_bihash_finish (t);
+  online_resize_report (ph, 1, 0);
+
+  for (i = 0; i < ONLINE_RESIZE_ROUNDS; i++)
+    {
+      online_resize_round (t, keys, &cursor, &phases[2]);
+      online_resize_churn (t, &phases[2]);
+    }
+  online_resize_report (&phases[2], 2, t->h);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  vec_foreach (sc, ph->step_cycles)
+    step_total += sc[0];
+  vec_sort_with_function (ph->step_cycles, profiler_u32_cmp);
+  fformat (stdout, "Migration:%ld steps,%.2f cycles per bucket moved,step p50 %d p99 %d max %d cycles\n",
+	   vec_len (ph->step_cycles), (f64) step_total / (nbuckets / 2),
+	   profiler_pct (ph->step_cycles, 50),
+	   profiler_pct (ph->step_cycles, 99),
+	   vec_elt (ph->step_cycles, vec_len (ph->step_cycles) - 1));
+
+  for (phase = 0; phase < ARRAY_LEN (phases); phase++)
+    failed |= phases[phase].failed;
+  failed |= online_resize_check (bpm->h, t, present);
+  fformat (stdout, "clib_bihash_search|-> MATCH <-|resize_bihash_search ---[%s]\n",
+	   failed ? "FAILED" : "PASS");
+
+  for (phase = 0; phase < ARRAY_LEN (phases); phase++)
+    {
+      vec_free (phases[phase].samples);
+      vec_free (phases[phase].step_cycles);
+    }
+  resize_bihash_free (t);
+  vec_free (present);
+  vec_free (keys);
+}
@@ -0,0 +1,237 @@
+/*
+ * Parallel build mode: the profile's table built again by N threads, timed
+ * against the serial category_*_init loops of init_hash_table, run here
+ * again without any of its hooks (insert timing, bloom, direct index).
+ * Included by bihash_application.c.
+ *
+ *   keys:      init_hash_table collects the profile's kvs instead of
+ *              inserting them (init_hash_table_kvs), same order and seed
+ *   partition: kvs split by bucket range, thread i inserts the kvs of
+ *              buckets [i * nbuckets / N, (i + 1) * nbuckets / N), so no
+ *              two threads ever take the same bucket lock, and a key
+ *              inserted twice is still inserted twice in the same order
+ *   prefault:  one arena chunk for the whole table, zeroed by the N
+ *              threads, so the page faults are taken in parallel
+ *   insert:    N threads, clib_bihash_add_del
+ *
+ * The result is checked against the serial table, kv by kv both ways.
+ */
+
+typedef struct
+{
+  pthread_t thread;
+  u32 index;
+  u32 cpu;
+  BVT (clib_bihash) * h;
+
+  /* prefault: bytes to zero; insert: kvs to add */
+  u8 *base;
+  uword n_bytes;
+  BVT (clib_bihash_kv) * kvs;
+} parallel_build_worker_t;
+
+static void
+parallel_build_worker_init (parallel_build_worker_t * w)
+{
+  cpu_set_t cpuset;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (w->cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+
+  /* own bihash working copy and heap slot, thread 0 is perf_cmp_body */
+  __os_thread_index = w->index + 1;
+  clib_mem_set_heap (w->h->heap);
+}
+
+static void *
+parallel_build_prefault_fn (void *arg)
+{
+  parallel_build_worker_t *w = arg;
+
+  parallel_build_worker_init (w);
+  clib_memset (w->base, 0, w->n_bytes);
+  return 0;
+}
+
+static void *
+parallel_build_insert_fn (void *arg)
+{
+  parallel_build_worker_t *w = arg;
+  BVT (clib_bihash_kv) * kv;
+
+  parallel_build_worker_init (w);
+  vec_foreach (kv, w->kvs)
+    BV (clib_bihash_add_del) (w->h, kv, 1 /* is_add */ );
+  return 0;
+}
+
+static void
+parallel_build_run (parallel_build_worker_t * workers, void *(*fn) (void *))
+{
+  parallel_build_worker_t *w;
+
+  vec_foreach (w, workers)
+    pthread_create (&w->thread, 0, fn, w);
+  vec_foreach (w, workers)
+    pthread_join (w->thread, 0);
+}
+
+/*
+ * Give h one arena chunk of n_bytes, zeroed across the workers. The
+ * bihash carves its kvp pages (and, when instantiated lazily, its
+ * buckets) out of the newest chunk until it runs out.
+ */
+static void
+parallel_build_prefault (parallel_build_worker_t * workers,
+			 BVT (clib_bihash) * h, uword n_bytes)
+{
+  BVT (clib_bihash_alloc_chunk) * c;
+  parallel_build_worker_t *w;
+  uword share;
+  void *oldheap;
+
+  n_bytes = round_pow2 (n_bytes, CLIB_CACHE_LINE_BYTES);
+  oldheap = clib_mem_set_heap (h->heap);
+  c = clib_mem_alloc_aligned (sizeof (*c) + n_bytes, CLIB_CACHE_LINE_BYTES);
+  clib_mem_set_heap (oldheap);
+
+  share = round_pow2 (n_bytes / vec_len (workers) + 1, 4096);
+  vec_foreach (w, workers)
+  {
+    w->base = (u8 *) (c + 1) + clib_min (n_bytes, w->index * share);
+    w->n_bytes = clib_min (n_bytes, (w->index + 1) * share) -
+      (w->base - (u8 *) (c + 1));
+  }
+  parallel_build_run (workers, parallel_build_prefault_fn);
+
+  c->size = n_bytes;
+  c->next_alloc = (u8 *) (c + 1);
+  c->bytes_left = n_bytes;
+  c->prev = 0;
+  c->next = h->chunks;
+  if (h->chunks)
+    h->chunks->prev = c;
+  h->chunks = c;
+}
+
+typedef struct
+{
+  BVT (clib_bihash) * other;
+  u64 n_keys;
+  u64 n_diff;
+} parallel_build_cmp_t;
+
+static int
+parallel_build_cmp_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  parallel_build_cmp_t *cmp = arg;
+  BVT (clib_bihash_kv) result;
+
+  cmp->n_keys++;
+  if (BV (clib_bihash_search) (cmp->other, kv, &result) < 0 ||
+      result.value != kv->value)
+    cmp->n_diff++;
+  return BIHASH_WALK_CONTINUE;
+}
+
+/* kvs of a not in b, or with another value in b */
+static u64
+parallel_build_cmp (BVT (clib_bihash) * a, BVT (clib_bihash) * b,
+		    u64 * n_keys)
+{
+  parallel_build_cmp_t cmp = {.other = b };
+
+  BV (clib_bihash_foreach_key_value_pair) (a, parallel_build_cmp_cb, &cmp);
+  *n_keys = cmp.n_keys;
+  return cmp.n_diff;
+}
+
+/* wall time of a plain serial init_hash_table of the profile */
+static f64
+parallel_build_serial (int profile_id, u32 seed)
+{
+  BVT (clib_bihash) _h, *h = &_h;
+  f64 t;
+
+  clib_memset (h, 0, sizeof (*h));
+  t = unix_time_now ();
+  srandom (seed);
+  init_hash_table (g_p_table, profile_id, h, 0);
+  t = unix_time_now () - t;
+  BV (clib_bihash_free) (h);
+  return t;
+}
+
+/* seed: the srandom seed init_hash_table built bpm->h with */
+void
+parallel_build_perf_test (bihash_profiler_main_t * bpm, int profile_id,
+			  u32 seed)
+{
+  BVT (clib_bihash) _h, *h = &_h;
+  BVT (clib_bihash_kv) * kvs = 0, *kv;
+  parallel_build_worker_t *workers = 0, *w;
+  u32 n = bpm->build_threads, n_cpus = clib_max (get_nprocs (), 1);
+  u64 n_keys, n_serial_keys, n_diff;
+  uword prefault_bytes;
+  f64 serial_seconds, t[5];
+
+  serial_seconds = parallel_build_serial (profile_id, seed);
+
+  clib_memset (h, 0, sizeof (*h));
+  t[0] = unix_time_now ();
+  srandom (seed);
+  init_hash_table_kvs = &kvs;
+  init_hash_table (g_p_table, profile_id, h, 0);
+  init_hash_table_kvs = 0;
+  t[1] = unix_time_now ();
+
+  vec_validate (workers, n - 1);
+  vec_foreach (w, workers)
+  {
+    w->index = w - workers;
+    w->cpu = w->index % n_cpus;
+    w->h = h;
+  }
+  vec_foreach (kv, kvs)
+    vec_add1 (workers[((u64) (BV (clib_bihash_hash) (kv) &
+			      (h->nbuckets - 1)) * n) / h->nbuckets].kvs,
+	      kv[0]);
+  /* split buckets, never shared between threads; see bihash_template.c */
+  vec_validate (h->working_copies, n);
+  vec_validate_init_empty (h->working_copy_lengths, n, ~0);
+  t[2] = unix_time_now ();
+
+  /* upper bound: every bucket, and one kvp page per key */
+  prefault_bytes = (uword) h->nbuckets * sizeof (BVT (clib_bihash_bucket)) +
+    vec_len (kvs) * sizeof (BVT (clib_bihash_value));
+  parallel_build_prefault (workers, h, prefault_bytes);
+  t[3] = unix_time_now ();
+
+  parallel_build_run (workers, parallel_build_insert_fn);
+  t[4] = unix_time_now ();
+
+  n_diff = parallel_build_cmp (h, bpm->h, &n_keys) +
+    parallel_build_cmp (bpm->h, h, &n_serial_keys);
+
+  fformat (stdout, "Parallel build:profile_id[%d],%ld kvs,%d threads on %d cpus,keys partitioned by bucket range\n"
+	   "build    |---| Wall ms |---| Speedup | \n"
+	   "serial       %.2f       100.00%% \n"
+	   "parallel       %.2f       %.2f%% \n"
+	   "    keys %.2f ms, partition %.2f ms, prefault %.2f ms (%.2f MB), insert %.2f ms\n",
+	   profile_id, vec_len (kvs), n, n_cpus,
+	   serial_seconds * 1e3, (t[4] - t[0]) * 1e3,
+	   100.0 * serial_seconds / (t[4] - t[0]),
+	   (t[1] - t[0]) * 1e3, (t[2] - t[1]) * 1e3, (t[3] - t[2]) * 1e3,
+	   (f64) prefault_bytes / (1 << 20), (t[4] - t[3]) * 1e3);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+  fformat (stdout, "parallel build,%ld keys|-> MATCH <-|serial build,%ld keys ---[%s]\n",
+	   n_keys, n_serial_keys,
+	   n_diff == 0 && n_keys == n_serial_keys ? "PASS" : "FAILED");
+
+  vec_foreach (w, workers)
+    vec_free (w->kvs);
+  vec_free (workers);
+  vec_free (kvs);
+  BV (clib_bihash_free) (h);
+}
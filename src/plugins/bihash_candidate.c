@@ -0,0 +1,105 @@
+/*
+ * Example search kernel plugin: the stock bihash_8_8 lookups, built
+ * against the VPP tree given by CANDIDATE_VPP_PATH.
+ *
+ * Point CANDIDATE_VPP_PATH at a tree carrying a bihash patch and run
+ *   ./bin/bihash_application.icl <profile> 255 255 plugin ./bin/bihash_candidate.so
+ * to time and cross-check the patched lookups against the builtin ones.
+ */
+#include <vppinfra/bihash_8_8.h>
+#include <vppinfra/bihash_template.h>
+#include <vppinfra/bihash_template.c>
+
+#include "../search_kernel_plugin.h"
+
+static void *
+candidate_table_create (uint64_t n_keys, uint32_t nbuckets)
+{
+  BVT (clib_bihash) * h = clib_mem_alloc (sizeof (*h));
+
+  clib_memset (h, 0, sizeof (*h));
+  BV (clib_bihash_init) (h, "bihash-candidate", nbuckets,
+			 clib_max (n_keys * 64, 32ULL << 20));
+  return h;
+}
+
+static int
+candidate_table_add (void *table, search_kernel_kv_8_8_t * kv)
+{
+  return BV (clib_bihash_add_del) (table, (BVT (clib_bihash_kv) *) kv, 1);
+}
+
+static void
+candidate_table_free (void *table)
+{
+  BV (clib_bihash_free) (table);
+  clib_mem_free (table);
+}
+
+static int
+candidate_search (void *table, search_kernel_kv_8_8_t * search_key,
+		  search_kernel_kv_8_8_t * valuep)
+{
+  return BV (clib_bihash_search) (table, (BVT (clib_bihash_kv) *) search_key,
+				  (BVT (clib_bihash_kv) *) valuep);
+}
+
+/* hash all keys and prefetch their buckets, then search */
+static int
+candidate_search_batch (void *table, search_kernel_kv_8_8_t * search_key,
+			uint8_t key_mask, search_kernel_kv_8_8_t * valuep,
+			uint8_t * valid_key_idx)
+{
+  BVT (clib_bihash) * h = table;
+  BVT (clib_bihash_kv) * kv = (BVT (clib_bihash_kv) *) search_key;
+  u64 hash[8];
+  u32 i, n_keys = count_set_bits (key_mask);
+  u8 bitmap = 0;
+  int ret = 0;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = BV (clib_bihash_hash) (&kv[i]);
+      BV (clib_bihash_prefetch_bucket) (h, hash[i]);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    {
+      if (BV (clib_bihash_search_inline_2_with_hash)
+	  (h, hash[i], &kv[i], (BVT (clib_bihash_kv) *) & valuep[i]) < 0)
+	continue;
+      bitmap |= 1 << i;
+      ret++;
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+static search_kernel_plugin_t candidate_kernels[] = {
+  {
+   .abi_version = SEARCH_KERNEL_PLUGIN_ABI_VERSION,
+   .name = "candidate-V0",
+   .batch_width = 1,
+   .table_create = candidate_table_create,
+   .table_add = candidate_table_add,
+   .table_free = candidate_table_free,
+   .search = candidate_search,
+   },
+  {
+   .abi_version = SEARCH_KERNEL_PLUGIN_ABI_VERSION,
+   .name = "candidate-batch",
+   .batch_width = 8,
+   .table_create = candidate_table_create,
+   .table_add = candidate_table_add,
+   .table_free = candidate_table_free,
+   .search_batch = candidate_search_batch,
+   },
+};
+
+search_kernel_plugin_t *
+search_kernel_plugin_register (uint32_t * n_kernels)
+{
+  *n_kernels = ARRAY_LEN (candidate_kernels);
+  return candidate_kernels;
+}
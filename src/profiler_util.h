@@ -0,0 +1,56 @@
+/*
+ * Helpers shared by the modes, so that no mode reaches into the private
+ * helpers of another and the include order of bihash_application.c does
+ * not matter to them. A template like bihash_template.h: included after
+ * it, for 8_8.
+ */
+#ifndef __included_profiler_util_h__
+#define __included_profiler_util_h__
+
+/* stride of the bucket array, the kvps at bucket level included */
+#define BIHASH_BUCKET_BYTES                                             \
+  (sizeof (BVT (clib_bihash_bucket)) + BIHASH_KVP_AT_BUCKET_LEVEL *     \
+   BIHASH_KVP_PER_PAGE * sizeof (BVT (clib_bihash_kv)))
+
+/* a copy of keys in random order */
+static u64 *
+profiler_shuffle (u64 * keys)
+{
+  u64 *s = vec_dup (keys), i, j, t;
+
+  for (i = vec_len (s) - 1; i > 0; i--)
+    {
+      j = random () % (i + 1);
+      t = s[i];
+      s[i] = s[j];
+      s[j] = t;
+    }
+  return s;
+}
+
+/* clib_bihash_foreach_key_value_pair callback: add kv to the bihash arg */
+static int
+profiler_copy_kv_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  BV (clib_bihash_add_del) (arg, kv, 1 /* is_add */ );
+  return BIHASH_WALK_CONTINUE;
+}
+
+/* vec_sort_with_function of u32 */
+static int
+profiler_u32_cmp (void *a1, void *a2)
+{
+  u32 *a = a1, *b = a2;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* pct percentile of sorted, a non empty vec sorted by profiler_u32_cmp */
+always_inline u32
+profiler_pct (u32 * sorted, f64 pct)
+{
+  return sorted[clib_min ((u64) (pct * vec_len (sorted) / 100),
+			  vec_len (sorted) - 1)];
+}
+
+#endif /* __included_profiler_util_h__ */
@@ -0,0 +1,183 @@
+/*
+ * Baseline store and regression check. Included by bihash_application.c.
+ *
+ * "record <file>" appends one line per timed kernel to a baseline file:
+ *   <profile_id>,<api>,<batch>,<linear|random>,<n>,<mean CPO>,<sd CPO>
+ * from the "repeat <n>" warm runs of the kernel. Later lines override
+ * earlier ones for the same cell, so a whole matrix can be recorded by
+ * one invocation per profile (see profiles/profile_regression.sh).
+ *
+ * "compare <file>" runs the same cells on this build and prints, per cell,
+ * the CPO delta and Welch's t. A cell regresses when it is slower by more
+ * than "threshold <pct>" (default REGRESSION_DEFAULT_THRESHOLD) and the
+ * difference is significant at 95%; perf_cmp_body then exits non-zero.
+ */
+
+#define REGRESSION_DEFAULT_REPEAT    5
+#define REGRESSION_DEFAULT_THRESHOLD 5.0
+
+typedef struct
+{
+  int profile_id;
+  char api[32];
+  u32 batch;
+  char keys[8];
+  u32 n;
+  f64 mean, sd;
+} regression_cell_t;
+
+/* two-sided 95% critical values of Student's t, df 1..30 */
+static f64 regression_t95[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static void
+regression_cell_of (regression_cell_t * c, search_kernel_t * k,
+		    int profile_id, int is_random)
+{
+  f64 *x, sum = 0, sum2 = 0;
+
+  clib_memset (c, 0, sizeof (*c));
+  c->profile_id = profile_id;
+  snprintf (c->api, sizeof (c->api), "%s", k->name);
+  c->batch = k->batch_width;
+  snprintf (c->keys, sizeof (c->keys), "%s", is_random ? "random" : "linear");
+  c->n = vec_len (k->cpo_samples);
+  vec_foreach (x, k->cpo_samples)
+  {
+    sum += x[0];
+    sum2 += x[0] * x[0];
+  }
+  if (c->n == 0)
+    return;
+  c->mean = sum / c->n;
+  c->sd = c->n > 1 ?
+    sqrt (clib_max ((sum2 - c->n * c->mean * c->mean) / (c->n - 1), 0)) : 0;
+}
+
+always_inline int
+regression_cell_match (regression_cell_t * a, regression_cell_t * b)
+{
+  return a->profile_id == b->profile_id && !strcmp (a->api, b->api) &&
+    a->batch == b->batch && !strcmp (a->keys, b->keys);
+}
+
+/* last line of the baseline for cell c, -1 if none */
+static int
+regression_baseline_find (char *path, regression_cell_t * c,
+			  regression_cell_t * base)
+{
+  regression_cell_t r;
+  char line[256];
+  int found = -1;
+  FILE *f;
+
+  if (!(f = fopen (path, "r")))
+    return -1;
+  while (fgets (line, sizeof (line), f))
+    {
+      if (line[0] == '#')
+	continue;
+      if (sscanf (line, "%d,%31[^,],%u,%7[^,],%u,%lf,%lf", &r.profile_id,
+		  r.api, &r.batch, r.keys, &r.n, &r.mean, &r.sd) != 7)
+	continue;
+      if (regression_cell_match (&r, c))
+	{
+	  *base = r;
+	  found = 0;
+	}
+    }
+  fclose (f);
+  return found;
+}
+
+void
+regression_record (bihash_profiler_main_t * bpm, int profile_id,
+		   int is_random)
+{
+  char *path = (char *) bpm->baseline_path;
+  regression_cell_t c;
+  u32 *ip;
+  FILE *f;
+  int is_new = access (path, F_OK) != 0;
+
+  if (!(f = fopen (path, "a")))
+    {
+      fformat (stderr, "record: cannot open %s\n", path);
+      return;
+    }
+  if (is_new)
+    fprintf (f, "# profile_id,api,batch,keys,n,mean_cpo,sd_cpo\n");
+  vec_foreach (ip, bpm->selected)
+  {
+    regression_cell_of (&c, vec_elt_at_index (bpm->kernels, ip[0]),
+			profile_id, is_random);
+    fprintf (f, "%d,%s,%u,%s,%u,%.4f,%.4f\n", c.profile_id, c.api, c.batch,
+	     c.keys, c.n, c.mean, c.sd);
+  }
+  fclose (f);
+  fformat (stdout, "Baseline:%d cells of profile_id[%d] recorded in %s\n",
+	   vec_len (bpm->selected), profile_id, path);
+}
+
+/* number of cells which regressed */
+int
+regression_compare (bihash_profiler_main_t * bpm, int profile_id,
+		    int is_random)
+{
+  regression_cell_t c, b = { 0 };
+  f64 threshold = bpm->regression_threshold > 0 ?
+    bpm->regression_threshold : REGRESSION_DEFAULT_THRESHOLD;
+  f64 delta, se2, t, df, t95;
+  int n_regressed = 0, significant;
+  char *verdict;
+  u32 *ip;
+
+  fformat (stdout, "Regression:profile_id[%d] against %s,threshold %.2f%%\n"
+	   "API  |---| batch |---| base CPO |---| CPO |---| delta |---| t |---| verdict | \n",
+	   profile_id, bpm->baseline_path, threshold);
+
+  vec_foreach (ip, bpm->selected)
+  {
+    regression_cell_of (&c, vec_elt_at_index (bpm->kernels, ip[0]),
+			profile_id, is_random);
+    if (regression_baseline_find ((char *) bpm->baseline_path, &c, &b) < 0 ||
+	b.mean == 0 || c.n == 0)
+      {
+	fformat (stdout, "%s       %d       n/a       %.2f       n/a       n/a       no baseline \n",
+		 c.api, c.batch, c.mean);
+	continue;
+      }
+
+    /* Welch's t, Welch-Satterthwaite degrees of freedom */
+    delta = 100.0 * (c.mean - b.mean) / b.mean;
+    se2 = (c.n ? c.sd * c.sd / c.n : 0) + (b.n ? b.sd * b.sd / b.n : 0);
+    t = se2 > 0 ? (c.mean - b.mean) / sqrt (se2) : 0;
+    df = c.n > 1 && b.n > 1 && se2 > 0 ?
+      se2 * se2 / (pow (c.sd * c.sd / c.n, 2) / (c.n - 1) +
+		   pow (b.sd * b.sd / b.n, 2) / (b.n - 1)) : 0;
+    t95 = df < 1 ? regression_t95[0] : df <= ARRAY_LEN (regression_t95) ?
+      regression_t95[(u32) df - 1] : 1.96;
+    /* without a spread on both sides only the threshold is left */
+    significant = se2 > 0 ? fabs (t) > t95 : 1;
+
+    if (delta > threshold && significant)
+      {
+	verdict = "REGRESSED";
+	n_regressed++;
+      }
+    else if (delta < -threshold && significant)
+      verdict = "improved";
+    else
+      verdict = "same";
+
+    fformat (stdout, "%s       %d       %.2f+-%.2f       %.2f+-%.2f       %.2f%%       %.2f       %s \n",
+	     c.api, c.batch, b.mean, b.sd, c.mean, c.sd, delta, t, verdict);
+  }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+  fformat (stdout, "regression check,%d cells regressed ---[%s]\n", n_regressed,
+	   n_regressed ? "FAILED" : "PASS");
+  return n_regressed;
+}
@@ -0,0 +1,187 @@
+/*
+ * Online resize of a bihash: the table grows into a bihash with more
+ * buckets a few buckets at a time, while lookups, adds and deletes go on
+ * against both.
+ *
+ * Both tables hash with clib_bihash_hash. Buckets of h below n_migrated
+ * have been copied to next: a key whose bucket in h is one of them is
+ * searched, added and deleted in next, any other in h. Kvps stay in the
+ * buckets of h they were copied from, so a lookup routed to h just before
+ * its bucket moves still finds them. resize_bihash_step copies the kvps
+ * of the next buckets into next, then publishes n_migrated (release; the
+ * lookups load it acquire). Steps and adds/deletes come from one thread,
+ * as the main thread does in VPP.
+ *
+ * Once every bucket has moved, resize_bihash_finish frees h and next
+ * becomes h. No lookup may still be in h then: call it after the readers
+ * have gone through a quiescent point (a worker barrier in VPP).
+ */
+#ifndef __included_resize_bihash_8_8_h__
+#define __included_resize_bihash_8_8_h__
+
+typedef struct
+{
+  BVT (clib_bihash) * h;
+  BVT (clib_bihash) * next;	/* growing into, 0: not resizing */
+  volatile u32 n_migrated;	/* buckets of h copied to next */
+} resize_bihash_t;
+
+/* t owns h, a clib_mem_alloc'ed and initialized bihash */
+static void
+resize_bihash_init (resize_bihash_t * t, BVT (clib_bihash) * h)
+{
+  clib_memset (t, 0, sizeof (*t));
+  t->h = h;
+}
+
+static void
+resize_bihash_free (resize_bihash_t * t)
+{
+  if (t->next)
+    {
+      BV (clib_bihash_free) (t->next);
+      clib_mem_free (t->next);
+    }
+  BV (clib_bihash_free) (t->h);
+  clib_mem_free (t->h);
+  clib_memset (t, 0, sizeof (*t));
+}
+
+/* the table holding the key of hash */
+always_inline BVT (clib_bihash) *
+resize_bihash_table (resize_bihash_t * t, u64 hash)
+{
+  BVT (clib_bihash) * next = t->next;
+
+  if (PREDICT_TRUE (next == 0))
+    return t->h;
+  if ((hash & (t->h->nbuckets - 1)) <
+      __atomic_load_n (&t->n_migrated, __ATOMIC_ACQUIRE))
+    return next;
+  return t->h;
+}
+
+/* start growing into nbuckets buckets */
+static void
+resize_bihash_start (resize_bihash_t * t, u32 nbuckets)
+{
+  ASSERT (t->next == 0 && nbuckets > t->h->nbuckets);
+  t->n_migrated = 0;
+  t->next = clib_mem_alloc_aligned (sizeof (*t->next), CLIB_CACHE_LINE_BYTES);
+  BV (clib_bihash_init) (t->next, "resize-next", nbuckets,
+			 t->h->memory_size / t->h->nbuckets * nbuckets);
+}
+
+/* copy up to n buckets more; 1 once every bucket of h has moved */
+static int
+resize_bihash_step (resize_bihash_t * t, u32 n)
+{
+  BVT (clib_bihash_bucket) * b;
+  BVT (clib_bihash_value) * v;
+  u32 i, j, p;
+
+  for (; n && t->n_migrated < t->h->nbuckets; n--)
+    {
+      i = t->n_migrated;
+      b = BV (clib_bihash_get_bucket) (t->h, i);
+      if (!BV (clib_bihash_bucket_is_empty) (b))
+	{
+	  v = BV (clib_bihash_get_value) (t->h, b->offset);
+	  for (p = 0; p < 1 << b->log2_pages; p++)
+	    for (j = 0; j < BIHASH_KVP_PER_PAGE; j++)
+	      if (!BV (clib_bihash_is_free) (&v[p].kvp[j]))
+		BV (clib_bihash_add_del) (t->next, &v[p].kvp[j],
+					  1 /* is_add */ );
+	}
+      __atomic_store_n (&t->n_migrated, i + 1, __ATOMIC_RELEASE);
+    }
+  return t->n_migrated == t->h->nbuckets;
+}
+
+/* every bucket has moved and no lookup is still in h */
+static void
+resize_bihash_finish (resize_bihash_t * t)
+{
+  BVT (clib_bihash) * h = t->h;
+
+  ASSERT (t->next && t->n_migrated == h->nbuckets);
+  t->h = t->next;
+  t->next = 0;
+  t->n_migrated = 0;
+  BV (clib_bihash_free) (h);
+  clib_mem_free (h);
+}
+
+/* clib_bihash_add_del, in the table holding the key */
+static inline int
+resize_bihash_add_del (resize_bihash_t * t, BVT (clib_bihash_kv) * kv,
+		       int is_add)
+{
+  return BV (clib_bihash_add_del) (resize_bihash_table
+				   (t, BV (clib_bihash_hash) (kv)), kv,
+				   is_add);
+}
+
+/* Same contract as clib_bihash_search */
+static never_inline int
+resize_bihash_search (resize_bihash_t * t, BVT (clib_bihash_kv) * search_key,
+		      BVT (clib_bihash_kv) * valuep)
+{
+  u64 hash = BV (clib_bihash_hash) (search_key);
+  BVT (clib_bihash) * h = resize_bihash_table (t, hash);
+
+  BIHASH_PROBE_KEY (h, search_key);
+  return BV (clib_bihash_search_inline_2_with_hash) (h, hash, search_key,
+						     valuep);
+}
+
+/*
+ * Same contract as clib_bihash_search_batch_v4: one V4 call while not
+ * resizing, else one per table with the keys routed to it.
+ */
+static never_inline int
+resize_bihash_search_batch (resize_bihash_t * t,
+			    BVT (clib_bihash_kv) * search_key, u8 key_mask,
+			    BVT (clib_bihash_kv) * valuep, u8 * valid_key_idx)
+{
+  BVT (clib_bihash_kv) kv[2][8], result[8];
+  BVT (clib_bihash) * tables[2];
+  u32 i, s, n[2] = { 0, 0 }, n_keys = count_set_bits (key_mask);
+  u8 idx[2][8], found, bitmap = 0;
+  int ret = 0;
+
+  if (PREDICT_TRUE (t->next == 0))
+    return BV (clib_bihash_search_batch_v4) (t->h, search_key, key_mask,
+					     valuep, valid_key_idx);
+
+  tables[0] = t->h;
+  tables[1] = t->next;
+  for (i = 0; i < n_keys; i++)
+    {
+      s = resize_bihash_table (t, BV (clib_bihash_hash) (&search_key[i])) ==
+	t->next;
+      kv[s][n[s]] = search_key[i];
+      idx[s][n[s]++] = i;
+    }
+
+  for (s = 0; s < 2; s++)
+    {
+      if (n[s] == 0)
+	continue;
+      found = 0;
+      BV (clib_bihash_search_batch_v4) (tables[s], kv[s], pow2_mask (n[s]),
+					result, &found);
+      for (i = 0; i < n[s]; i++)
+	if (found & (1 << i))
+	  {
+	    valuep[idx[s][i]] = result[i];
+	    bitmap |= 1 << idx[s][i];
+	    ret++;
+	  }
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+#endif /* __included_resize_bihash_8_8_h__ */
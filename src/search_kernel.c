@@ -0,0 +1,450 @@
+/*
+ * Search kernel registry: builtin kernels, selection by name and
+ * dlopen-able kernel plugins. Included by bihash_application.c.
+ */
+#include <dlfcn.h>
+
+STATIC_ASSERT (sizeof (search_kernel_kv_8_8_t) ==
+	       sizeof (BVT (clib_bihash_kv)),
+	       "plugin kv layout must match the bihash kv");
+
+#define _search_kernel_str(x) #x
+#define search_kernel_str(x) _search_kernel_str(x)
+
+/* _(id, name, batch_width, table, fn) */
+#define foreach_builtin_search_kernel                                   \
+  _(0, V0, 1, BIHASH, BV (clib_bihash_search))                          \
+  _(4, V4, 8, BIHASH, BV (clib_bihash_search_batch_v4))                 \
+  _(5, V5, 8, BIHASH, BV (clib_bihash_search_batch_v5))                 \
+  _(8, V8, 1, CUCKOO, cuckoo_8_8_search)                                \
+  _(9, V9, 8, CUCKOO, cuckoo_8_8_search_batch)                          \
+  _(10, V10, 1, SWISS, swiss_8_8_search)                                \
+  _(11, V11, 8, SWISS, swiss_8_8_search_batch)                         \
+  _(12, V12, 1, FILTERED, bloom_bihash_search)                          \
+  _(13, V13, 8, FILTERED, bloom_bihash_search_batch)                   \
+  _(14, V14, 1, CACHED, flow_cache_bihash_search)                       \
+  _(15, V15, 8, CACHED, flow_cache_bihash_search_batch)                \
+  _(16, V16, 1, FIXED, bihash_fixed_search)                             \
+  _(17, V17, 8, FIXED, bihash_fixed_search_batch)                       \
+  _(18, V18, 1, DIRECT, direct_index_bihash_search)                     \
+  _(19, V19, 8, DIRECT, direct_index_bihash_search_batch)
+
+/*
+ * One thunk per builtin with the registry's void * table signature: the
+ * kernels take their own table type, calling them through
+ * search_kernel_fn_t directly would be undefined behaviour.
+ */
+#define search_kernel_thunk_1(n, fn)                                    \
+static int                                                              \
+search_kernel_##n##_thunk (void *t, BVT (clib_bihash_kv) * search_key,  \
+                           BVT (clib_bihash_kv) * valuep)               \
+{                                                                       \
+  return fn (t, search_key, valuep);                                    \
+}
+#define search_kernel_thunk_8(n, fn)                                    \
+static int                                                              \
+search_kernel_##n##_thunk (void *t, BVT (clib_bihash_kv) * search_key,  \
+                           u8 key_mask, BVT (clib_bihash_kv) * valuep,  \
+                           u8 * valid_key_idx)                          \
+{                                                                       \
+  return fn (t, search_key, key_mask, valuep, valid_key_idx);           \
+}
+#define _(i, n, w, t, fn) search_kernel_thunk_##w (n, fn)
+foreach_builtin_search_kernel
+#undef _
+
+#define search_kernel_set_1(k, n) k->search = search_kernel_##n##_thunk
+#define search_kernel_set_8(k, n) k->search_batch = search_kernel_##n##_thunk
+
+void
+search_kernel_register_builtins (bihash_profiler_main_t * bpm)
+{
+  search_kernel_t *k;
+
+#define _(i, n, w, t, fn)                                               \
+  vec_add2 (bpm->kernels, k, 1);                                        \
+  k->id = i;                                                            \
+  k->name = #n;                                                         \
+  k->fn_name = search_kernel_str (fn);                                  \
+  k->batch_width = w;                                                   \
+  k->table_kind = SEARCH_TABLE_##t;                                     \
+  search_kernel_set_##w (k, n);
+  foreach_builtin_search_kernel;
+#undef _
+}
+
+u32
+search_kernel_index_by_name (bihash_profiler_main_t * bpm, char *name)
+{
+  search_kernel_t *k;
+
+  vec_foreach (k, bpm->kernels)
+    if (!strcmp (k->name, name))
+      return k - bpm->kernels;
+  return ~0;
+}
+
+int
+search_kernel_select (bihash_profiler_main_t * bpm, char *name)
+{
+  u32 i, *ip;
+
+  i = search_kernel_index_by_name (bpm, name);
+  if (i == ~0)
+    {
+      fformat (stderr, "unknown search kernel '%s'\n", name);
+      return -1;
+    }
+  vec_foreach (ip, bpm->selected)
+    if (*ip == i)
+      return 0;
+  vec_add1 (bpm->selected, i);
+  return 0;
+}
+
+/* on stderr, after an unknown kernel name */
+void
+search_kernel_usage (bihash_profiler_main_t * bpm)
+{
+  search_kernel_t *k;
+
+  fformat (stderr, "usage: kernel <name>, <name> one of");
+  vec_foreach (k, bpm->kernels)
+    fformat (stderr, " %s", k->name);
+  fformat (stderr, "\n");
+}
+
+int
+search_kernel_load_plugin (bihash_profiler_main_t * bpm, char *path)
+{
+  search_kernel_plugin_register_fn_t *reg;
+  search_kernel_plugin_t *pk;
+  search_kernel_t *k;
+  void *handle;
+  u32 i, n_kernels = 0;
+
+  /* deepbind: the plugin's own bihash template wins over ours */
+  handle = dlopen (path, RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+  if (!handle)
+    {
+      fformat (stderr, "plugin %s: %s\n", path, dlerror ());
+      return -1;
+    }
+
+  reg = dlsym (handle, SEARCH_KERNEL_PLUGIN_SYMBOL);
+  if (!reg)
+    {
+      fformat (stderr, "plugin %s: no %s symbol\n", path,
+	       SEARCH_KERNEL_PLUGIN_SYMBOL);
+      dlclose (handle);
+      return -1;
+    }
+
+  pk = reg (&n_kernels);
+  for (i = 0; i < n_kernels; i++, pk++)
+    {
+      if (pk->abi_version != SEARCH_KERNEL_PLUGIN_ABI_VERSION ||
+	  !pk->name || !pk->table_create || !pk->table_add ||
+	  !pk->table_free ||
+	  (pk->batch_width == 1 && !pk->search) ||
+	  (pk->batch_width == 8 && !pk->search_batch) ||
+	  (pk->batch_width != 1 && pk->batch_width != 8))
+	{
+	  fformat (stderr, "plugin %s: kernel %d rejected\n", path, i);
+	  continue;
+	}
+      if (search_kernel_index_by_name (bpm, (char *) pk->name) != ~0)
+	{
+	  fformat (stderr, "plugin %s: duplicate kernel '%s'\n", path,
+		   pk->name);
+	  continue;
+	}
+      vec_add2 (bpm->kernels, k, 1);
+      k->id = SEARCH_KERNEL_PLUGIN_FIRST_ID + bpm->n_plugin_kernels++;
+      k->name = (char *) pk->name;
+      k->fn_name = (char *) pk->name;
+      k->batch_width = pk->batch_width;
+      k->table_kind = SEARCH_TABLE_PLUGIN;
+      k->search = (search_kernel_fn_t *) pk->search;
+      k->search_batch = (search_kernel_batch_fn_t *) pk->search_batch;
+      k->plugin = pk;
+
+      /* loaded kernels always run */
+      vec_add1 (bpm->selected, k - bpm->kernels);
+      fformat (stdout, "plugin %s: kernel %s, batch width %d\n", path,
+	       k->name, k->batch_width);
+    }
+  return 0;
+}
+
+static int
+search_kernel_plugin_add_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  search_kernel_t *k = arg;
+
+  if (k->plugin->table_add (k->plugin_table,
+			    (search_kernel_kv_8_8_t *) kv) < 0)
+    fformat (stderr, "%s: table_add failed for key %lu\n", k->name, kv->key);
+  return BIHASH_WALK_CONTINUE;
+}
+
+static int
+search_kernel_direct_add_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  direct_index_bihash_t *t = arg;
+
+  direct_index_8_8_add (&t->index, t->h, kv);
+  return BIHASH_WALK_CONTINUE;
+}
+
+static int
+search_kernel_bloom_add_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  bloom_8_8_add (arg, kv->key);
+  return BIHASH_WALK_CONTINUE;
+}
+
+/* Table searched by k, built on first use */
+void *
+search_kernel_table (bihash_profiler_main_t * bpm, search_kernel_t * k)
+{
+  switch (k->table_kind)
+    {
+    case SEARCH_TABLE_BIHASH:
+      return bpm->h;
+    case SEARCH_TABLE_CUCKOO:
+    case SEARCH_TABLE_SWISS:
+      if (alt_tables_init (&bpm->alt_tables, bpm->h, bpm->n_elts) < 0)
+	fformat (stdout, "alt_tables_init failed \n");
+      return k->table_kind == SEARCH_TABLE_CUCKOO ?
+	(void *) &bpm->alt_tables.cuckoo : (void *) &bpm->alt_tables.swiss;
+    case SEARCH_TABLE_FILTERED:
+      /* without "bloom", built from the table instead of by init_hash_table */
+      if (!bpm->filtered.is_init)
+	{
+	  bloom_8_8_init (&bpm->filtered.filter, bpm->n_elts,
+			  BLOOM_8_8_DEFAULT_BITS_PER_KEY);
+	  BV (clib_bihash_foreach_key_value_pair) (bpm->h,
+						   search_kernel_bloom_add_cb,
+						   &bpm->filtered.filter);
+	  bpm->filtered.h = bpm->h;
+	  bpm->filtered.is_init = 1;
+	}
+      return &bpm->filtered;
+    case SEARCH_TABLE_CACHED:
+      if (!bpm->cached.is_init)
+	{
+	  flow_cache_8_8_init (&bpm->cached.cache, bpm->flow_cache_entries ?
+			       bpm->flow_cache_entries :
+			       FLOW_CACHE_8_8_DEFAULT_ENTRIES,
+			       bpm->flow_cache_policy);
+	  bpm->cached.h = bpm->h;
+	  bpm->cached.is_init = 1;
+	}
+      return &bpm->cached;
+    case SEARCH_TABLE_FIXED:
+      if (!bpm->fixed.is_init)
+	bihash_fixed_init (&bpm->fixed, bpm->h);
+      return &bpm->fixed;
+    case SEARCH_TABLE_DIRECT:
+      /* without "direct", built from the table in walk order */
+      if (!bpm->direct.is_init)
+	{
+	  direct_index_8_8_init (&bpm->direct.index, bpm->direct_density_pct);
+	  bpm->direct.h = bpm->h;
+	  BV (clib_bihash_foreach_key_value_pair) (bpm->h,
+						   search_kernel_direct_add_cb,
+						   &bpm->direct);
+	  direct_index_8_8_seal (&bpm->direct.index);
+	  bpm->direct.is_init = 1;
+	}
+      return &bpm->direct;
+    case SEARCH_TABLE_PLUGIN:
+      if (!k->plugin_table)
+	{
+	  k->plugin_table = k->plugin->table_create (bpm->n_elts,
+						     bpm->h->nbuckets);
+	  BV (clib_bihash_foreach_key_value_pair) (bpm->h,
+						   search_kernel_plugin_add_cb,
+						   k);
+	}
+      return k->plugin_table;
+    }
+  return 0;
+}
+
+uword
+search_kernel_table_bytes (bihash_profiler_main_t * bpm, search_kernel_t * k)
+{
+  void *t = search_kernel_table (bpm, k);
+
+  switch (k->table_kind)
+    {
+    case SEARCH_TABLE_BIHASH:
+      return BV (clib_bihash_bytes_in_use) (t);
+    case SEARCH_TABLE_CUCKOO:
+      return cuckoo_8_8_memory_bytes (t);
+    case SEARCH_TABLE_SWISS:
+      return swiss_8_8_memory_bytes (t);
+    case SEARCH_TABLE_FILTERED:
+      return BV (clib_bihash_bytes_in_use) (bpm->h) +
+	bloom_8_8_memory_bytes (&bpm->filtered.filter);
+    case SEARCH_TABLE_CACHED:
+      return BV (clib_bihash_bytes_in_use) (bpm->h) +
+	flow_cache_8_8_memory_bytes (&bpm->cached.cache);
+    case SEARCH_TABLE_FIXED:
+      return BV (clib_bihash_bytes_in_use) (bpm->fixed.h);
+    case SEARCH_TABLE_DIRECT:
+      return BV (clib_bihash_bytes_in_use) (bpm->h) +
+	direct_index_8_8_memory_bytes (&bpm->direct.index);
+    case SEARCH_TABLE_PLUGIN:
+      return k->plugin->table_bytes ? k->plugin->table_bytes (t) : 0;
+    }
+  return 0;
+}
+
+static int
+search_kernel_key_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  u64 **keys = arg;
+  vec_add1 (*keys, kv->key);
+  return BIHASH_WALK_CONTINUE;
+}
+
+/* keys of the profile's table, in walk order */
+u64 *
+search_kernel_table_keys (bihash_profiler_main_t * bpm)
+{
+  u64 *keys = 0;
+
+  BV (clib_bihash_foreach_key_value_pair) (bpm->h, search_kernel_key_cb,
+					   &keys);
+  return keys;
+}
+
+/*
+ * Cycles for k to search every key of keys, 8 at a time for batch
+ * kernels (vec_len (keys) must be a multiple of 8). Second of two runs.
+ */
+u64
+search_kernel_time_keys (bihash_profiler_main_t * bpm, search_kernel_t * k,
+			 u64 * keys, u64 * hits)
+{
+  void *table = search_kernel_table (bpm, k);
+  BVT (clib_bihash_kv) kv[8];
+  u64 i, start, cycles = 0;
+  u8 valid_key_idx;
+  u32 j;
+  int warm;
+
+  for (warm = 0; warm < 2; warm++)
+    {
+      *hits = 0;
+      perf_timer_begin (start);
+      if (k->batch_width == 1)
+	for (i = 0; i < vec_len (keys); i++)
+	  {
+	    kv[0].key = keys[i];
+	    if (k->search (table, kv, kv) == 0)
+	      (*hits)++;
+	  }
+      else
+	for (i = 0; i < vec_len (keys); i += 8)
+	  {
+	    for (j = 0; j < 8; j++)
+	      kv[j].key = keys[i + j];
+	    if (k->search_batch (table, kv, 0xFF, kv, &valid_key_idx) > 0)
+	      *hits += count_set_bits (valid_key_idx);
+	  }
+      perf_timer_end (start, cycles);
+    }
+  return cycles;
+}
+
+/* Evict k's table, and the first lines of its code, from the caches */
+void
+search_kernel_evict (bihash_profiler_main_t * bpm, search_kernel_t * k)
+{
+  void *t = search_kernel_table (bpm, k);
+  void *fn = k->batch_width == 1 ? (void *) k->search :
+    (void *) k->search_batch;
+  cuckoo_8_8_t *ct = t;
+  swiss_8_8_t *st = t;
+
+  switch (k->table_kind)
+    {
+    case SEARCH_TABLE_BIHASH:
+      BV (clib_bihash_flush_cache) (t);
+      break;
+    case SEARCH_TABLE_CUCKOO:
+      cold_cache_flush_range (ct->buckets, cuckoo_8_8_memory_bytes (ct));
+      cold_cache_flush_range (ct, sizeof (*ct));
+      break;
+    case SEARCH_TABLE_SWISS:
+      cold_cache_flush_range (st->ctrl, st->n_groups * SWISS_8_8_GROUP_SZ);
+      cold_cache_flush_range (st->slots, st->n_groups * SWISS_8_8_GROUP_SZ *
+			      sizeof (st->slots[0]));
+      cold_cache_flush_range (st, sizeof (*st));
+      break;
+    case SEARCH_TABLE_FILTERED:
+      BV (clib_bihash_flush_cache) (bpm->h);
+      cold_cache_flush_range (bpm->filtered.filter.blocks,
+			      bloom_8_8_memory_bytes (&bpm->filtered.filter));
+      break;
+    case SEARCH_TABLE_CACHED:
+      BV (clib_bihash_flush_cache) (bpm->h);
+      cold_cache_flush_range (bpm->cached.cache.sets,
+			      bpm->cached.cache.n_sets *
+			      sizeof (bpm->cached.cache.sets[0]));
+      break;
+    case SEARCH_TABLE_FIXED:
+      BV (clib_bihash_flush_cache) (bpm->fixed.h);
+      cold_cache_flush_range (&bpm->fixed, sizeof (bpm->fixed));
+      break;
+    case SEARCH_TABLE_DIRECT:
+      {
+	direct_index_8_8_chunk_t **ch;
+
+	BV (clib_bihash_flush_cache) (bpm->h);
+	vec_foreach (ch, bpm->direct.index.chunks)
+	  cold_cache_flush_range (ch[0], sizeof (ch[0][0]));
+	cold_cache_flush_range (bpm->direct.index.chunk_of,
+				vec_len (bpm->direct.index.chunk_of) *
+				sizeof (bpm->direct.index.chunk_of[0]));
+      }
+      break;
+    case SEARCH_TABLE_PLUGIN:
+      /* plugin tables are opaque */
+      cold_cache_sweep_llc (&bpm->cold_cache);
+      break;
+    }
+  cold_cache_flush_range (fn, 4096);
+
+  if (bpm->cold_cache.disturb_tlb)
+    cold_cache_disturb_tlb (&bpm->cold_cache);
+}
+
+void
+search_kernels_free (bihash_profiler_main_t * bpm)
+{
+  search_kernel_t *k;
+
+  vec_foreach (k, bpm->kernels)
+  {
+    if (k->plugin_table)
+      {
+	k->plugin->table_free (k->plugin_table);
+	k->plugin_table = 0;
+      }
+    vec_free (k->cpo_samples);
+  }
+  alt_tables_free (&bpm->alt_tables);
+  bloom_8_8_free (&bpm->filtered.filter);
+  bpm->filtered.is_init = 0;
+  flow_cache_8_8_free (&bpm->cached.cache);
+  bpm->cached.is_init = 0;
+  bihash_fixed_free (&bpm->fixed);
+  direct_index_8_8_free (&bpm->direct.index);
+  bpm->direct.is_init = 0;
+  cold_cache_free (&bpm->cold_cache);
+}
@@ -0,0 +1,67 @@
+/*
+ * Registry of the search kernels the harness can time and cross-check.
+ *
+ * Kernels come from the builtin list in search_kernel.c or from plugins
+ * loaded at runtime. Each kernel searches one table; builtin kernels share
+ * the profile's bihash or the alternative backends, plugin kernels own
+ * theirs.
+ */
+#ifndef __included_search_kernel_h__
+#define __included_search_kernel_h__
+
+#include "search_kernel_plugin.h"
+
+typedef int (search_kernel_fn_t) (void *table,
+				  BVT (clib_bihash_kv) * search_key,
+				  BVT (clib_bihash_kv) * valuep);
+
+typedef int (search_kernel_batch_fn_t) (void *table,
+					BVT (clib_bihash_kv) * search_key,
+					u8 key_mask,
+					BVT (clib_bihash_kv) * valuep,
+					u8 * valid_key_idx);
+
+typedef enum
+{
+  SEARCH_TABLE_BIHASH,
+  SEARCH_TABLE_CUCKOO,
+  SEARCH_TABLE_SWISS,
+  SEARCH_TABLE_FILTERED,
+  SEARCH_TABLE_CACHED,
+  SEARCH_TABLE_FIXED,
+  SEARCH_TABLE_DIRECT,
+  SEARCH_TABLE_PLUGIN,
+} search_table_kind_t;
+
+typedef struct
+{
+  char *name;			/* "V0", selects the kernel on the command line */
+  char *fn_name;		/* reported by the consistency stage */
+  u32 id;			/* item number in the perf output */
+  u8 batch_width;		/* 1: search, 8: search_batch */
+  search_table_kind_t table_kind;
+  search_kernel_fn_t *search;
+  search_kernel_batch_fn_t *search_batch;
+
+  /* plugin kernels own their table */
+  search_kernel_plugin_t *plugin;
+  void *plugin_table;
+
+  /* last perf run */
+  u64 cycles;
+  u64 options;
+  f64 core_ratio;		/* core cycles per tsc tick, 0: unknown */
+  u8 freq_stable;
+  f64 *cpo_samples;		/* every warm run, see regression.c */
+
+  /* last run after search_kernel_evict */
+  u64 cold_cycles;
+  u64 cold_options;
+} search_kernel_t;
+
+#define SEARCH_KERNEL_PLUGIN_FIRST_ID 32
+
+/* reference kernel of the consistency stage */
+#define SEARCH_KERNEL_REFERENCE "V4"
+
+#endif /* __included_search_kernel_h__ */
@@ -0,0 +1,52 @@
+/*
+ * Search kernel plugin ABI.
+ *
+ * A plugin is a shared object exporting SEARCH_KERNEL_PLUGIN_SYMBOL, which
+ * returns an array of kernel descriptors. Every kernel owns a table: the
+ * profiler creates it with table_create, then feeds it every key/value of
+ * the profile's bihash through table_add before timing the kernel.
+ *
+ * This header only depends on <stdint.h>, so a plugin can be built
+ * against a different VPP tree than the profiler, e.g. to A/B a candidate
+ * bihash patch (see src/plugins/bihash_candidate.c).
+ */
+#ifndef __included_search_kernel_plugin_h__
+#define __included_search_kernel_plugin_h__
+
+#include <stdint.h>
+
+#define SEARCH_KERNEL_PLUGIN_ABI_VERSION 1
+#define SEARCH_KERNEL_PLUGIN_SYMBOL "search_kernel_plugin_register"
+
+/* layout of clib_bihash_kv_8_8_t */
+typedef struct
+{
+  uint64_t key;
+  uint64_t value;
+} search_kernel_kv_8_8_t;
+
+typedef struct
+{
+  uint32_t abi_version;		/* SEARCH_KERNEL_PLUGIN_ABI_VERSION */
+  const char *name;		/* selects the kernel on the command line */
+  uint32_t batch_width;		/* 1: search, 8: search_batch */
+
+  void *(*table_create) (uint64_t n_keys, uint32_t nbuckets);
+  int (*table_add) (void *table, search_kernel_kv_8_8_t * kv);
+  void (*table_free) (void *table);
+  uint64_t (*table_bytes) (void *table);	/* optional */
+
+  /* same contract as clib_bihash_search */
+  int (*search) (void *table, search_kernel_kv_8_8_t * search_key,
+		 search_kernel_kv_8_8_t * valuep);
+
+  /* same contract as clib_bihash_search_batch_v4 */
+  int (*search_batch) (void *table, search_kernel_kv_8_8_t * search_key,
+		       uint8_t key_mask, search_kernel_kv_8_8_t * valuep,
+		       uint8_t * valid_key_idx);
+} search_kernel_plugin_t;
+
+typedef search_kernel_plugin_t *(search_kernel_plugin_register_fn_t)
+  (uint32_t * n_kernels);
+
+#endif /* __included_search_kernel_plugin_h__ */
@@ -0,0 +1,306 @@
+/*
+ * Sharded mode: the profile's key set split across N bihash shards, one
+ * per worker, against N workers sharing the profile's table.
+ * Included by bihash_application.c.
+ *
+ * Every worker is a thread pinned to its own CPU (modulo the CPUs
+ * available). Three runs:
+ *   shared:  worker i searches a 1/N slice of the keys in the shared table
+ *   sharded: worker i searches the keys of shard i in shard i, as if RSS
+ *            had steered each flow to its worker; shards hold as many keys
+ *            as the steering hash gives them, not exactly 1/N
+ *   steered: worker i takes the same slice as in the shared run and steers
+ *            every key to its shard itself, the cross-shard case: batch
+ *            kernels get groups of 8 keys of one shard, collected per
+ *            shard, and each shard's last group with the keys it has
+ */
+
+typedef struct
+{
+  BVT (clib_bihash) * shards;
+  u32 n_shards;
+
+  /* all keys in random order, then the keys of each shard */
+  u64 *keys;
+  u64 **shard_keys;
+} sharded_tables_t;
+
+typedef enum
+{
+  SHARDED_RUN_SHARED,
+  SHARDED_RUN_SHARDED,
+  SHARDED_RUN_STEERED,
+} sharded_run_t;
+
+typedef struct
+{
+  pthread_t thread;
+  u32 index;
+  u32 cpu;
+  sharded_run_t run;
+  search_kernel_t *kernel;
+  sharded_tables_t *st;
+  BVT (clib_bihash) * shared;
+  pthread_barrier_t *barrier;
+
+  /* steered batches: 8 kvs per shard, and how many of them are filled */
+  BVT (clib_bihash_kv) * groups;
+  u8 *fill;
+
+  /* results */
+  u64 start, end;
+  u64 options;
+  u64 hits;
+} sharded_worker_t;
+
+/*
+ * Flow steering hash. Not crc32c: the bihash picks buckets with it, and
+ * steering on the same bits would leave most buckets of a shard empty.
+ */
+always_inline u32
+sharded_steer (u64 key, u32 n_shards)
+{
+  return ((key * 0x9e3779b97f4a7c15ULL) >> 32) % n_shards;
+}
+
+static int
+sharded_tables_key_cb (BVT (clib_bihash_kv) * kv, void *arg)
+{
+  sharded_tables_t *st = arg;
+  u32 s = sharded_steer (kv->key, st->n_shards);
+
+  vec_add1 (st->keys, kv->key);
+  BV (clib_bihash_add_del) (&st->shards[s], kv, 1 /* is_add */ );
+  return BIHASH_WALK_CONTINUE;
+}
+
+int
+sharded_tables_init (sharded_tables_t * st, BVT (clib_bihash) * h,
+		     u32 n_shards)
+{
+  u32 i, j, nbuckets;
+  u64 t;
+
+  clib_memset (st, 0, sizeof (*st));
+  st->n_shards = n_shards;
+  vec_validate (st->shards, n_shards - 1);
+  vec_validate (st->shard_keys, n_shards - 1);
+
+  /* same buckets per key as the shared table */
+  nbuckets = clib_max (h->nbuckets / n_shards, 64);
+  for (i = 0; i < n_shards; i++)
+    BV (clib_bihash_init) (&st->shards[i], "bihash-shard", nbuckets,
+			   clib_max (h->memory_size / n_shards, 32ULL << 20));
+
+  BV (clib_bihash_foreach_key_value_pair) (h, sharded_tables_key_cb, st);
+
+  /* walk order is bucket order, searching in it would be prefetch friendly */
+  for (i = vec_len (st->keys); i > 1; i--)
+    {
+      j = random () % i;
+      t = st->keys[i - 1];
+      st->keys[i - 1] = st->keys[j];
+      st->keys[j] = t;
+    }
+  for (i = 0; i < vec_len (st->keys); i++)
+    vec_add1 (st->shard_keys[sharded_steer (st->keys[i], n_shards)],
+	      st->keys[i]);
+  return 0;
+}
+
+void
+sharded_tables_free (sharded_tables_t * st)
+{
+  u32 i;
+
+  for (i = 0; i < vec_len (st->shards); i++)
+    {
+      BV (clib_bihash_free) (&st->shards[i]);
+      vec_free (st->shard_keys[i]);
+    }
+  vec_free (st->shards);
+  vec_free (st->shard_keys);
+  vec_free (st->keys);
+}
+
+always_inline void *
+sharded_worker_table (sharded_worker_t * w, u64 key)
+{
+  switch (w->run)
+    {
+    case SHARDED_RUN_SHARED:
+      return w->shared;
+    case SHARDED_RUN_SHARDED:
+      return &w->st->shards[w->index];
+    case SHARDED_RUN_STEERED:
+      return &w->st->shards[sharded_steer (key, w->st->n_shards)];
+    }
+  return 0;
+}
+
+static void *
+sharded_worker_fn (void *arg)
+{
+  sharded_worker_t *w = arg;
+  search_kernel_t *k = w->kernel;
+  BVT (clib_bihash_kv) kv[8], *g;
+  u64 *keys, n_keys, per, i, n;
+  u8 valid_key_idx;
+  cpu_set_t cpuset;
+  u32 j, s;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (w->cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+
+  if (w->run == SHARDED_RUN_SHARDED)
+    {
+      keys = w->st->shard_keys[w->index];
+      n_keys = vec_len (keys);
+    }
+  else
+    {
+      /* same share of the keys a shard holds, the last worker takes the
+         remainder so every key is searched as in the sharded run */
+      per = vec_len (w->st->keys) / w->st->n_shards;
+      keys = w->st->keys + w->index * per;
+      n_keys = w->index == w->st->n_shards - 1 ?
+	vec_len (w->st->keys) - w->index * per : per;
+    }
+
+  pthread_barrier_wait (w->barrier);
+  w->start = timer_begin ();
+
+  if (k->batch_width == 1)
+    for (i = 0; i < n_keys; i++)
+      {
+	kv[0].key = keys[i];
+	if (k->search (sharded_worker_table (w, keys[i]), kv, kv) == 0)
+	  w->hits++;
+      }
+  else if (w->run != SHARDED_RUN_STEERED)
+    for (i = 0; i < n_keys; i += 8)
+      {
+	n = clib_min (n_keys - i, 8);
+	for (j = 0; j < n; j++)
+	  kv[j].key = keys[i + j];
+	w->hits += k->search_batch (sharded_worker_table (w, 0), kv,
+				    pow2_mask (n), kv, &valid_key_idx);
+      }
+  else
+    {
+      /* keys collected per shard, a batch per 8 keys of one shard */
+      for (i = 0; i < n_keys; i++)
+	{
+	  s = sharded_steer (keys[i], w->st->n_shards);
+	  g = w->groups + s * 8;
+	  g[w->fill[s]++].key = keys[i];
+	  if (w->fill[s] < 8)
+	    continue;
+	  w->hits += k->search_batch (&w->st->shards[s], g, 0xFF, g,
+				      &valid_key_idx);
+	  w->fill[s] = 0;
+	}
+      for (s = 0; s < w->st->n_shards; s++)
+	if (w->fill[s])
+	  {
+	    g = w->groups + s * 8;
+	    w->hits += k->search_batch (&w->st->shards[s], g,
+					pow2_mask (w->fill[s]), g,
+					&valid_key_idx);
+	    w->fill[s] = 0;
+	  }
+    }
+
+  w->end = timer_end ();
+  w->options = n_keys;
+  return 0;
+}
+
+static char *sharded_run_names[] = {
+  [SHARDED_RUN_SHARED] = "shared",
+  [SHARDED_RUN_SHARDED] = "sharded",
+  [SHARDED_RUN_STEERED] = "steered",
+};
+
+/*
+ * Run kernel k on N pinned workers for each of the three runs and print
+ * aggregate throughput and table memory side by side.
+ */
+void
+sharded_perf_test (bihash_profiler_main_t * bpm, search_kernel_t * k,
+		   f64 cycles_per_second)
+{
+  sharded_tables_t _st, *st = &_st;
+  sharded_worker_t *workers = 0, *w;
+  pthread_barrier_t barrier;
+  u32 n = bpm->n_shards, n_cpus = clib_max (get_nprocs (), 1);
+  u64 start, end, options, hits;
+  uword shared_bytes, sharded_bytes = 0;
+  sharded_run_t run;
+  f64 mops;
+  u32 i;
+
+  if (k->table_kind != SEARCH_TABLE_BIHASH)
+    {
+      fformat (stdout, "sharded: %s does not search a bihash, skipped\n",
+	       k->name);
+      return;
+    }
+
+  sharded_tables_init (st, bpm->h, n);
+  shared_bytes = BV (clib_bihash_bytes_in_use) (bpm->h);
+  for (i = 0; i < n; i++)
+    sharded_bytes += BV (clib_bihash_bytes_in_use) (&st->shards[i]);
+
+  fformat (stdout, "Sharded:API %s,%d workers on %d cpus,%d shards x %d buckets\n"
+	   "run      |---| MOPS |---| CPO/worker |---| Hits |---| Bytes |---| Bytes/Entry | \n",
+	   k->name, n, n_cpus, n, st->shards[0].nbuckets);
+
+  vec_validate (workers, n - 1);
+  for (run = SHARDED_RUN_SHARED; run <= SHARDED_RUN_STEERED; run++)
+    {
+      pthread_barrier_init (&barrier, 0, n);
+      vec_foreach (w, workers)
+      {
+	clib_memset (w, 0, sizeof (*w));
+	w->index = w - workers;
+	w->cpu = w->index % n_cpus;
+	w->run = run;
+	w->kernel = k;
+	w->st = st;
+	w->shared = bpm->h;
+	w->barrier = &barrier;
+	vec_validate (w->groups, n * 8 - 1);
+	vec_validate (w->fill, n - 1);
+	pthread_create (&w->thread, 0, sharded_worker_fn, w);
+      }
+
+      start = ~0ULL;
+      end = options = hits = 0;
+      vec_foreach (w, workers)
+      {
+	pthread_join (w->thread, 0);
+	start = clib_min (start, w->start);
+	end = clib_max (end, w->end);
+	options += w->options;
+	hits += w->hits;
+	vec_free (w->groups);
+	vec_free (w->fill);
+      }
+      pthread_barrier_destroy (&barrier);
+
+      mops = options / ((f64) (end - start) / cycles_per_second) / 1e6;
+      fformat (stdout, "%s       %.2f       %.2f       %ld       %ld       %.2f \n",
+	       sharded_run_names[run], mops,
+	       options ? (f64) (end - start) * n / options : 0, hits,
+	       run == SHARDED_RUN_SHARED ? shared_bytes : sharded_bytes,
+	       vec_len (st->keys) ? (f64) (run == SHARDED_RUN_SHARED ?
+					  shared_bytes : sharded_bytes) /
+	       vec_len (st->keys) : 0);
+    }
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+  vec_free (workers);
+  sharded_tables_free (st);
+}
@@ -0,0 +1,504 @@
+/*
+ * Shared-memory readers mode: the profile's table exported to a memfd and
+ * searched by "readers <n>" processes which attach it read-only, against
+ * n threads of this process over the table itself. Included by
+ * bihash_application.c.
+ *
+ * The 22.02 bihash allocates from the process heap, so the table is not
+ * built in shared memory but exported once built: a header, the bucket
+ * array and the kvp pages of every bucket copied into the memfd, the
+ * bucket offsets rewritten from the start of the image. Bihash offsets
+ * are relative to alloc_arena, so a reader maps the image wherever it
+ * lands and searches it with V0/V4/V5 through a clib_bihash whose buckets
+ * and alloc_arena point into its mapping; nothing there is written.
+ *
+ * Readers are forked after the export and attach as an unrelated process
+ * would: open the memfd through /proc/<pid>/fd, map it read-only and
+ * populated, check the header. That is the attach time. Readers, then
+ * threads, run each API together behind a barrier, every one of them
+ * over the same present keys in its own random order; the readers report
+ * in a shared anonymous mapping.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+#define SHARED_READERS_DEFAULT_READERS 4
+#define SHARED_READERS_MAX_KEYS (1 << 20)
+#define SHARED_READERS_MAGIC 0x3130686968736962ULL	/* "bishih01" */
+
+/* _(api, name) */
+#define foreach_shared_readers_api                                      \
+  _(V0, "V0")                                                           \
+  _(V4, "V4")                                                           \
+  _(V5, "V5")
+
+typedef enum
+{
+#define _(a, n) SHARED_READERS_##a,
+  foreach_shared_readers_api
+#undef _
+  SHARED_READERS_N_APIS,
+} shared_readers_api_t;
+
+static char *shared_readers_names[] = {
+#define _(a, n) [SHARED_READERS_##a] = n,
+  foreach_shared_readers_api
+#undef _
+};
+
+/* start of the image, the bucket array at buckets_offset */
+typedef struct
+{
+  u64 magic;
+  u32 nbuckets;
+  u32 log2_nbuckets;
+  u64 buckets_offset;
+  u64 n_bytes;
+} shared_readers_image_t;
+
+typedef struct
+{
+  u32 cpu;
+  u64 attach_cycles;
+  u64 start[SHARED_READERS_N_APIS];
+  u64 end[SHARED_READERS_N_APIS];
+  u64 hits[SHARED_READERS_N_APIS];
+  int failed;			/* could not attach */
+} shared_readers_result_t;
+
+/* the mapping the readers share with this process */
+typedef struct
+{
+  pthread_barrier_t barrier;
+  shared_readers_result_t results[0];
+} shared_readers_shm_t;
+
+typedef struct
+{
+  pthread_t thread;
+  BVT (clib_bihash) * h;
+  u64 *keys;
+  pthread_barrier_t *barrier;
+  shared_readers_result_t *result;
+} shared_readers_worker_t;
+
+/* hits of api over keys, vec_len (keys) a multiple of 8 */
+static u64
+shared_readers_run (BVT (clib_bihash) * h, shared_readers_api_t api,
+		    u64 * keys)
+{
+  BVT (clib_bihash_kv) kv[8];
+  u64 i, n = vec_len (keys), hits = 0;
+  u8 valid_key_idx;
+  u32 j;
+
+  if (api == SHARED_READERS_V0)
+    {
+      for (i = 0; i < n; i++)
+	{
+	  kv[0].key = keys[i];
+	  hits += BV (clib_bihash_search) (h, kv, kv) == 0;
+	}
+      return hits;
+    }
+
+  for (i = 0; i < n; i += 8)
+    {
+      for (j = 0; j < 8; j++)
+	kv[j].key = keys[i + j];
+      if (api == SHARED_READERS_V4)
+	BV (clib_bihash_search_batch_v4) (h, kv, 0xFF, kv, &valid_key_idx);
+      else
+	BV (clib_bihash_search_batch_v5) (h, kv, 0xFF, kv, &valid_key_idx);
+      hits += count_set_bits (valid_key_idx);
+    }
+  return hits;
+}
+
+/* every api: warm, wait for the others, timed */
+static void
+shared_readers_body (shared_readers_worker_t * w)
+{
+  shared_readers_api_t api;
+
+  for (api = 0; api < SHARED_READERS_N_APIS; api++)
+    {
+      shared_readers_run (w->h, api, w->keys);
+      pthread_barrier_wait (w->barrier);
+      w->result->start[api] = timer_begin ();
+      w->result->hits[api] = shared_readers_run (w->h, api, w->keys);
+      w->result->end[api] = timer_end ();
+    }
+}
+
+static void
+shared_readers_pin (u32 cpu)
+{
+  cpu_set_t cpuset;
+
+  CPU_ZERO (&cpuset);
+  CPU_SET (cpu, &cpuset);
+  pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+}
+
+static void *
+shared_readers_thread_fn (void *arg)
+{
+  shared_readers_worker_t *w = arg;
+
+  shared_readers_pin (w->result->cpu);
+  shared_readers_body (w);
+  return 0;
+}
+
+/* bytes of the image of h, the pages of bucket i at offsets[i] (0: none) */
+static u64
+shared_readers_layout (BVT (clib_bihash) * h, u64 ** offsets)
+{
+  BVT (clib_bihash_bucket) * b;
+  u64 i, n_bytes;
+
+  n_bytes = round_pow2 (sizeof (shared_readers_image_t), CLIB_CACHE_LINE_BYTES)
+    + (u64) h->nbuckets * BIHASH_BUCKET_BYTES;
+  vec_validate (*offsets, h->nbuckets - 1);
+  for (i = 0; i < h->nbuckets; i++)
+    {
+      b = BV (clib_bihash_get_bucket) (h, i);
+      (*offsets)[i] = 0;
+      /* empty, or its page in the bucket array */
+      if (BV (clib_bihash_bucket_is_empty) (b) ||
+	  BV (clib_bihash_get_value) (h, b->offset) == (void *) (b + 1))
+	continue;
+      (*offsets)[i] = n_bytes;
+      n_bytes += sizeof (BVT (clib_bihash_value)) << b->log2_pages;
+    }
+  return n_bytes;
+}
+
+/* h copied to a new memfd, mapped at *image; the memfd, -1 on error */
+static int
+shared_readers_export (BVT (clib_bihash) * h, shared_readers_image_t ** image)
+{
+  BVT (clib_bihash_bucket) * b, *ib;
+  shared_readers_image_t *im;
+  u64 *offsets = 0, i, n_bytes;
+  u8 *base, *ibuckets;
+  int fd;
+
+  n_bytes = shared_readers_layout (h, &offsets);
+  fd = memfd_create ("bihash-image", 0);
+  if (fd < 0 || ftruncate (fd, n_bytes) < 0)
+    goto error;
+  base = mmap (0, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+    goto error;
+
+  im = (shared_readers_image_t *) base;
+  im->magic = SHARED_READERS_MAGIC;
+  im->nbuckets = h->nbuckets;
+  im->log2_nbuckets = h->log2_nbuckets;
+  im->buckets_offset = round_pow2 (sizeof (*im), CLIB_CACHE_LINE_BYTES);
+  im->n_bytes = n_bytes;
+
+  ibuckets = base + im->buckets_offset;
+  clib_memcpy_fast (ibuckets, BV (clib_bihash_get_bucket) (h, 0),
+		    (u64) h->nbuckets * BIHASH_BUCKET_BYTES);
+  for (i = 0; i < h->nbuckets; i++)
+    {
+      b = BV (clib_bihash_get_bucket) (h, i);
+      ib = (BVT (clib_bihash_bucket) *) (ibuckets + i *
+					  BIHASH_BUCKET_BYTES);
+      ib->lock = 0;
+      if (offsets[i])
+	{
+	  clib_memcpy_fast (base + offsets[i],
+			    BV (clib_bihash_get_value) (h, b->offset),
+			    sizeof (BVT (clib_bihash_value)) << b->log2_pages);
+	  ib->offset = offsets[i];
+	}
+      else if (BIHASH_KVP_AT_BUCKET_LEVEL)
+	ib->offset = (u8 *) (ib + 1) - base;
+    }
+
+  vec_free (offsets);
+  *image = im;
+  return fd;
+
+error:
+  if (fd >= 0)
+    close (fd);
+  vec_free (offsets);
+  return -1;
+}
+
+/* h searches the image behind fd of process pid, mapped read-only;
+   0 on success */
+static int
+shared_readers_attach (pid_t pid, int fd, BVT (clib_bihash) * h,
+		       shared_readers_image_t ** image)
+{
+  shared_readers_image_t *im;
+  struct stat st;
+  char path[64];
+  u8 *base;
+  int rfd;
+
+  snprintf (path, sizeof (path), "/proc/%d/fd/%d", pid, fd);
+  if ((rfd = open (path, O_RDONLY)) < 0)
+    return -1;
+  if (fstat (rfd, &st) < 0 || st.st_size < (off_t) sizeof (*im))
+    {
+      close (rfd);
+      return -1;
+    }
+  base = mmap (0, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, rfd, 0);
+  close (rfd);
+  if (base == MAP_FAILED)
+    return -1;
+
+  im = (shared_readers_image_t *) base;
+  if (im->magic != SHARED_READERS_MAGIC || im->n_bytes != st.st_size)
+    {
+      munmap (base, st.st_size);
+      return -1;
+    }
+  clib_memset (h, 0, sizeof (*h));
+  h->buckets = (BVT (clib_bihash_bucket) *) (base + im->buckets_offset);
+  h->nbuckets = im->nbuckets;
+  h->log2_nbuckets = im->log2_nbuckets;
+  h->alloc_arena = (uword) base;
+  h->instantiated = 1;
+  *image = im;
+  return 0;
+}
+
+/* 0: the image finds what h finds, on present keys and key + 1 */
+static int
+shared_readers_check (BVT (clib_bihash) * h, BVT (clib_bihash) * ih,
+		      u64 * keys)
+{
+  BVT (clib_bihash_kv) kv, r0, r1;
+  u64 *key;
+  int rv0, rv1, d;
+
+  vec_foreach (key, keys)
+    for (d = 0; d < 2; d++)
+      {
+	kv.key = key[0] + d;
+	rv0 = BV (clib_bihash_search) (h, &kv, &r0);
+	rv1 = BV (clib_bihash_search) (ih, &kv, &r1);
+	if (rv0 != rv1 || (rv0 == 0 && (r0.key != r1.key ||
+					r0.value != r1.value)))
+	  return 1;
+      }
+  return 0;
+}
+
+static void
+shared_readers_report (char *name, shared_readers_result_t * r, u32 n,
+		       u64 n_keys, f64 cycles_per_second)
+{
+  shared_readers_api_t api;
+  u64 start, end, attach = 0;
+  u32 i;
+
+  fformat (stdout, "%s", name);
+  for (i = 0; i < n; i++)
+    attach = clib_max (attach, r[i].attach_cycles);
+  if (attach)
+    fformat (stdout, "       %.1f", attach / cycles_per_second * 1e6);
+  else
+    fformat (stdout, "       n/a");
+  for (api = 0; api < SHARED_READERS_N_APIS; api++)
+    {
+      start = ~0ULL;
+      end = 0;
+      for (i = 0; i < n; i++)
+	{
+	  start = clib_min (start, r[i].start[api]);
+	  end = clib_max (end, r[i].end[api]);
+	}
+      fformat (stdout, "       %.2f", (f64) n_keys * n /
+	       ((f64) (end - start) / cycles_per_second) / 1e6);
+    }
+  fformat (stdout, " \n");
+}
+
+void
+shared_readers_perf_test (bihash_profiler_main_t * bpm,
+			  f64 cycles_per_second)
+{
+  BVT (clib_bihash) * h = bpm->h, ih;
+  shared_readers_image_t *image = 0, *check_image;
+  shared_readers_worker_t *workers = 0, *w;
+  shared_readers_result_t *results = 0, *r;
+  shared_readers_shm_t *shm;
+  shared_readers_api_t api;
+  pthread_barrierattr_t attr;
+  pthread_barrier_t barrier;
+  u32 n = bpm->shared_readers ? bpm->shared_readers :
+    SHARED_READERS_DEFAULT_READERS, n_cpus = clib_max (get_nprocs (), 1);
+  u64 *present = 0, *keys = 0, start, export_cycles, shm_bytes, i;
+  pid_t *pids = 0, pid = getpid ();
+  int fd = -1, status, failed = 0;
+  u8 *name = 0;
+
+  present = search_kernel_table_keys (bpm);
+  if (vec_len (present) < 8)
+    goto done;
+  for (i = 0; i < clib_min (vec_len (present), SHARED_READERS_MAX_KEYS) / 8 * 8;
+       i++)
+    vec_add1 (keys, present[random () % vec_len (present)]);
+
+  perf_timer_begin (start);
+  fd = shared_readers_export (h, &image);
+  perf_timer_end (start, export_cycles);
+  if (fd < 0)
+    {
+      fformat (stdout, "shared readers: cannot export the table to a memfd\n");
+      goto done;
+    }
+
+  /* this process attaches too, to check the image */
+  if (shared_readers_attach (pid, fd, &ih, &check_image) == 0)
+    {
+      failed = shared_readers_check (h, &ih, present);
+      munmap (check_image, check_image->n_bytes);
+    }
+  else
+    failed = 1;
+
+  vec_validate (workers, n - 1);
+  vec_foreach (w, workers)
+    w->keys = profiler_shuffle (keys);
+
+  shm_bytes = sizeof (*shm) + n * sizeof (shm->results[0]);
+  shm = mmap (0, shm_bytes, PROT_READ | PROT_WRITE,
+	      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shm == MAP_FAILED)
+    goto done;
+  clib_memset (shm, 0, shm_bytes);
+  pthread_barrierattr_init (&attr);
+  pthread_barrierattr_setpshared (&attr, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init (&shm->barrier, &attr, n);
+  pthread_barrierattr_destroy (&attr);
+
+  fformat (stdout, "Shared-memory readers:%.2f MB table image in a memfd,exported in %.2f ms,%d readers and %d threads on %d cpus,all over the same %ld keys\n"
+	   "reader |---| attach us |", (f64) image->n_bytes / (1 << 20),
+	   export_cycles / cycles_per_second * 1e3, n, n, n_cpus,
+	   vec_len (keys));
+  for (api = 0; api < SHARED_READERS_N_APIS; api++)
+    fformat (stdout, "---| %s MOPS |", shared_readers_names[api]);
+  fformat (stdout, " \n");
+
+  /* processes: the table behind the memfd only */
+  for (i = 0; i < n; i++)
+    {
+      w = vec_elt_at_index (workers, i);
+      r = &shm->results[i];
+      r->cpu = i % n_cpus;
+      vec_add1 (pids, fork ());
+      if (pids[i] < 0)
+	{
+	  /* the readers forked so far wait at a barrier of n: stop them */
+	  fformat (stdout, "shared readers: fork failed, no process readers\n");
+	  while (i--)
+	    {
+	      kill (pids[i], SIGKILL);
+	      waitpid (pids[i], &status, 0);
+	    }
+	  goto threads;
+	}
+      if (pids[i] == 0)
+	{
+	  shared_readers_pin (r->cpu);
+	  perf_timer_begin (start);
+	  r->failed = shared_readers_attach (pid, fd, &ih, &check_image) != 0;
+	  perf_timer_end (start, r->attach_cycles);
+	  if (r->failed)
+	    {
+	      /* still at the barriers, so the others do not hang */
+	      for (api = 0; api < SHARED_READERS_N_APIS; api++)
+		pthread_barrier_wait (&shm->barrier);
+	      _exit (1);
+	    }
+	  w->h = &ih;
+	  w->barrier = &shm->barrier;
+	  w->result = r;
+	  shared_readers_body (w);
+	  _exit (0);
+	}
+    }
+  for (i = 0; i < n; i++)
+    {
+      if (waitpid (pids[i], &status, 0) < 0 ||
+	  !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+	failed = 1;
+      for (api = 0; api < SHARED_READERS_N_APIS; api++)
+	failed |= shm->results[i].hits[api] != vec_len (keys);
+    }
+  for (i = 0; i < n; i++)
+    {
+      name = format (name, "process %ld%c", i, 0);
+      shared_readers_report ((char *) name, &shm->results[i], 1,
+			     vec_len (keys), cycles_per_second);
+      vec_reset_length (name);
+    }
+  shared_readers_report ("processes", shm->results, n, vec_len (keys),
+			 cycles_per_second);
+
+threads:
+  /* threads of this process over its own table */
+  vec_validate (results, n - 1);
+  pthread_barrier_init (&barrier, 0, n);
+  vec_foreach (w, workers)
+  {
+    r = vec_elt_at_index (results, w - workers);
+    r->cpu = (w - workers) % n_cpus;
+    w->h = h;
+    w->barrier = &barrier;
+    w->result = r;
+    pthread_create (&w->thread, 0, shared_readers_thread_fn, w);
+  }
+  vec_foreach (w, workers)
+  {
+    pthread_join (w->thread, 0);
+    for (api = 0; api < SHARED_READERS_N_APIS; api++)
+      failed |= w->result->hits[api] != vec_len (keys);
+  }
+  pthread_barrier_destroy (&barrier);
+  for (i = 0; i < n; i++)
+    {
+      name = format (name, "thread %ld%c", i, 0);
+      shared_readers_report ((char *) name, &results[i], 1, vec_len (keys),
+			     cycles_per_second);
+      vec_reset_length (name);
+    }
+  shared_readers_report ("threads", results, n, vec_len (keys),
+			 cycles_per_second);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+  fformat (stdout, "clib_bihash_search|-> MATCH <-|shared image ---[%s]\n",
+	   failed ? "FAILED" : "PASS");
+
+  pthread_barrier_destroy (&shm->barrier);
+  munmap (shm, shm_bytes);
+
+done:
+  if (image)
+    {
+      munmap (image, image->n_bytes);
+      close (fd);
+    }
+  vec_foreach (w, workers)
+    vec_free (w->keys);
+  vec_free (workers);
+  vec_free (results);
+  vec_free (pids);
+  vec_free (name);
+  vec_free (present);
+  vec_free (keys);
+}
@@ -0,0 +1,135 @@
+/*
+ * Soak mode: one kernel searching for a fixed wall time, with a sample of
+ * throughput every interval instead of one number per run, to see warm-up,
+ * periodic dips (writers, THP compaction, other tenants) and drift.
+ * Included by bihash_application.c.
+ *
+ * Keys are the same as in the perf runs: linear (0, 1, 2, ... wrapping at
+ * the profile's element count) or random (). The tsc is read every
+ * SOAK_BATCH_KEYS keys, so an interval ends at most one batch late.
+ * Every sample is a CSV line:
+ *   soak,<kernel>,<ms since start>,<MOPS>,<CPO>,<hits>
+ * and with "counters" also
+ *   ,<minor faults>,<major faults>,<core/tsc>,<rss MB>
+ * where faults are deltas over the interval; core/tsc is 0 without a
+ * frequency source (see timer_calib.h), or when either end of the
+ * interval was sampled on another CPU than the calibrated one.
+ */
+
+#define SOAK_BATCH_KEYS 1024
+#define SOAK_DEFAULT_INTERVAL_MS 100
+
+typedef struct
+{
+  u64 tsc;
+  u64 n_keys;
+  u64 hits;
+  u64 core, ref;
+  process_mem_stats_t ps;
+} soak_sample_t;
+
+static void
+soak_sample (bihash_profiler_main_t * bpm, soak_sample_t * s)
+{
+  s->tsc = timer_end ();
+  if (!bpm->soak_counters)
+    return;
+  process_mem_stats_get (&s->ps);
+  /* as timer_freq_begin: no counters of a CPU the thread is not on */
+  if (!timer_freq_cpu_ok (&bpm->timer, sched_getcpu ()) ||
+      timer_freq_sample (&bpm->timer, &s->core, &s->ref) < 0)
+    s->core = s->ref = 0;
+}
+
+/* SOAK_BATCH_KEYS lookups from key *next on, hits found */
+static u64
+soak_batch (search_kernel_t * k, void *table, u64 * next, u64 n_elts,
+	    int is_random)
+{
+  BVT (clib_bihash_kv) kv[8];
+  u64 hits = 0, key = *next;
+  u8 valid_key_idx;
+  u32 i, j;
+
+  for (i = 0; i < SOAK_BATCH_KEYS; i += k->batch_width)
+    {
+      for (j = 0; j < k->batch_width; j++)
+	{
+	  kv[j].key = is_random ? random () : key;
+	  key = key + 1 < n_elts ? key + 1 : 0;
+	}
+      if (k->batch_width == 1)
+	hits += k->search (table, kv, kv) == 0;
+      else if (k->search_batch (table, kv, 0xFF, kv, &valid_key_idx) > 0)
+	hits += count_set_bits (valid_key_idx);
+    }
+  *next = key;
+  return hits;
+}
+
+void
+soak_perf_test (bihash_profiler_main_t * bpm, search_kernel_t * k,
+		f64 cycles_per_second, int is_random)
+{
+  void *table = search_kernel_table (bpm, k);
+  u64 interval_tsc, end_tsc, next_key = 0, n;
+  soak_sample_t s0, s1, first;
+  f64 mops, sum = 0, sum2 = 0, min = 1e18, max = 0, mean;
+  u32 interval_ms = bpm->soak_interval_ms ?
+    bpm->soak_interval_ms : SOAK_DEFAULT_INTERVAL_MS;
+  u32 n_samples = 0;
+
+  fformat (stdout, "Soak:API %s,%d s,%d ms interval,%s keys\n"
+	   "soak,api,ms,mops,cpo,hits%s\n",
+	   k->name, bpm->soak_seconds, interval_ms,
+	   is_random ? "random" : "linear",
+	   bpm->soak_counters ? ",minflt,majflt,core_tsc,rss_mb" : "");
+
+  interval_tsc = cycles_per_second * interval_ms / 1e3;
+  clib_memset (&s0, 0, sizeof (s0));
+  soak_sample (bpm, &s0);
+  first = s0;
+  end_tsc = s0.tsc + (u64) (cycles_per_second * bpm->soak_seconds);
+
+  while (s0.tsc < end_tsc)
+    {
+      s1 = s0;
+      s1.n_keys = s1.hits = 0;
+      do
+	{
+	  s1.hits += soak_batch (k, table, &next_key, bpm->n_elts, is_random);
+	  s1.n_keys += SOAK_BATCH_KEYS;
+	}
+      while (timer_end () - s0.tsc < interval_tsc);
+      soak_sample (bpm, &s1);
+
+      n = s1.tsc - s0.tsc;
+      mops = s1.n_keys / ((f64) n / cycles_per_second) / 1e6;
+      fformat (stdout, "soak,%s,%.1f,%.2f,%.2f,%ld", k->name,
+	       (f64) (s1.tsc - first.tsc) * 1e3 / cycles_per_second, mops,
+	       (f64) n / s1.n_keys, s1.hits);
+      if (bpm->soak_counters)
+	fformat (stdout, ",%ld,%ld,%.3f,%.2f",
+		 s1.ps.minor_faults - s0.ps.minor_faults,
+		 s1.ps.major_faults - s0.ps.major_faults,
+		 s0.ref && s1.ref > s0.ref ? (f64) (s1.core - s0.core) / (s1.ref - s0.ref)
+		 : 0, (f64) s1.ps.rss_bytes / (1 << 20));
+      fformat (stdout, "\n");
+
+      sum += mops;
+      sum2 += mops * mops;
+      min = clib_min (min, mops);
+      max = clib_max (max, mops);
+      n_samples++;
+      s0 = s1;
+    }
+
+  if (n_samples == 0)
+    return;
+  mean = sum / n_samples;
+  fformat (stdout, "Soak:API %s,%d samples,MOPS min %.2f mean %.2f max %.2f,cv %.2f%%\n",
+	   k->name, n_samples, min, mean, max,
+	   mean ? 100.0 * sqrt (clib_max (sum2 / n_samples - mean * mean, 0))
+	   / mean : 0);
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+}
@@ -0,0 +1,200 @@
+/*
+ * Swiss-table style open addressing hash for 8-byte keys / 8-byte values.
+ *
+ * Reference backend for comparing against bihash_8_8 under the same
+ * profiles. Slots are grouped by 16; every group has 16 control bytes
+ * holding a 7-bit tag of the hash of the key in the slot, or
+ * SWISS_8_8_CTRL_EMPTY. A probe compares the 16 tags of a group in one
+ * SSE2 compare and only touches the slots whose tag matched.
+ * Groups are probed quadratically, the table never deletes so no
+ * tombstones are needed.
+ */
+#ifndef __included_swiss_8_8_h__
+#define __included_swiss_8_8_h__
+
+#define SWISS_8_8_GROUP_SZ     16
+#define SWISS_8_8_CTRL_EMPTY   0x80
+
+typedef struct
+{
+  u8 *ctrl;
+  BVT (clib_bihash_kv) * slots;
+  u64 n_groups;
+  u64 group_mask;
+  u64 n_elts;
+} swiss_8_8_t;
+
+always_inline u32
+swiss_8_8_hash (u64 key)
+{
+  return clib_crc32c_u64 (0, key);
+}
+
+/* top 7 bits select the tag, the rest selects the first group */
+always_inline u8
+swiss_8_8_tag (u32 hash)
+{
+  return hash >> 25;
+}
+
+always_inline u32
+swiss_8_8_group_match (u8 * ctrl, u8 tag)
+{
+  __m128i c = _mm_load_si128 ((__m128i *) ctrl);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (c, _mm_set1_epi8 (tag)));
+}
+
+static inline int
+swiss_8_8_init (swiss_8_8_t * t, u64 n_elts)
+{
+  u64 n_slots;
+
+  clib_memset (t, 0, sizeof (*t));
+
+  /* max load factor 7/8 */
+  n_slots = (n_elts * 8) / 7 + 1;
+  t->n_groups = 1ULL << max_log2 (clib_max (n_slots / SWISS_8_8_GROUP_SZ + 1, 2));
+  t->group_mask = t->n_groups - 1;
+  t->ctrl = clib_mem_alloc_aligned (t->n_groups * SWISS_8_8_GROUP_SZ,
+				    CLIB_CACHE_LINE_BYTES);
+  t->slots = clib_mem_alloc_aligned (t->n_groups * SWISS_8_8_GROUP_SZ *
+				     sizeof (t->slots[0]),
+				     CLIB_CACHE_LINE_BYTES);
+  if (!t->ctrl || !t->slots)
+    return -1;
+  clib_memset (t->ctrl, SWISS_8_8_CTRL_EMPTY, t->n_groups * SWISS_8_8_GROUP_SZ);
+  return 0;
+}
+
+static inline void
+swiss_8_8_free (swiss_8_8_t * t)
+{
+  if (t->ctrl)
+    clib_mem_free (t->ctrl);
+  if (t->slots)
+    clib_mem_free (t->slots);
+  clib_memset (t, 0, sizeof (*t));
+}
+
+always_inline uword
+swiss_8_8_memory_bytes (swiss_8_8_t * t)
+{
+  return t->n_groups * SWISS_8_8_GROUP_SZ * (1 + sizeof (t->slots[0]));
+}
+
+/* Same contract as clib_bihash_add_del (..., is_add = 1) */
+static inline int
+swiss_8_8_add (swiss_8_8_t * t, BVT (clib_bihash_kv) * kv)
+{
+  u32 hash = swiss_8_8_hash (kv->key);
+  u8 tag = swiss_8_8_tag (hash);
+  u64 g = hash & t->group_mask, step = 0, base;
+  u32 m, slot;
+
+  if ((t->n_elts + 1) * 8 > t->n_groups * SWISS_8_8_GROUP_SZ * 7)
+    return -1;
+
+  while (1)
+    {
+      base = g * SWISS_8_8_GROUP_SZ;
+      m = swiss_8_8_group_match (t->ctrl + base, tag);
+      while (m)
+	{
+	  slot = count_trailing_zeros (m);
+	  if (t->slots[base + slot].key == kv->key)
+	    {
+	      t->slots[base + slot].value = kv->value;
+	      return 0;
+	    }
+	  m &= m - 1;
+	}
+      m = swiss_8_8_group_match (t->ctrl + base, SWISS_8_8_CTRL_EMPTY);
+      if (m)
+	{
+	  slot = count_trailing_zeros (m);
+	  t->ctrl[base + slot] = tag;
+	  t->slots[base + slot] = *kv;
+	  t->n_elts++;
+	  return 0;
+	}
+      g = (g + ++step) & t->group_mask;
+    }
+}
+
+always_inline int
+swiss_8_8_search_with_hash (swiss_8_8_t * t, u32 hash, u64 key,
+			    BVT (clib_bihash_kv) * valuep)
+{
+  u8 tag = swiss_8_8_tag (hash);
+  u64 g = hash & t->group_mask, step = 0, base;
+  u32 m;
+
+  while (1)
+    {
+      base = g * SWISS_8_8_GROUP_SZ;
+      m = swiss_8_8_group_match (t->ctrl + base, tag);
+      while (m)
+	{
+	  u32 slot = count_trailing_zeros (m);
+	  if (PREDICT_TRUE (t->slots[base + slot].key == key))
+	    {
+	      *valuep = t->slots[base + slot];
+	      return 0;
+	    }
+	  m &= m - 1;
+	}
+      /* an empty control byte ends the probe sequence */
+      if (PREDICT_TRUE (swiss_8_8_group_match (t->ctrl + base,
+					       SWISS_8_8_CTRL_EMPTY)))
+	return -1;
+      g = (g + ++step) & t->group_mask;
+    }
+}
+
+/* Same contract as clib_bihash_search, never_inline as in cuckoo_8_8.h */
+static never_inline int
+swiss_8_8_search (swiss_8_8_t * t, BVT (clib_bihash_kv) * search_key,
+		  BVT (clib_bihash_kv) * valuep)
+{
+  return swiss_8_8_search_with_hash (t, swiss_8_8_hash (search_key->key),
+				     search_key->key, valuep);
+}
+
+/*
+ * Same contract as clib_bihash_search_batch_v4. Hashes all keys first and
+ * prefetches the control bytes and first slot line of every home group,
+ * then probes.
+ */
+static never_inline int
+swiss_8_8_search_batch (swiss_8_8_t * t, BVT (clib_bihash_kv) * search_key,
+			u8 key_mask, BVT (clib_bihash_kv) * valuep,
+			u8 * valid_key_idx)
+{
+  u32 hash[8];
+  u32 i, n_keys = _mm_popcnt_u32 (key_mask);
+  u64 base;
+  u8 bitmap = 0;
+  int ret = 0;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      hash[i] = swiss_8_8_hash (search_key[i].key);
+      base = (hash[i] & t->group_mask) * SWISS_8_8_GROUP_SZ;
+      CLIB_PREFETCH (t->ctrl + base, SWISS_8_8_GROUP_SZ, LOAD);
+      CLIB_PREFETCH (t->slots + base, CLIB_CACHE_LINE_BYTES, LOAD);
+    }
+
+  for (i = 0; i < n_keys; i++)
+    {
+      if (swiss_8_8_search_with_hash (t, hash[i], search_key[i].key,
+				      &valuep[i]) < 0)
+	continue;
+      bitmap |= 1 << i;
+      ret++;
+    }
+
+  *valid_key_idx = bitmap;
+  return ret;
+}
+
+#endif /* __included_swiss_8_8_h__ */
@@ -0,0 +1,254 @@
+/*
+ * Calibrated cycle timer for the perf runs.
+ *
+ * Timestamps are serialized: lfence/rdtsc/lfence to open a timed region,
+ * rdtscp/lfence to close it, so the region neither starts early nor ends
+ * before the searches retired. The cost of an empty region is measured
+ * once and subtracted from every run.
+ *
+ * The TSC ticks at a constant rate whatever the core clock does. The
+ * ratio of core cycles to TSC ticks is read from APERF/MPERF through
+ * /dev/cpu/<n>/msr, or from a perf cycles counter, around every run.
+ * A run is "frequency stable" when that ratio stays within
+ * TIMER_FREQ_TOLERANCE of the one measured at calibration and the thread
+ * did not migrate. The msr device is the one of the CPU calibration ran
+ * on, so timer_calibrate pins the calling thread to that CPU until
+ * timer_calib_free restores its affinity; a run which still begins or
+ * ends on another CPU (the affinity changed meanwhile) has no ratio.
+ */
+#ifndef __included_timer_calib_h__
+#define __included_timer_calib_h__
+
+#include <x86intrin.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <math.h>
+
+#define TIMER_CALIB_ROUNDS     1000
+#define TIMER_CALIB_SPIN_TSC   (50ULL << 20)	/* ~20ms at a few GHz */
+#define TIMER_FREQ_TOLERANCE   0.02
+
+#define MSR_IA32_MPERF 0xe7
+#define MSR_IA32_APERF 0xe8
+
+typedef enum
+{
+  TIMER_FREQ_SRC_NONE,
+  TIMER_FREQ_SRC_MSR,
+  TIMER_FREQ_SRC_PERF,
+} timer_freq_src_t;
+
+typedef struct
+{
+  u64 overhead;			/* tsc ticks of an empty timed region */
+  timer_freq_src_t freq_src;
+  int fd;			/* msr device or perf event */
+  int cpu;
+  cpu_set_t saved_cpuset;	/* affinity before timer_calibrate pinned */
+  u8 is_pinned;
+  u8 is_calibrated;		/* 0: zeroed, nothing to free */
+
+  /* core cycles per tsc tick at calibration */
+  f64 core_ratio;
+
+  /* last run */
+  u64 core0, ref0;
+  int cpu0;
+  f64 last_ratio;
+  u8 last_stable;
+} timer_calib_t;
+
+always_inline u64
+timer_begin (void)
+{
+  u64 t;
+
+  _mm_lfence ();
+  t = __rdtsc ();
+  _mm_lfence ();
+  return t;
+}
+
+always_inline u64
+timer_end (void)
+{
+  u32 aux;
+  u64 t;
+
+  t = __rdtscp (&aux);
+  _mm_lfence ();
+  return t;
+}
+
+static inline int
+timer_msr_read (int fd, u32 msr, u64 * v)
+{
+  return pread (fd, v, sizeof (*v), msr) == sizeof (*v) ? 0 : -1;
+}
+
+/* core cycles and reference (tsc rate) cycles counted so far */
+static inline int
+timer_freq_sample (timer_calib_t * tc, u64 * core, u64 * ref)
+{
+  switch (tc->freq_src)
+    {
+    case TIMER_FREQ_SRC_MSR:
+      if (timer_msr_read (tc->fd, MSR_IA32_APERF, core) < 0 ||
+	  timer_msr_read (tc->fd, MSR_IA32_MPERF, ref) < 0)
+	return -1;
+      return 0;
+    case TIMER_FREQ_SRC_PERF:
+      if (read (tc->fd, core, sizeof (*core)) != sizeof (*core))
+	return -1;
+      *ref = timer_end ();
+      return 0;
+    default:
+      return -1;
+    }
+}
+
+static inline int
+timer_freq_open (timer_calib_t * tc)
+{
+  struct perf_event_attr pe;
+  char path[64];
+
+  tc->cpu = sched_getcpu ();
+  snprintf (path, sizeof (path), "/dev/cpu/%d/msr", tc->cpu);
+  if ((tc->fd = open (path, O_RDONLY)) >= 0)
+    {
+      u64 v;
+      if (timer_msr_read (tc->fd, MSR_IA32_APERF, &v) == 0)
+	return TIMER_FREQ_SRC_MSR;
+      close (tc->fd);
+    }
+
+  clib_memset (&pe, 0, sizeof (pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof (pe);
+  pe.config = PERF_COUNT_HW_CPU_CYCLES;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  tc->fd = syscall (__NR_perf_event_open, &pe, 0, -1, -1, 0);
+  if (tc->fd >= 0)
+    return TIMER_FREQ_SRC_PERF;
+  return TIMER_FREQ_SRC_NONE;
+}
+
+/* APERF/MPERF are per CPU: only those of tc->cpu can be read */
+always_inline int
+timer_freq_cpu_ok (timer_calib_t * tc, int cpu)
+{
+  return tc->freq_src != TIMER_FREQ_SRC_MSR || cpu == tc->cpu;
+}
+
+static inline void
+timer_freq_begin (timer_calib_t * tc)
+{
+  tc->cpu0 = sched_getcpu ();
+  if (!timer_freq_cpu_ok (tc, tc->cpu0) ||
+      timer_freq_sample (tc, &tc->core0, &tc->ref0) < 0)
+    tc->core0 = tc->ref0 = 0;
+}
+
+static inline void
+timer_freq_end (timer_calib_t * tc)
+{
+  u64 core, ref;
+
+  int cpu = sched_getcpu ();
+
+  tc->last_ratio = 0;
+  tc->last_stable = 0;
+  if (!tc->ref0 || !timer_freq_cpu_ok (tc, cpu) ||
+      timer_freq_sample (tc, &core, &ref) < 0 || ref == tc->ref0)
+    return;
+
+  tc->last_ratio = (f64) (core - tc->core0) / (ref - tc->ref0);
+  tc->last_stable = cpu == tc->cpu0 &&
+    fabs (tc->last_ratio - tc->core_ratio) <=
+    TIMER_FREQ_TOLERANCE * tc->core_ratio;
+}
+
+/* tsc ticks between begin and end, without the timer's own cost */
+always_inline u64
+timer_cycles (timer_calib_t * tc, u64 begin, u64 end)
+{
+  u64 d = end - begin;
+  return d > tc->overhead ? d - tc->overhead : 0;
+}
+
+static inline void
+timer_calibrate (timer_calib_t * tc)
+{
+  u64 t0, t1, d, spin;
+  u32 i;
+
+  clib_memset (tc, 0, sizeof (*tc));
+  tc->fd = -1;
+  tc->is_calibrated = 1;
+
+  /* stay on the CPU whose counters timer_freq_open picks */
+  if (pthread_getaffinity_np (pthread_self (), sizeof (tc->saved_cpuset),
+			      &tc->saved_cpuset) == 0)
+    {
+      cpu_set_t cpuset;
+
+      CPU_ZERO (&cpuset);
+      CPU_SET (sched_getcpu (), &cpuset);
+      tc->is_pinned = pthread_setaffinity_np (pthread_self (),
+					      sizeof (cpuset), &cpuset) == 0;
+    }
+
+  tc->overhead = ~0ULL;
+  for (i = 0; i < TIMER_CALIB_ROUNDS; i++)
+    {
+      t0 = timer_begin ();
+      t1 = timer_end ();
+      d = t1 - t0;
+      tc->overhead = clib_min (tc->overhead, d);
+    }
+
+  tc->freq_src = timer_freq_open (tc);
+  if (tc->freq_src == TIMER_FREQ_SRC_NONE)
+    return;
+
+  /* ratio under load, the way the perf runs see it */
+  timer_freq_begin (tc);
+  spin = timer_begin ();
+  while (timer_end () - spin < TIMER_CALIB_SPIN_TSC)
+    ;
+  tc->core_ratio = 1;
+  timer_freq_end (tc);
+  tc->core_ratio = tc->last_ratio;
+  if (tc->core_ratio == 0)
+    tc->freq_src = TIMER_FREQ_SRC_NONE;
+}
+
+/* safe on a timer_calib_t never calibrated */
+static inline void
+timer_calib_free (timer_calib_t * tc)
+{
+  if (!tc->is_calibrated)
+    return;
+  if (tc->fd >= 0)
+    close (tc->fd);
+  tc->fd = -1;
+  if (tc->is_pinned)
+    pthread_setaffinity_np (pthread_self (), sizeof (tc->saved_cpuset),
+			    &tc->saved_cpuset);
+  tc->is_pinned = 0;
+  tc->is_calibrated = 0;
+}
+
+always_inline char *
+timer_freq_src_name (timer_calib_t * tc)
+{
+  return tc->freq_src == TIMER_FREQ_SRC_MSR ? "aperf/mperf" :
+    tc->freq_src == TIMER_FREQ_SRC_PERF ? "perf cycles" : "none";
+}
+
+#endif /* __included_timer_calib_h__ */
@@ -0,0 +1,107 @@
+/*
+ * Wide key mode: clib_bihash_search (V0) against the batch search of
+ * bihash_batch_wide.h (W) for 16, 40 and 48 byte keys, where the key
+ * compare is a bigger share of a lookup. Included by bihash_application.c.
+ *
+ * Every key size gets its own bihash instantiation, built from the keys
+ * of the profile's table with its nbuckets and memory size. W is checked
+ * against V0 on a mix of present and absent keys.
+ */
+
+#define WIDE_KEYS_PREFIX 0x5bd1e9955bd1e995ULL
+
+#define _wide_keys_str(t) #t
+#define wide_keys_str(t) _wide_keys_str(t)
+
+#define foreach_wide_key_type                                           \
+  _(16_8)                                                               \
+  _(40_8)                                                               \
+  _(48_8)
+
+typedef enum
+{
+#define _(t) WIDE_KEY_##t,
+  foreach_wide_key_type
+#undef _
+  WIDE_KEY_N_TYPES,
+} wide_key_type_t;
+
+/* one instantiation per key size, see vppinfra/bihash_template.h */
+#undef __included_bihash_template_h__
+#include <vppinfra/bihash_16_8.h>
+#include <vppinfra/bihash_template.h>
+#include <vppinfra/bihash_template.c>
+#include "bihash_batch_wide.h"
+#include "wide_keys_template.c"
+
+#undef __included_bihash_template_h__
+#include <vppinfra/bihash_40_8.h>
+#include <vppinfra/bihash_template.h>
+#include <vppinfra/bihash_template.c>
+#include "bihash_batch_wide.h"
+#include "wide_keys_template.c"
+
+#undef __included_bihash_template_h__
+#include <vppinfra/bihash_48_8.h>
+#include <vppinfra/bihash_template.h>
+#include <vppinfra/bihash_template.c>
+#include "bihash_batch_wide.h"
+#include "wide_keys_template.c"
+
+/* back to the profile's bihash_8_8 for the rest of the file */
+#if BIHASH_USING_8_8_STATS
+#include <vppinfra/bihash_8_8_stats.h>
+#else
+#include <vppinfra/bihash_8_8.h>
+#endif
+
+void
+wide_keys_perf_test (bihash_profiler_main_t * bpm)
+{
+  u64 *present, *lookups = 0, *mixed = 0, i, n;
+  int failed[WIDE_KEY_N_TYPES];
+
+  present = search_kernel_table_keys (bpm);
+  n = vec_len (present) & ~7ULL;
+  if (n == 0)
+    goto done;
+
+  for (i = 0; i < n; i++)
+    {
+      vec_add1 (lookups, present[random () % vec_len (present)]);
+      /* absent keys have bit 63 set, as in filtered_lookup.c */
+      vec_add1 (mixed, present[random () % vec_len (present)] |
+		((u64) (random () & 1) << 63));
+    }
+
+  fformat (stdout, "Wide keys:%ld keys,%d buckets,W: %s kvp compare\n"
+	   "type  |---| key bytes |---| V0 CPO |---| W CPO |---| Ratio for OPS |---| Hits | \n",
+	   vec_len (present), bpm->h->nbuckets,
+#ifdef __AVX512F__
+	   "AVX512 masked"
+#else
+	   "scalar"
+#endif
+    );
+
+#define _(t)                                                            \
+  failed[WIDE_KEY_##t] = wide_keys_perf_test_##t (present, lookups,     \
+                                                  mixed,                \
+                                                  bpm->h->nbuckets,     \
+                                                  bpm->h->memory_size);
+  foreach_wide_key_type
+#undef _
+  fformat (stdout, "-------------------------------------------------------------------| \n");
+
+#define _(t)                                                            \
+  fformat (stdout, "clib_bihash_search_" #t "|-> MATCH <-|"             \
+           "clib_bihash_search_batch_wide_" #t " ---[%s]\n",            \
+           failed[WIDE_KEY_##t] ? "FAILED" : "PASS");
+  foreach_wide_key_type
+#undef _
+
+done:
+  vec_free (present);
+  vec_free (lookups);
+  vec_free (mixed);
+}
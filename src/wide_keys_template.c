@@ -0,0 +1,114 @@
+/*
+ * Wide key stage for one bihash instantiation, included by wide_keys.c
+ * once per key size, after bihash_batch_wide.h.
+ *
+ * The profile's 8-byte keys go in the last key word behind a prefix all
+ * keys share, so no compare can stop before the last word.
+ */
+
+always_inline void
+BV (wide_keys_fill) (BVT (clib_bihash_kv) * kv, u64 key)
+{
+  u32 i;
+
+  for (i = 0; i < bihash_wide_key_u64s - 1; i++)
+    kv->key[i] = WIDE_KEYS_PREFIX + i;
+  kv->key[i] = key;
+}
+
+/* cycles of the second of two runs of V0 (batch == 0) or W over keys */
+static u64
+BV (wide_keys_time) (BVT (clib_bihash) * h, u64 * keys, int batch,
+		     u64 * hits)
+{
+  BVT (clib_bihash_kv) kv[8], result[8];
+  u64 i, start, cycles = 0;
+  u8 valid_key_idx;
+  u32 j;
+  int warm;
+
+  for (warm = 0; warm < 2; warm++)
+    {
+      *hits = 0;
+      perf_timer_begin (start);
+      if (!batch)
+	for (i = 0; i < vec_len (keys); i++)
+	  {
+	    BV (wide_keys_fill) (&kv[0], keys[i]);
+	    if (BV (clib_bihash_search) (h, &kv[0], &result[0]) == 0)
+	      (*hits)++;
+	  }
+      else
+	for (i = 0; i < vec_len (keys); i += 8)
+	  {
+	    for (j = 0; j < 8; j++)
+	      BV (wide_keys_fill) (&kv[j], keys[i + j]);
+	    *hits += BV (clib_bihash_search_batch_wide) (h, kv, 0xFF, result,
+							 &valid_key_idx);
+	  }
+      perf_timer_end (start, cycles);
+    }
+  return cycles;
+}
+
+/* batches where W's bitmap or values differ from V0's */
+static u64
+BV (wide_keys_consistency) (BVT (clib_bihash) * h, u64 * keys)
+{
+  BVT (clib_bihash_kv) kv[8], result[8], result0;
+  u64 i, n_mismatch = 0;
+  u8 valid_key_idx, bitmap;
+  u32 j;
+
+  for (i = 0; i < vec_len (keys); i += 8)
+    {
+      for (j = 0; j < 8; j++)
+	BV (wide_keys_fill) (&kv[j], keys[i + j]);
+      BV (clib_bihash_search_batch_wide) (h, kv, 0xFF, result,
+					  &valid_key_idx);
+      bitmap = 0;
+      for (j = 0; j < 8; j++)
+	if (BV (clib_bihash_search) (h, &kv[j], &result0) == 0)
+	  {
+	    bitmap |= 1 << j;
+	    if (!(valid_key_idx & (1 << j)) ||
+		result[j].value != result0.value)
+	      break;
+	  }
+      if (j < 8 || bitmap != valid_key_idx)
+	n_mismatch++;
+    }
+  return n_mismatch;
+}
+
+/* prints a row of the wide key table; 0 if W matched V0 */
+static int
+BV (wide_keys_perf_test) (u64 * present, u64 * lookups, u64 * mixed,
+			  u32 nbuckets, uword memory_size)
+{
+  BVT (clib_bihash) _h, *h = &_h;
+  BVT (clib_bihash_kv) kv;
+  u64 i, cycles[2], hits[2], n_mismatch;
+
+  clib_memset (h, 0, sizeof (*h));
+  BV (clib_bihash_init) (h, "bihash-wide", nbuckets, memory_size);
+  for (i = 0; i < vec_len (present); i++)
+    {
+      BV (wide_keys_fill) (&kv, present[i]);
+      kv.value = present[i];
+      BV (clib_bihash_add_del) (h, &kv, 1 /* is_add */ );
+    }
+
+  cycles[0] = BV (wide_keys_time) (h, lookups, 0, &hits[0]);
+  cycles[1] = BV (wide_keys_time) (h, lookups, 1, &hits[1]);
+  n_mismatch = BV (wide_keys_consistency) (h, mixed);
+
+  fformat (stdout, "%s       %d       %.2f       %.2f       %.2f%%       %ld \n",
+	   wide_keys_str (BIHASH_TYPE) + 1, (int) bihash_wide_key_u64s * 8,
+	   (f64) cycles[0] / vec_len (lookups),
+	   (f64) cycles[1] / vec_len (lookups),
+	   cycles[1] ? 100.0 * cycles[0] / cycles[1] : 0, hits[0]);
+
+  BV (clib_bihash_free) (h);
+  return n_mismatch || hits[0] != hits[1] ? -1 : 0;
+}